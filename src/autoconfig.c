@@ -30,10 +30,12 @@
 #endif
 
 #include "autoconfig.h"
+#include "input_stats.h"
 #include "m64p_config.h"
 #include "m64p_types.h"
 #include "osal_preproc.h"
 #include "plugin.h"
+#include "trace.h"
 
 #if EMSCRIPTEN
 extern int findAutoInputConfigName(void* gamepadNamePtr, void* responseBufferPointer, int maxCharacters);
@@ -204,7 +206,7 @@ static int auto_compare_name(const char *joySDLName, char *line)
         return -1;
 }
 
-int auto_set_defaults(int iDeviceIdx, const char *joySDLName)
+static int parse_auto_config(int iDeviceIdx, const char *joySDLName)
 {
     FILE *pfIn;
     m64p_handle pConfig = NULL;
@@ -404,4 +406,13 @@ int auto_set_defaults(int iDeviceIdx, const char *joySDLName)
     return 0;
 }
 
+int auto_set_defaults(int iDeviceIdx, const char *joySDLName)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    int ControllersFound = parse_auto_config(iDeviceIdx, joySDLName);
 
+    trace_span("auto_set_defaults", start, iDeviceIdx);
+    input_stats_add(COUNTER_AUTOCONFIG_LOOKUPS, 1);
+    input_stats_add(COUNTER_AUTOCONFIG_USEC, input_stats_usec(start));
+    return ControllersFound;
+}
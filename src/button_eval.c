@@ -0,0 +1,217 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - button_eval.c                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <string.h>
+
+#include "button_eval.h"
+#include "m64p_types.h"
+#include "plugin.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BUTTON_EVAL_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#else
+#define BUTTON_EVAL_X86 0
+#endif
+
+/* the vector evaluators are compiled for their instruction set, and only called if the cpu has it */
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+typedef void (*ptr_ButtonEval)(const SButtonProgram *prog, Uint16 Buttons[4]);
+
+/* static data definitions */
+static ptr_ButtonEval l_Eval = button_eval_scalar;
+static const char    *l_EvalName = "scalar";
+
+/* static functions */
+#if BUTTON_EVAL_X86
+TARGET_SSE2 static void button_eval_sse2(const SButtonProgram *prog, Uint16 Buttons[4])
+{
+    int port;
+
+    for (port = 0; port < 4; port++)
+    {
+        unsigned int i = prog->start[port], end = i + prog->count[port];
+        __m128i acc = _mm_setzero_si128();
+
+        for (; i < end; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) &prog->value[i]);
+            v = _mm_and_si128(v, _mm_loadu_si128((const __m128i *) &prog->mask[i]));
+            v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *) &prog->flip[i]));
+            v = _mm_cmpgt_epi32(v, _mm_loadu_si128((const __m128i *) &prog->threshold[i]));
+            acc = _mm_or_si128(acc, _mm_and_si128(v, _mm_loadu_si128((const __m128i *) &prog->bit[i])));
+        }
+        acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        Buttons[port] = (Uint16) _mm_cvtsi128_si32(acc);
+    }
+}
+
+TARGET_AVX2 static void button_eval_avx2(const SButtonProgram *prog, Uint16 Buttons[4])
+{
+    int port;
+
+    for (port = 0; port < 4; port++)
+    {
+        unsigned int i = prog->start[port], end = i + prog->count[port];
+        __m256i acc = _mm256_setzero_si256();
+        __m128i acc4;
+
+        for (; i < end; i += 8)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *) &prog->value[i]);
+            v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i *) &prog->mask[i]));
+            v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *) &prog->flip[i]));
+            v = _mm256_cmpgt_epi32(v, _mm256_loadu_si256((const __m256i *) &prog->threshold[i]));
+            acc = _mm256_or_si256(acc, _mm256_and_si256(v, _mm256_loadu_si256((const __m256i *) &prog->bit[i])));
+        }
+        acc4 = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        acc4 = _mm_or_si128(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc4 = _mm_or_si128(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+        Buttons[port] = (Uint16) _mm_cvtsi128_si32(acc4);
+    }
+}
+#endif
+
+/* global functions */
+void button_eval_init(void)
+{
+    l_Eval = button_eval_scalar;
+    l_EvalName = "scalar";
+#if BUTTON_EVAL_X86
+#if SDL_VERSION_ATLEAST(2,0,4)
+    if (SDL_HasAVX2())
+    {
+        l_Eval = button_eval_avx2;
+        l_EvalName = "AVX2";
+        return;
+    }
+#endif
+    if (SDL_HasSSE2())
+    {
+        l_Eval = button_eval_sse2;
+        l_EvalName = "SSE2";
+    }
+#endif
+}
+
+const char *button_eval_name(void)
+{
+    return l_EvalName;
+}
+
+void button_eval_build(SButtonProgram *prog, const SBinding *const bind[4], const unsigned int count[4])
+{
+    unsigned int n = 0, i;
+    int port;
+
+    /* the padding entries are all zero: 0 > 0 is never true */
+    memset(prog, 0, sizeof(SButtonProgram));
+
+    for (port = 0; port < 4; port++)
+    {
+        int type;
+
+        prog->start[port] = n;
+        for (type = 0; type <= BIND_MOUSE; type++)
+        {
+            for (i = 0; i < count[port] && i < MAX_BUTTON_BINDINGS; i++)
+            {
+                const SBinding *b = &bind[port][i];
+
+                if (b->type != type)
+                    continue;
+                prog->source[n] = *b;
+                prog->bit[n] = 1u << b->target;
+                prog->mask[n] = -1;
+                switch (type)
+                {
+                    case BIND_JOY_AXIS_NEG:
+                        /* value <= param  <=>  ~value > -param - 2 */
+                        prog->flip[n] = -1;
+                        prog->threshold[n] = -b->param - 2;
+                        break;
+                    case BIND_JOY_AXIS_POS:
+                        /* value >= param  <=>  value > param - 1 */
+                        prog->threshold[n] = b->param - 1;
+                        break;
+                    case BIND_JOY_HAT:
+                        prog->mask[n] = b->param;
+                        break;
+                    case BIND_MOUSE:
+                        prog->mask[n] = b->index;
+                        prog->uses_mouse = 1;
+                        break;
+                    default:
+                        /* keys and buttons are 0 or 1 */
+                        break;
+                }
+                n++;
+            }
+            prog->type_end[port][type] = n;
+        }
+        n = (n + BUTTON_EVAL_WIDTH - 1) / BUTTON_EVAL_WIDTH * BUTTON_EVAL_WIDTH;
+        prog->count[port] = n - prog->start[port];
+    }
+    prog->size = n;
+}
+
+void button_eval_scalar(const SButtonProgram *prog, Uint16 Buttons[4])
+{
+    int port;
+
+    for (port = 0; port < 4; port++)
+    {
+        unsigned int i = prog->start[port], end = i + prog->count[port];
+        Uint32 word = 0;
+
+        for (; i < end; i++)
+        {
+            Sint32 v = (prog->value[i] & prog->mask[i]) ^ prog->flip[i];
+            word |= prog->bit[i] & (Uint32) -(Sint32) (v > prog->threshold[i]);
+        }
+        Buttons[port] = (Uint16) word;
+    }
+}
+
+void button_eval_run(const SButtonProgram *prog, Uint16 Buttons[4])
+{
+    (*l_Eval)(prog, Buttons);
+
+#ifdef _DEBUG
+    {
+        Uint16 check[4];
+
+        button_eval_scalar(prog, check);
+        if (memcmp(check, Buttons, sizeof(check)) != 0)
+            DebugMessage(M64MSG_ERROR, "%s button evaluator differs from the scalar one: %04X %04X %04X %04X / %04X %04X %04X %04X",
+                         l_EvalName, Buttons[0], Buttons[1], Buttons[2], Buttons[3], check[0], check[1], check[2], check[3]);
+    }
+#endif
+}
@@ -0,0 +1,93 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - button_eval.h                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __BUTTON_EVAL_H__
+#define __BUTTON_EVAL_H__
+
+#include <SDL.h>
+
+/* the controller mappings as they are read on every poll: only the inputs which are actually bound, in a few
+ * bytes each.  compile_bindings() builds them from the configuration */
+enum EBindType
+{
+    BIND_KEY = 0,       // index: scancode
+    BIND_JOY_BUTTON,    // index: joystick button
+    BIND_JOY_AXIS_NEG,  // index: joystick axis, pressed at or below 'param'
+    BIND_JOY_AXIS_POS,  // index: joystick axis, pressed at or above 'param'
+    BIND_JOY_HAT,       // index: joystick hat, param: hat position mask
+    BIND_STICK_AXIS,    // index: joystick axis moving the N64 stick, param: direction (1 or -1)
+    BIND_MOUSE          // index: mask of the mouse button in SDL_GetMouseState()
+};
+
+/* targets of the bindings: a bit of BUTTONS.Value (0-15), or one direction of the N64 stick */
+#define BIND_STICK(axis, positive)  (16 + (axis) * 2 + ((positive) ? 1 : 0))
+
+/* 6 bytes rather than 4, because 'param' holds the full 16 bit thresholds of the joystick axes.  moving them to
+ * a side table would save little: the buttons are evaluated from the arrays of SButtonProgram, so only the stick
+ * inputs and the joystick indexes in 'source' are read per sample.  with the sample state and the bindings header
+ * in front of them, the state a port reads on every poll spans 3 cache lines, not 1 or 2 */
+typedef struct
+{
+    Uint8  type;                    // EBindType
+    Uint8  target;                  // button number or BIND_STICK()
+    Uint16 index;
+    Sint16 param;
+} SBinding;
+
+#define MAX_BUTTON_BINDINGS 80      // 16 buttons * (key, joystick button, axis and hat, mouse button)
+#define MAX_STICK_BINDINGS  16      // 2 axes * (2 keys, 2 joystick axes, 2 hat positions, 2 buttons)
+
+/* the button inputs of all four ports as one program, evaluated with a single pass over flat arrays:
+ * an input is active if ((value & mask) ^ flip) > threshold, and then sets 'bit' in the button word of
+ * its port.  value[] is filled in from the devices for every sample.  the entries of each port are padded
+ * to a multiple of BUTTON_EVAL_WIDTH with entries which are never active, and grouped by the type of the input,
+ * so that value[] is filled in with one tight loop per device */
+#define BUTTON_EVAL_WIDTH   8       // 32 bit lanes of an AVX2 register
+#define BUTTON_EVAL_SIZE    (4 * ((MAX_BUTTON_BINDINGS + BUTTON_EVAL_WIDTH - 1) / BUTTON_EVAL_WIDTH * BUTTON_EVAL_WIDTH))
+
+typedef struct
+{
+    unsigned int start[4];          // first entry of each port
+    unsigned int count[4];          // entries of each port, a multiple of BUTTON_EVAL_WIDTH
+    unsigned int type_end[4][BIND_MOUSE + 1]; // the entries of a port are grouped by EBindType: type t ends at type_end[port][t]
+    unsigned int size;              // entries of all ports
+    int          uses_mouse;        // there are BIND_MOUSE entries
+    SBinding     source[BUTTON_EVAL_SIZE];
+    Sint32       value[BUTTON_EVAL_SIZE];
+    Sint32       mask[BUTTON_EVAL_SIZE];
+    Sint32       flip[BUTTON_EVAL_SIZE];
+    Sint32       threshold[BUTTON_EVAL_SIZE];
+    Uint32       bit[BUTTON_EVAL_SIZE];
+} SButtonProgram;
+
+/* picks the scalar, SSE2 or AVX2 evaluator for this cpu */
+extern void button_eval_init(void);
+extern const char *button_eval_name(void);
+
+/* builds the program from the button inputs of the 4 ports */
+extern void button_eval_build(SButtonProgram *prog, const SBinding *const bind[4], const unsigned int count[4]);
+
+/* evaluates the program with the values of the current sample; Buttons receives the button word of every port */
+extern void button_eval_run(const SButtonProgram *prog, Uint16 Buttons[4]);
+
+/* the scalar evaluator, which the others must match bit for bit */
+extern void button_eval_scalar(const SButtonProgram *prog, Uint16 Buttons[4]);
+
+#endif /* __BUTTON_EVAL_H__ */
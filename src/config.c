@@ -29,12 +29,16 @@
 #define M64P_PLUGIN_PROTOTYPES 1
 #include "autoconfig.h"
 #include "config.h"
+#include "input_ext.h"
+#include "input_stats.h"
 #include "m64p_config.h"
 #include "m64p_plugin.h"
 #include "m64p_types.h"
 #include "osal_preproc.h"
 #include "plugin.h"
+#include "probes.h"
 #include "sdl_key_converter.h"
+#include "trace.h"
 
 #define HAT_POS_NAME( hat )         \
        ((hat == SDL_HAT_UP) ? "Up" :        \
@@ -85,7 +89,7 @@ static int get_hat_pos_by_name( const char *name )
     return -1;
 }
 
-static void clear_controller(int iCtrlIdx)
+static void clear_controller(SController *controller, int iCtrlIdx)
 {
     int b;
 
@@ -93,6 +97,7 @@ static void clear_controller(int iCtrlIdx)
     controller[iCtrlIdx].control->Present = 0;
     controller[iCtrlIdx].control->RawData = 0;
     controller[iCtrlIdx].control->Plugin = PLUGIN_MEMPAK;
+    controller[iCtrlIdx].input_delay = 0;
     for( b = 0; b < 16; b++ )
     {
         controller[iCtrlIdx].button[b].button = -1;
@@ -147,7 +152,7 @@ static const char * get_sdl_joystick_name(int iCtrlIdx)
 // return value: 1 = OK
 //               0 = fail: couldn't open config section
 
-static int load_controller_config(const char *SectionName, int i, int sdlDeviceIdx)
+static int load_controller_config(SController *controller, const char *SectionName, int i, int sdlDeviceIdx)
 {
     m64p_handle pConfig;
     char input_str[256], value1_str[16], value2_str[16];
@@ -274,7 +279,7 @@ static int load_controller_config(const char *SectionName, int i, int sdlDeviceI
     return 1;
 }
 
-static void init_controller_config(int iCtrlIdx, const char *pccDeviceName, eModeType mode)
+static void init_controller_config(SController *controller, int iCtrlIdx, const char *pccDeviceName, eModeType mode)
 {
     m64p_handle pConfig;
     char SectionName[32], Param[32], ParamString[128];
@@ -297,6 +302,10 @@ static void init_controller_config(int iCtrlIdx, const char *pccDeviceName, eMod
     ConfigSetDefaultString(pConfig, "name", pccDeviceName, "SDL joystick name (or Keyboard)");
     ConfigSetDefaultBool(pConfig, "plugged", controller[iCtrlIdx].control->Present, "Specifies whether this controller is 'plugged in' to the simulated N64");
     ConfigSetDefaultInt(pConfig, "plugin", controller[iCtrlIdx].control->Plugin, "Specifies which type of expansion pak is in the controller: 1=None, 2=Mem pak, 4=Transfer pak, 5=Rumble pak");
+    ConfigSetDefaultBool(pConfig, "RawData", controller[iCtrlIdx].control->RawData, "If True, the core sends the raw PIF commands for this controller to the plugin, which then emulates the Mem pak and Transfer pak itself");
+    ConfigSetDefaultString(pConfig, "TransferPakROM", "", "Path to the Game Boy ROM in the Transfer pak (RawData mode only)");
+    ConfigSetDefaultString(pConfig, "TransferPakSav", "", "Path to the Game Boy cartridge save.  If empty, the ROM path with a .sav extension is used");
+    ConfigSetDefaultInt(pConfig, "InputDelay", controller[iCtrlIdx].input_delay, "Number of frames (0-32) by which the input of this controller is delayed, for delay based netplay");
     ConfigSetDefaultBool(pConfig, "mouse", controller[iCtrlIdx].mouse, "If True, then mouse buttons may be used with this controller");
 
     sprintf(Param, "%.2f,%.2f", controller[iCtrlIdx].mouse_sens[0], controller[iCtrlIdx].mouse_sens[1]);
@@ -394,7 +403,7 @@ static void init_controller_config(int iCtrlIdx, const char *pccDeviceName, eMod
 
 }
 
-static int setup_auto_controllers(int bPreConfig, int n64CtrlStart, int sdlCtrlIdx, const char *sdlJoyName, eModeType ControlMode[], eModeType OrigControlMode[], char DeviceName[][256])
+static int setup_auto_controllers(SController *controller, int bPreConfig, int n64CtrlStart, int sdlCtrlIdx, const char *sdlJoyName, eModeType ControlMode[], eModeType OrigControlMode[], char DeviceName[][256])
 {
     char SectionName[32];
     int ActiveControllers = 0;
@@ -411,7 +420,7 @@ static int setup_auto_controllers(int bPreConfig, int n64CtrlStart, int sdlCtrlI
         auto_copy_inputconfig("AutoConfig0", SectionName, sdlJoyName);
     else
         auto_copy_inputconfig("AutoConfig0", SectionName, NULL);  // don't overwrite 'name' parameter if original mode was "named auto"
-    if (load_controller_config("AutoConfig0", n64CtrlStart, sdlCtrlIdx) > 0)
+    if (load_controller_config(controller, "AutoConfig0", n64CtrlStart, sdlCtrlIdx) > 0)
     {
         if (!bPreConfig)
             DebugMessage(M64MSG_INFO, "N64 Controller #%i: Using auto-config with SDL joystick %i ('%s')", n64CtrlStart+1, sdlCtrlIdx, sdlJoyName);
@@ -443,7 +452,7 @@ static int setup_auto_controllers(int bPreConfig, int n64CtrlStart, int sdlCtrlI
             {
                 sprintf(SectionName, "Input-SDL-Control%i", n64CtrlStart + j + 1);
                 /* load our plugin joystick settings from the autoconfig */
-                if (load_controller_config(AutoSectionName, n64CtrlStart+j, sdlCtrlIdx) > 0)
+                if (load_controller_config(controller, AutoSectionName, n64CtrlStart+j, sdlCtrlIdx) > 0)
                 {
                     /* copy the auto-config settings to the controller config section */
                     if (OrigControlMode[n64CtrlStart+j] == E_MODE_FULL_AUTO)
@@ -472,9 +481,10 @@ static int setup_auto_controllers(int bPreConfig, int n64CtrlStart, int sdlCtrlI
 
 /* global functions */
 
-/* There are 4 special section parameters: version, mode, device, and name.  There are also 24 regular
- * parameters: plugged, plugin, mouse, MouseSensitivity, DPad R/L/D/U, Start, Z/L/R Trigger, A/B button,
- * C Button R/L/D/U, Mempak/Rumblepak switch, X/Y Axis, AnalogDeadzone, AnalogPeak.
+/* There are 4 special section parameters: version, mode, device, and name.  There are also 28 regular
+ * parameters: plugged, plugin, RawData, TransferPakROM, TransferPakSav, InputDelay, mouse, MouseSensitivity,
+ * DPad R/L/D/U, Start, Z/L/R Trigger, A/B button, C Button R/L/D/U, Mempak/Rumblepak switch, X/Y Axis,
+ * AnalogDeadzone, AnalogPeak.
  *
  * The N64 controller configuration behavior is regulated by the 'mode' parameter.  If this parameter is
  * 0 (Fully Manual), then all configuration data is loaded and parsed without changes or autoconfig from
@@ -496,7 +506,7 @@ static int setup_auto_controllers(int bPreConfig, int n64CtrlStart, int sdlCtrlI
  * functions are called in quick sequence from the console-ui).
  */
   
-void load_configuration(int bPreConfig)
+void load_configuration(SController *controller, int bPreConfig)
 {
     char SectionName[32];
     int joy_plugged = 0;
@@ -511,6 +521,9 @@ void load_configuration(int bPreConfig)
     float fVersion = 0.0f;
     const char *sdl_name;
     int ControllersFound = 0;
+    Uint64 config_start = SDL_GetPerformanceCounter(), pass_start = trace_now();
+
+    PROBE3(config_phase, PROBE_CONFIG_BEGIN, bPreConfig, 0);
 
     /* tell user how many SDL joysticks are available */
     if (!bPreConfig)
@@ -521,7 +534,7 @@ void load_configuration(int bPreConfig)
     {
         m64p_handle pConfig;
         /* reset the controller configuration */
-        clear_controller(n64CtrlIdx);
+        clear_controller(controller, n64CtrlIdx);
 
         /* Open the configuration section for this controller */
         sprintf(SectionName, "Input-SDL-Control%i", n64CtrlIdx + 1);
@@ -542,7 +555,7 @@ void load_configuration(int bPreConfig)
             ControlDevice[n64CtrlIdx] = DEVICE_NO_JOYSTICK;
             DeviceName[n64CtrlIdx][0] = 0;
             // write blank config for GUI front-ends
-            init_controller_config(n64CtrlIdx, "", E_MODE_FULL_AUTO);
+            init_controller_config(controller, n64CtrlIdx, "", E_MODE_FULL_AUTO);
         }
         else
         {
@@ -569,9 +582,28 @@ void load_configuration(int bPreConfig)
                 DebugMessage(M64MSG_WARNING, "missing 'plugin' parameter from config section %s. Setting to 2 (mempak).", SectionName);
                 controller[n64CtrlIdx].control->Plugin = PLUGIN_MEMPAK;
             }
+            /* the RawData and TransferPak parameters were added without a version change, so they may be missing */
+            ConfigSetDefaultBool(pConfig, "RawData", 0, "If True, the core sends the raw PIF commands for this controller to the plugin, which then emulates the Mem pak and Transfer pak itself");
+            if (ConfigGetParameter(pConfig, "RawData", M64TYPE_BOOL, &controller[n64CtrlIdx].control->RawData, sizeof(int)) != M64ERR_SUCCESS)
+                controller[n64CtrlIdx].control->RawData = 0;
+            /* the transfer pak cartridge paths are read by tpak_open() when a rom starts */
+            ConfigSetDefaultString(pConfig, "TransferPakROM", "", "Path to the Game Boy ROM in the Transfer pak (RawData mode only)");
+            ConfigSetDefaultString(pConfig, "TransferPakSav", "", "Path to the Game Boy cartridge save.  If empty, the ROM path with a .sav extension is used");
+            ConfigSetDefaultInt(pConfig, "InputDelay", 0, "Number of frames (0-32) by which the input of this controller is delayed, for delay based netplay");
+            if (ConfigGetParameter(pConfig, "InputDelay", M64TYPE_INT, &controller[n64CtrlIdx].input_delay, sizeof(int)) != M64ERR_SUCCESS ||
+                controller[n64CtrlIdx].input_delay < 0 || controller[n64CtrlIdx].input_delay > INPUT_DELAY_MAX)
+            {
+                if (!bPreConfig)
+                    DebugMessage(M64MSG_WARNING, "Invalid 'InputDelay' parameter in config section '%s'.  Setting to 0", SectionName);
+                controller[n64CtrlIdx].input_delay = 0;
+            }
         }
     }
 
+    PROBE3(config_phase, PROBE_CONFIG_SECTIONS, bPreConfig, 0);
+    trace_span("load_configuration: sections", pass_start, bPreConfig);
+    pass_start = trace_now();
+
     /* loop through 4 N64 controllers and set up those in Fully Manual mode */
     for (n64CtrlIdx=0; n64CtrlIdx < 4; n64CtrlIdx++)
     {
@@ -579,7 +611,7 @@ void load_configuration(int bPreConfig)
             continue;
         /* load the stored configuration (disregard any errors) */
         sprintf(SectionName, "Input-SDL-Control%i", n64CtrlIdx + 1);
-        load_controller_config(SectionName, n64CtrlIdx, ControlDevice[n64CtrlIdx]);
+        load_controller_config(controller, SectionName, n64CtrlIdx, ControlDevice[n64CtrlIdx]);
         /* if this config uses an SDL joystick, mark it as used */
         if (ControlDevice[n64CtrlIdx] == DEVICE_NO_JOYSTICK)
         {
@@ -595,6 +627,10 @@ void load_configuration(int bPreConfig)
         ActiveControllers++;
     }
 
+    PROBE3(config_phase, PROBE_CONFIG_MANUAL, bPreConfig, ActiveControllers);
+    trace_span("load_configuration: manual", pass_start, bPreConfig);
+    pass_start = trace_now();
+
     /* now loop through again, setting up those in Named Auto mode */
     for (n64CtrlIdx=0; n64CtrlIdx < 4; n64CtrlIdx++)
     {
@@ -611,7 +647,7 @@ void load_configuration(int bPreConfig)
         if (strcasecmp(DeviceName[n64CtrlIdx], "Keyboard") == 0)
         {
             auto_set_defaults(DEVICE_NO_JOYSTICK, "Keyboard");
-            if (load_controller_config("AutoConfig0", n64CtrlIdx, DEVICE_NO_JOYSTICK) > 0)
+            if (load_controller_config(controller, "AutoConfig0", n64CtrlIdx, DEVICE_NO_JOYSTICK) > 0)
             {
                 if (!bPreConfig)
                     DebugMessage(M64MSG_INFO, "N64 Controller #%i: Using auto-config for keyboard", n64CtrlIdx+1);
@@ -643,7 +679,7 @@ void load_configuration(int bPreConfig)
             if (sdl_name != NULL && strncmp(DeviceName[n64CtrlIdx], sdl_name, 255) == 0)
             {
                 /* set up one or more controllers for this SDL device, if present in InputAutoConfig.ini */
-                int ControllersFound = setup_auto_controllers(bPreConfig, n64CtrlIdx, sdlCtrlIdx, sdl_name, ControlMode, OrigControlMode, DeviceName);
+                int ControllersFound = setup_auto_controllers(controller, bPreConfig, n64CtrlIdx, sdlCtrlIdx, sdl_name, ControlMode, OrigControlMode, DeviceName);
                 if (ControllersFound == 0)
                 {
                     // error: no auto-config found for this SDL device
@@ -669,6 +705,10 @@ void load_configuration(int bPreConfig)
         }
     }
 
+    PROBE3(config_phase, PROBE_CONFIG_NAMED_AUTO, bPreConfig, ActiveControllers);
+    trace_span("load_configuration: named auto", pass_start, bPreConfig);
+    pass_start = trace_now();
+
     /* Final loop through N64 controllers, setting up those in Full Auto mode */
     for (n64CtrlIdx=0; n64CtrlIdx < 4; n64CtrlIdx++)
     {
@@ -689,7 +729,7 @@ void load_configuration(int bPreConfig)
                 continue;
             /* set up one or more controllers for this SDL device, if present in InputAutoConfig.ini */
             sdl_name = get_sdl_joystick_name(sdlCtrlIdx);
-            ControllersFound = setup_auto_controllers(bPreConfig, n64CtrlIdx, sdlCtrlIdx, sdl_name, ControlMode, OrigControlMode, DeviceName);
+            ControllersFound = setup_auto_controllers(controller, bPreConfig, n64CtrlIdx, sdlCtrlIdx, sdl_name, ControlMode, OrigControlMode, DeviceName);
             if (!bPreConfig && ControllersFound == 0)
             {
                 // error: no auto-config found for this SDL device
@@ -718,13 +758,17 @@ void load_configuration(int bPreConfig)
         }
     }
 
+    PROBE3(config_phase, PROBE_CONFIG_FULL_AUTO, bPreConfig, ActiveControllers);
+    trace_span("load_configuration: full auto", pass_start, bPreConfig);
+    pass_start = trace_now();
+
     /* fallback to keyboard if no controllers were configured */
     if (ActiveControllers == 0)
     {
         if (!bPreConfig)
             DebugMessage(M64MSG_INFO, "N64 Controller #1: Forcing default keyboard configuration");
         auto_set_defaults(DEVICE_NO_JOYSTICK, "Keyboard");
-        if (load_controller_config("AutoConfig0", 0, DEVICE_NO_JOYSTICK) > 0)
+        if (load_controller_config(controller, "AutoConfig0", 0, DEVICE_NO_JOYSTICK) > 0)
         {
             /* copy the auto-config settings to the controller config section */
             if (OrigControlMode[0] == E_MODE_FULL_AUTO)
@@ -764,6 +808,122 @@ void load_configuration(int bPreConfig)
         }
     }
 
+    PROBE3(config_phase, PROBE_CONFIG_END, bPreConfig, ActiveControllers);
+    trace_span("load_configuration", config_start, bPreConfig);
+    input_stats_add(COUNTER_CONFIG_LOADS, 1);
+    input_stats_add(COUNTER_CONFIG_USEC, input_stats_usec(config_start));
 }
 
 
+
+/* appends an input to the list of its target: the button inputs, or the stick inputs, where the keys have to be
+ * added before the joystick inputs */
+static void add_binding(SBindings *bindings, int type, int target, int index, int param)
+{
+    SBinding *bind;
+
+    if (target < 16)
+    {
+        if (bindings->num_buttons >= MAX_BUTTON_BINDINGS)
+            return;
+        bind = &bindings->button[bindings->num_buttons++];
+    }
+    else
+    {
+        if (bindings->num_stick_keys + bindings->num_stick_joy >= MAX_STICK_BINDINGS)
+            return;
+        bind = &bindings->stick[bindings->num_stick_keys + bindings->num_stick_joy];
+        if (type == BIND_KEY)
+            bindings->num_stick_keys++;
+        else
+            bindings->num_stick_joy++;
+    }
+    bind->type = (Uint8) type;
+    bind->target = (Uint8) target;
+    bind->index = (Uint16) index;
+    bind->param = (Sint16) param;
+}
+
+static void add_key_binding(SBindings *bindings, int target, int key)
+{
+    if (key > 0 && key < SDL_NUM_SCANCODES)
+        add_binding(bindings, BIND_KEY, target, key, 0);
+}
+
+/* compile_bindings()
+ *
+ * Builds the compact lists of bound inputs which are read on every poll: the button inputs, which go into the
+ * program of button_eval.c, and the stick inputs, which doSdlKeys() and evaluate_port() walk.  The stick
+ * inputs are stored in the order in which they used to be checked, because the last active input of an axis
+ * wins.  Inputs which can never be active (no key, an axis without a
+ * direction, a threshold beyond the range of the joystick axis, ...) are left out.
+ */
+void compile_bindings(SController *controller)
+{
+    SBindings *bindings = &controller->bindings;
+    int b;
+
+    memset(bindings, 0, sizeof(SBindings));
+
+    /* keys */
+    for (b = 0; b < 16; b++)
+        add_key_binding(bindings, b, (int) controller->button[b].key);
+    for (b = 0; b < 2; b++)
+    {
+        add_key_binding(bindings, BIND_STICK(b, 0), (int) controller->axis[b].key_a);
+        add_key_binding(bindings, BIND_STICK(b, 1), (int) controller->axis[b].key_b);
+    }
+
+    /* joystick */
+    if (controller->device >= 0)
+    {
+        for (b = 0; b < 16; b++)
+        {
+            SButtonMap *map = &controller->button[b];
+
+            if (map->button >= 0)
+                add_binding(bindings, BIND_JOY_BUTTON, b, map->button, 0);
+            if (map->axis >= 0)
+            {
+                int deadzone = (map->axis_deadzone < 0) ? 16384 : map->axis_deadzone;
+                if (map->axis_dir < 0 && deadzone <= 32768)
+                    add_binding(bindings, BIND_JOY_AXIS_NEG, b, map->axis, -deadzone);
+                else if (map->axis_dir > 0 && deadzone <= 32767)
+                    add_binding(bindings, BIND_JOY_AXIS_POS, b, map->axis, deadzone);
+            }
+            if (map->hat >= 0 && map->hat_pos > 0)
+                add_binding(bindings, BIND_JOY_HAT, b, map->hat, map->hat_pos);
+        }
+        for (b = 0; b < 2; b++)
+        {
+            SAxisMap *map = &controller->axis[b];
+
+            bindings->deadzone[b] = controller->axis_deadzone[b];
+            bindings->range[b] = controller->axis_peak[b] - controller->axis_deadzone[b];
+            /* skip this axis if the deadzone/peak values are invalid */
+            if (bindings->deadzone[b] < 0 || bindings->range[b] < 1)
+                continue;
+
+            if (map->axis_a >= 0 && map->axis_dir_a != 0)
+                add_binding(bindings, BIND_STICK_AXIS, BIND_STICK(b, 0), map->axis_a, map->axis_dir_a > 0 ? 1 : -1);
+            if (map->axis_b >= 0 && map->axis_dir_b != 0)
+                add_binding(bindings, BIND_STICK_AXIS, BIND_STICK(b, 1), map->axis_b, map->axis_dir_b > 0 ? 1 : -1);
+            if (map->hat >= 0 && map->hat_pos_a > 0)
+                add_binding(bindings, BIND_JOY_HAT, BIND_STICK(b, 0), map->hat, map->hat_pos_a);
+            if (map->hat >= 0 && map->hat_pos_b > 0)
+                add_binding(bindings, BIND_JOY_HAT, BIND_STICK(b, 1), map->hat, map->hat_pos_b);
+            if (map->button_a >= 0)
+                add_binding(bindings, BIND_JOY_BUTTON, BIND_STICK(b, 0), map->button_a, 0);
+            if (map->button_b >= 0)
+                add_binding(bindings, BIND_JOY_BUTTON, BIND_STICK(b, 1), map->button_b, 0);
+        }
+    }
+
+    /* mouse buttons; SDL_GetMouseState() is read into 8 bits */
+    for (b = 0; b < 16; b++)
+    {
+        int mouse = controller->button[b].mouse;
+        if (mouse >= 1 && mouse <= 8)
+            add_binding(bindings, BIND_MOUSE, b, SDL_BUTTON(mouse), 0);
+    }
+}
@@ -22,9 +22,15 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#include "plugin.h"
+
 #define CONFIG_VERSION 2.00
 
-extern void load_configuration(int bPreConfig);
+/* fills in controller[0..3] (and the CONTROL structs they point to) from the config sections */
+extern void load_configuration(SController *controller, int bPreConfig);
+
+/* builds controller->bindings from its button/axis mappings; the joystick inputs only if it uses a joystick */
+extern void compile_bindings(SController *controller);
 
 #endif /* __CONFIG_H__ */
 
@@ -0,0 +1,97 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_delay.c                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <string.h>
+
+#include "m64p_plugin.h"
+#include "input_delay.h"
+#include "input_ext.h"
+#include "osal_atomic.h"
+#include "plugin.h"
+
+/* global functions */
+void input_delay_reset(SDelayQueue *queue, unsigned int Frames)
+{
+    memset(queue, 0, sizeof(SDelayQueue));
+    input_delay_set(queue, Frames);
+}
+
+void input_delay_set(SDelayQueue *queue, unsigned int Frames)
+{
+    if (Frames > INPUT_DELAY_MAX)
+        Frames = INPUT_DELAY_MAX;
+    osal_atomic_store(&queue->delay, Frames);
+}
+
+void input_delay_apply(SDelayQueue *queue, BUTTONS *Keys)
+{
+    unsigned int delay = osal_atomic_load(&queue->delay);
+    SDelayEntry *entry;
+    Uint64 now;
+
+    queue->stats.polls++;
+    queue->stats.delay = delay;
+
+    if (delay == 0 && queue->count == 0)
+    {
+        queue->stats.delay_polls[0]++;
+        queue->stats.delay_usec[0]++;
+        queue->last = Keys->Value;
+        return;
+    }
+
+    now = SDL_GetPerformanceCounter();
+    entry = &queue->entry[queue->head];
+    entry->value = Keys->Value;
+    entry->poll = queue->stats.polls;
+    entry->time = now;
+    queue->head = (queue->head + 1) & (DELAY_QUEUE_SIZE - 1);
+    queue->count++;
+
+    /* the delay was lowered: drop the oldest inputs */
+    while (queue->count > delay + 1)
+    {
+        queue->count--;
+        queue->stats.dropped++;
+    }
+
+    /* the delay was raised (or the rom just started): hold the previous input until the queue is full */
+    if (queue->count <= delay)
+    {
+        Keys->Value = queue->last;
+        queue->stats.repeated++;
+        return;
+    }
+
+    entry = &queue->entry[(queue->head - queue->count) & (DELAY_QUEUE_SIZE - 1)];
+    queue->count--;
+    queue->last = Keys->Value = entry->value;
+    queue->stats.delay_polls[queue->stats.polls - entry->poll]++;
+    queue->stats.delay_usec[input_stats_usec_bucket(input_stats_ticks_to_usec(now - entry->time))]++;
+}
+
+void input_delay_get_stats(SDelayQueue *queue, input_delay_stats *Stats)
+{
+    *Stats = queue->stats;
+    Stats->size = sizeof(input_delay_stats);
+    Stats->delay = osal_atomic_load(&queue->delay);
+}
+
@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_delay.h                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_DELAY_H__
+#define __INPUT_DELAY_H__
+
+#include <SDL.h>
+
+#include "input_ext.h"
+#include "m64p_plugin.h"
+
+#define DELAY_QUEUE_SIZE    64          // power of 2, > INPUT_DELAY_MAX + 1
+
+typedef struct
+{
+    unsigned int value;
+    unsigned int poll;                  // poll counter at which the input was queued
+    Uint64       time;
+} SDelayEntry;
+
+/* only touched by the emulation thread, except for 'delay' */
+typedef struct
+{
+    SDelayEntry           entry[DELAY_QUEUE_SIZE];
+    volatile unsigned int delay;        // polls by which the input is held back
+    unsigned int          head;         // next entry to be written
+    unsigned int          count;
+    unsigned int          last;         // last value returned
+    input_delay_stats     stats;
+} SDelayQueue;
+
+/* empties the queue and clears the statistics */
+extern void input_delay_reset(SDelayQueue *queue, unsigned int Frames);
+
+/* changes the delay of a port; may be called from any thread */
+extern void input_delay_set(SDelayQueue *queue, unsigned int Frames);
+
+/* queues the new state of the port and replaces it with the one which is due now (emulation thread) */
+extern void input_delay_apply(SDelayQueue *queue, BUTTONS *Keys);
+
+extern void input_delay_get_stats(SDelayQueue *queue, input_delay_stats *Stats);
+
+#endif /* __INPUT_DELAY_H__ */
+
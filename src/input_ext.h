@@ -0,0 +1,343 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_ext.h                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* this header declares the functions which this plugin exports in addition to the standard input
+ * plugin API (m64p_plugin.h).  a core or front-end should check the Capabilities bits returned by
+ * PluginGetVersion() and look the functions up with its dynamic library loader before using them. */
+
+#if !defined(INPUT_EXT_H)
+#define INPUT_EXT_H
+
+#include <stdint.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bits in the Capabilities value from PluginGetVersion() */
+#define INPUT_CAPS_GET_ALL_KEYS     0x0001      // GetAllKeys() is available
+#define INPUT_CAPS_INPUT_SERVER     0x0002      // GetInputServerStatus() is available
+#define INPUT_CAPS_INPUT_HISTORY    0x0004      // the InputHistory*() functions are available
+#define INPUT_CAPS_SAVE_STATE       0x0008      // InputSaveState() and InputLoadState() are available
+#define INPUT_CAPS_INPUT_DELAY      0x0010      // SetInputDelay() and GetInputDelayStats() are available
+#define INPUT_CAPS_INPUT_HASH       0x0020      // GetInputHash() is available
+#define INPUT_CAPS_INSTANCES        0x0040      // the InputInstance*() functions are available
+#define INPUT_CAPS_INPUT_SAMPLER    0x0080      // GetInputSamplerStats() is available
+#define INPUT_CAPS_INPUT_STATS      0x0100      // GetInputStats() and ResetInputStats() are available
+
+/* GetAllKeys()
+ *
+ * Fills in the state of all 4 controllers from a single sample of the input devices.  A core can call
+ * this once per frame instead of calling GetKeys() for every port.
+ */
+typedef void (*ptr_GetAllKeys)(BUTTONS *Keys);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT void CALL GetAllKeys(BUTTONS *Keys);
+#endif
+
+/* Shared memory input
+ *
+ * If the 'SharedMemoryName' parameter of the 'Input-SDL' config section is set, the plugin creates (or
+ * attaches to) a POSIX shared memory object of that name which holds an input_shm_header.  Another
+ * process can then drive any of the controller ports by publishing frames into the ring:
+ *
+ *   slot = &shm->ring[shm->write_index % INPUT_SHM_RING_SIZE]
+ *   slot->seq++ (now odd), fill in frame/ports/buttons, slot->seq++ (even again)
+ *   shm->write_index++ (with release semantics)
+ *
+ * Normally the plugin uses the newest frame whenever the game polls the controllers.  With
+ * 'SharedMemoryLockstep' enabled, every frame is used for exactly one poll of the controllers, and the
+ * game waits for the next frame; the producer must then not get more than INPUT_SHM_RING_SIZE frames
+ * ahead of read_index.  A port whose bit is set in 'ports' takes its state from 'buttons' (a
+ * BUTTONS.Value) instead of the local input devices.
+ */
+#define INPUT_SHM_MAGIC         0x4d485334  // "4SHM"
+#define INPUT_SHM_VERSION       1
+#define INPUT_SHM_RING_SIZE     64
+
+typedef struct
+{
+    volatile uint32_t seq;          // odd while the producer writes this slot
+    uint32_t          frame;        // producer's frame number, for its own bookkeeping
+    uint32_t          ports;        // bit n set: the frame drives port n
+    uint32_t          buttons[4];
+    uint32_t          reserved;
+} input_shm_frame;
+
+typedef struct
+{
+    uint32_t          magic;
+    uint32_t          version;
+    uint32_t          ring_size;
+    uint32_t          lockstep;     // copy of the plugin's 'SharedMemoryLockstep' setting
+    volatile uint32_t write_index;  // frames published by the producer
+    volatile uint32_t read_index;   // frames taken by the plugin
+    uint32_t          reserved[2];
+    input_shm_frame   ring[INPUT_SHM_RING_SIZE];
+} input_shm_header;
+
+/* Input server
+ *
+ * If the 'SocketPath' parameter of the 'Input-SDL' config section is set, the plugin listens on a unix
+ * domain stream socket at that path.  Clients send fixed size messages of INPUT_SERVER_MSG_SIZE bytes,
+ * all values little endian:
+ *
+ *   byte  0      port (0-3)
+ *   byte  1      flags: INPUT_SERVER_DRIVE set = use this state for the port, clear = give the port
+ *                back to the local input devices
+ *   bytes 2-3    N64 buttons (the low 16 bits of BUTTONS.Value)
+ *   byte  4      X axis (signed, -80 to 80)
+ *   byte  5      Y axis (signed, -80 to 80)
+ *   bytes 6-7    reserved, 0
+ *   bytes 8-11   frame id; a message with an older frame id than the last one for its port is dropped
+ *
+ * The state of a driven port replaces the local devices.  Shared memory input (above) takes priority
+ * over the input server.
+ */
+#define INPUT_SERVER_MSG_SIZE   12
+#define INPUT_SERVER_DRIVE      0x01
+
+typedef struct
+{
+    unsigned int size;              // set to sizeof(input_server_status) by the caller
+    int          listening;         // 1 if the server socket is open
+    unsigned int clients;           // connected clients
+    unsigned int messages;          // messages applied since the rom was opened
+    unsigned int stale;             // messages dropped because of an old frame id
+    unsigned int batches;           // wakeups of the server thread which read messages
+    unsigned int max_batch;         // most messages read in one wakeup
+    unsigned int queue_depth;       // bytes waiting in the client sockets at the last wakeup
+} input_server_status;
+
+/* GetInputServerStatus()
+ *
+ * Fills in the statistics of the input server.  Returns M64ERR_INPUT_INVALID if Status->size is wrong.
+ */
+typedef m64p_error (*ptr_GetInputServerStatus)(input_server_status *Status);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL GetInputServerStatus(input_server_status *Status);
+#endif
+
+/* Input history
+ *
+ * For rollback netplay, the plugin keeps the input of the last INPUT_HISTORY_SIZE frames of every port,
+ * indexed by the caller's frame number (which may wrap around).  The storage is fixed, so none of these
+ * functions allocate.  All of them have to be called from the same thread.
+ *
+ * InputHistoryConfirm() stores the real input of a frame: the local input read with GetKeys(), or a
+ * remote player's input received over the network.  Confirming a frame again revises it.
+ *
+ * InputHistoryGet() returns the confirmed input of a frame or, if there is none yet, a prediction: the
+ * input of the newest confirmed frame before it (or no buttons pressed if there is none).
+ *
+ * When a frame is confirmed with a different value than InputHistoryGet() returned for it, the frame is
+ * mispredicted.  InputHistoryMispredicted() returns the oldest mispredicted frame since its last call,
+ * which is where the caller has to roll back to.
+ *
+ * Get and Confirm return M64ERR_INPUT_INVALID for a bad port or for a frame which is too far behind the
+ * newest frame to still be in the history.  InputHistoryReset(-1) clears all ports.
+ */
+#define INPUT_HISTORY_SIZE      128
+
+typedef m64p_error (*ptr_InputHistoryGet)(int Control, unsigned int Frame, BUTTONS *Keys);
+typedef m64p_error (*ptr_InputHistoryConfirm)(int Control, unsigned int Frame, BUTTONS Keys);
+typedef int        (*ptr_InputHistoryMispredicted)(int Control, unsigned int *Frame);
+typedef void       (*ptr_InputHistoryReset)(int Control);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL InputHistoryGet(int Control, unsigned int Frame, BUTTONS *Keys);
+EXPORT m64p_error CALL InputHistoryConfirm(int Control, unsigned int Frame, BUTTONS Keys);
+EXPORT int        CALL InputHistoryMispredicted(int Control, unsigned int *Frame);
+EXPORT void       CALL InputHistoryReset(int Control);
+#endif
+
+/* InputSaveState() / InputLoadState()
+ *
+ * Save and restore the plugin's runtime state which isn't part of the configuration: the current pak of
+ * every port, pak switches in progress, the motor state of the rumble paks, the mouse motion which hasn't
+ * been applied yet and the mouse grab.  Together with a savestate of the core this restores the plugin
+ * deterministically (for rollback netplay, for example).  The state is an opaque block of
+ * INPUT_STATE_SIZE bytes which can be stored with the core's savestate; neither function allocates or
+ * blocks.  Both return M64ERR_INPUT_INVALID if Size is too small, and InputLoadState() also if the block
+ * wasn't written by a compatible version of the plugin.
+ */
+#define INPUT_STATE_SIZE        128
+
+typedef m64p_error (*ptr_InputSaveState)(void *Buffer, unsigned int Size);
+typedef m64p_error (*ptr_InputLoadState)(const void *Buffer, unsigned int Size);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL InputSaveState(void *Buffer, unsigned int Size);
+EXPORT m64p_error CALL InputLoadState(const void *Buffer, unsigned int Size);
+#endif
+
+/* Input delay
+ *
+ * Every port has a queue which holds back its input for a number of polls (frames) before GetKeys()
+ * returns it, for delay based netplay or for latency experiments.  The delay is set by the 'InputDelay'
+ * parameter of the controller's config section and can be changed at any time with SetInputDelay()
+ * (Control -1 sets all ports).  While the queue fills up after the delay was raised, the previous input is
+ * repeated; when the delay is lowered, the oldest inputs are dropped.  The delay is applied to the final
+ * state of the port, after shared memory and input server input have been merged in.
+ *
+ * GetInputDelayStats() returns the counters of a port since the rom was opened, including histograms of
+ * the delay actually added to every returned input.  Both functions return M64ERR_INPUT_INVALID for a bad
+ * port, a delay above INPUT_DELAY_MAX or a wrong Stats->size.
+ */
+#define INPUT_DELAY_MAX         32
+#define INPUT_LATENCY_BUCKETS   24
+
+typedef struct
+{
+    unsigned int size;                              // set to sizeof(input_delay_stats) by the caller
+    unsigned int delay;                             // current delay in polls
+    unsigned int polls;                             // polls of the port since the rom was opened
+    unsigned int repeated;                          // polls answered with the previous input while the queue filled up
+    unsigned int dropped;                           // inputs discarded because the delay was lowered
+    unsigned int delay_polls[INPUT_DELAY_MAX + 1];  // returned inputs by the number of polls they were held back
+    unsigned int delay_usec[INPUT_LATENCY_BUCKETS]; // same by time: bucket 0 < 1 us, bucket n from 2^(n-1) to 2^n - 1 us
+} input_delay_stats;
+
+typedef m64p_error (*ptr_SetInputDelay)(int Control, int Frames);
+typedef m64p_error (*ptr_GetInputDelayStats)(int Control, input_delay_stats *Stats);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL SetInputDelay(int Control, int Frames);
+EXPORT m64p_error CALL GetInputDelayStats(int Control, input_delay_stats *Stats);
+#endif
+
+/* Input sampler
+ *
+ * If 'SamplerRate' in the 'Input-SDL' config section is set, a thread reads the joysticks that many times per
+ * second while a rom runs, and the polls of the game (GetKeys(), GetAllKeys() and the pif reads) take its newest
+ * sample instead of reading the joysticks themselves.  'SamplerCpu' binds the thread to a cpu core (-1 for
+ * any) and 'SamplerPriority' sets its priority: 0 normal, 1 high, 2 real-time.  The keyboard and the mouse are
+ * still read at the poll, because their state comes from the event loop of the window.
+ *
+ * GetInputSamplerStats() returns the counters since the rom was opened, including a histogram of the age of
+ * the joystick state at the polls which returned it.  The histogram is also kept without the sampler thread,
+ * where the joysticks are read at the poll, so that both modes can be compared.  Must be called from the
+ * emulation thread; returns M64ERR_INPUT_INVALID for a wrong Stats->size.
+ */
+typedef struct
+{
+    unsigned int size;                              // set to sizeof(input_sampler_stats) by the caller
+    unsigned int rate;                              // samples per second of the sampler thread; 0 if it isn't running
+    unsigned int samples;                           // samples taken by the sampler thread
+    unsigned int late;                              // samples which started a whole period or more after their time
+    unsigned int polls;                             // polls of the devices
+    unsigned int age_usec[INPUT_LATENCY_BUCKETS];   // age of the joystick state at those polls, buckets as in input_delay_stats
+} input_sampler_stats;
+
+typedef m64p_error (*ptr_GetInputSamplerStats)(input_sampler_stats *Stats);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL GetInputSamplerStats(input_sampler_stats *Stats);
+#endif
+
+/* Statistics
+ *
+ * GetInputStats() returns counters of the plugin's work since the plugin was started or since the last
+ * ResetInputStats(): the polls of each port of the calling thread's instance and their latency, and the
+ * device, rumble and configuration work of the whole plugin.  The counters are read without a lock, so a
+ * front-end can call it every frame from any thread (e.g. for an overlay); a poll which runs at the same time
+ * may be counted in some fields and not yet in others.  ResetInputStats() starts the counting over for the
+ * calling thread's instance, the plugin wide counters included, and leaves the other instances alone; it must
+ * not run at the same time as GetInputStats() on the same instance on another thread.
+ *
+ * New versions of the plugin only add fields at the end and raise INPUT_STATS_VERSION.  Stats->size selects
+ * the version the caller was built against; M64ERR_INPUT_INVALID is returned if it isn't one the plugin knows.
+ */
+#define INPUT_STATS_VERSION     1
+
+typedef struct
+{
+    unsigned int size;                              // set to sizeof(input_stats) by the caller
+    unsigned int version;                           // set to INPUT_STATS_VERSION by the plugin
+    unsigned int polls[4];                          // polls of each port: GetKeys(), GetAllKeys() and pif reads
+    unsigned int state_changes[4];                  // polls which returned another state than the previous poll
+    unsigned int device_reads;                      // reads of the joysticks, by the polls or the sampler thread
+    unsigned int hotplug_events;                    // joysticks opened again after they were unplugged
+    unsigned int rumble_commands;                   // motor commands sent to the rumble worker or the device
+    unsigned int rumble_coalesced;                  // rumble pak writes which didn't change the motor state
+    unsigned int config_loads;                      // times the configuration was read
+    unsigned int config_usec;                       // total time spent reading it
+    unsigned int autoconfig_lookups;                // searches of InputAutoCfg.ini for a device
+    unsigned int autoconfig_usec;                   // total time spent searching
+    unsigned int latency_samples;                   // calls of GetKeys() and GetAllKeys()
+    unsigned int latency_ns[4];                     // their duration at the 50th, 90th, 99th and 99.9th percentile
+    unsigned int latency_max_ns;                    // and of the slowest call; latencies are within 1/4 above
+} input_stats;
+
+typedef m64p_error (*ptr_GetInputStats)(input_stats *Stats);
+typedef void       (*ptr_ResetInputStats)(void);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL GetInputStats(input_stats *Stats);
+EXPORT void       CALL ResetInputStats(void);
+#endif
+
+/* GetInputHash()
+ *
+ * Returns a rolling 64 bit hash (FNV-1a style) of every controller state the plugin has returned to the core and
+ * of every pak read/write command with its answer since the rom was opened, and the number of completed
+ * frames.  Two emulator instances which are fed the same input have the same hash after the same frame;
+ * comparing the hashes of a few frames finds the first frame at which they diverge with a binary search.
+ * With 'InputHashInterval' set in the 'Input-SDL' config section, the hash is also printed every that many
+ * frames.  Must be called from the emulation thread (e.g. from a frame callback).
+ */
+typedef m64p_error (*ptr_GetInputHash)(uint64_t *Hash, unsigned int *Frames);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_error CALL GetInputHash(uint64_t *Hash, unsigned int *Frames);
+#endif
+
+/* Instances
+ *
+ * All state of the plugin belongs to an instance, so that several emulators can run in one process (for
+ * example to search for desyncs, or to train against copies of a game on many threads).  The standard
+ * functions and all the extensions above work on the instance bound to the calling thread with
+ * InputInstanceBind(), or on the default instance if none is bound.  InputInstanceBind(NULL) goes back to
+ * the default instance.  A new instance starts out like the default one after PluginStartup(): the core
+ * calls InitiateControllers(), RomOpen() etc. for it from a thread bound to it.
+ *
+ * Only the default instance uses the input devices (keyboard, joysticks, mouse and rumble), the plugin's
+ * controller pak files and the shared memory / socket input.  The other instances are headless: they only
+ * see the keys passed in with SDL_KeyDown()/SDL_KeyUp() and the input history, delay and hash functions,
+ * their pak commands answer with an empty pak, and they don't touch SDL at all, so each of them can be
+ * driven by its own thread.
+ *
+ * A thread which is done with an instance must call InputInstanceBind(NULL) (or bind another instance)
+ * before it ends.  InputInstanceDestroy() refuses, with an error message, to free an instance which is still
+ * bound on another thread, so an instance whose thread ended without unbinding it is never freed.  The
+ * calling thread's own binding is dropped by InputInstanceDestroy().
+ */
+typedef m64p_handle (*ptr_InputInstanceCreate)(void);
+typedef void        (*ptr_InputInstanceDestroy)(m64p_handle Instance);
+typedef m64p_error  (*ptr_InputInstanceBind)(m64p_handle Instance);
+#if defined(M64P_PLUGIN_PROTOTYPES)
+EXPORT m64p_handle CALL InputInstanceCreate(void);
+EXPORT void        CALL InputInstanceDestroy(m64p_handle Instance);
+EXPORT m64p_error  CALL InputInstanceBind(m64p_handle Instance);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INPUT_EXT_H */
+
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_hash.c                                  *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "input_hash.h"
+#include "plugin.h"
+
+/* 64 bit FNV-1a; controller states are added as one 64 bit word (port and value) per step */
+#define FNV_OFFSET_BASIS    0xcbf29ce484222325ULL
+#define FNV_PRIME           0x00000100000001b3ULL
+
+/* static functions */
+static void hash_bytes(SInputHash *ih, const unsigned char *data, unsigned int len)
+{
+    uint64_t hash = ih->hash;
+
+    while (len--)
+    {
+        hash ^= *data++;
+        hash *= FNV_PRIME;
+    }
+    ih->hash = hash;
+}
+
+/* the core polls the ports in order once per frame, so going back to a lower port starts a new frame */
+static void next_port(SInputHash *ih, int Control)
+{
+    if (Control <= ih->last_port && ih->last_port < 4)
+    {
+        ih->frames++;
+        if (ih->interval != 0 && ih->frames % ih->interval == 0)
+            DebugMessage(M64MSG_INFO, "Input hash after frame %u: %08x%08x", ih->frames,
+                         (unsigned int) (ih->hash >> 32), (unsigned int) ih->hash);
+    }
+    ih->last_port = Control;
+}
+
+/* global functions */
+void input_hash_reset(SInputHash *ih)
+{
+    m64p_handle pConfig;
+    int iValue;
+
+    ih->hash = FNV_OFFSET_BASIS;
+    ih->frames = 0;
+    ih->last_port = 4;
+    ih->interval = 0;
+
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+    ConfigSetDefaultInt(pConfig, "InputHashInterval", 0, "Print the hash of all controller input every this many frames, to find where the input of two emulator instances diverges.  0 to disable");
+    if (ConfigGetParameter(pConfig, "InputHashInterval", M64TYPE_INT, &iValue, sizeof(int)) == M64ERR_SUCCESS && iValue > 0)
+        ih->interval = (unsigned int) iValue;
+}
+
+void input_hash_keys(SInputHash *ih, int Control, unsigned int Value)
+{
+    next_port(ih, Control);
+    ih->hash = (ih->hash ^ (((uint64_t) Control << 32) | Value)) * FNV_PRIME;
+}
+
+void input_hash_command(SInputHash *ih, int Control, const unsigned char *Command)
+{
+    /* the command and the answer: length bytes, tx bytes and rx bytes */
+    unsigned int len = 2 + (Command[0] & 0x3F) + (Command[1] & 0x3F);
+
+    ih->hash = (ih->hash ^ ((uint64_t) Control << 32)) * FNV_PRIME;
+    hash_bytes(ih, Command, len);
+}
+
+void input_hash_get(const SInputHash *ih, uint64_t *Hash, unsigned int *Frames)
+{
+    if (Hash != NULL)
+        *Hash = ih->hash;
+    if (Frames != NULL)
+        *Frames = ih->frames;
+}
+
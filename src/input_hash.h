@@ -0,0 +1,44 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_hash.h                                  *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_HASH_H__
+#define __INPUT_HASH_H__
+
+#include "input_ext.h"
+
+typedef struct
+{
+    uint64_t     hash;
+    unsigned int frames;            // completed frames
+    int          last_port;         // port of the last hashed state; a lower or equal port starts a frame
+    unsigned int interval;          // log the hash every 'interval' frames, 0: never
+} SInputHash;
+
+/* clears the hash and reads 'InputHashInterval' from the 'Input-SDL' config section */
+extern void input_hash_reset(SInputHash *ih);
+
+/* add a state returned to the core, or a pak command with its answer, to the hash (emulation thread) */
+extern void input_hash_keys(SInputHash *ih, int Control, unsigned int Value);
+extern void input_hash_command(SInputHash *ih, int Control, const unsigned char *Command);
+
+extern void input_hash_get(const SInputHash *ih, uint64_t *Hash, unsigned int *Frames);
+
+#endif /* __INPUT_HASH_H__ */
+
@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_history.c                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "input_history.h"
+
+/* static functions */
+
+/* frame numbers may wrap around, so they are compared by their difference */
+static int frame_before(unsigned int a, unsigned int b)
+{
+    return (int) (a - b) < 0;
+}
+
+/* returns the slot for 'Frame', or NULL if the frame has dropped out of the history */
+static SHistoryEntry *get_entry(SHistory *hist, unsigned int Frame)
+{
+    SHistoryEntry *entry;
+
+    if (!hist->used || frame_before(hist->newest, Frame))
+    {
+        hist->newest = Frame;
+        hist->used = 1;
+    }
+    else if (hist->newest - Frame >= INPUT_HISTORY_SIZE)
+        return NULL;
+
+    entry = &hist->entry[Frame & (INPUT_HISTORY_SIZE - 1)];
+    if (entry->frame != Frame)
+    {
+        entry->frame = Frame;
+        entry->flags = 0;
+    }
+    return entry;
+}
+
+/* the input of the newest confirmed frame before 'Frame' */
+static unsigned int predict(const SHistory *hist, unsigned int Frame)
+{
+    const SHistoryEntry *entry;
+    unsigned int f;
+
+    if (!hist->confirmed)
+        return 0;
+    if (frame_before(hist->last_confirmed, Frame))
+        return hist->last_value;
+
+    /* a later frame has been confirmed already: look for the closest one before this frame */
+    for (f = Frame - 1; hist->newest - f < INPUT_HISTORY_SIZE; f--)
+    {
+        entry = &hist->entry[f & (INPUT_HISTORY_SIZE - 1)];
+        if (entry->frame == f && (entry->flags & HIST_CONFIRMED))
+            return entry->value;
+    }
+    return 0;
+}
+
+/* global functions */
+m64p_error input_history_get(SHistory *hist, unsigned int Frame, BUTTONS *Keys)
+{
+    SHistoryEntry *entry;
+
+    if (Keys == NULL)
+        return M64ERR_INPUT_INVALID;
+
+    entry = get_entry(hist, Frame);
+    if (entry == NULL)
+        return M64ERR_INPUT_INVALID;
+
+    entry->returned = (entry->flags & HIST_CONFIRMED) ? entry->value : predict(hist, Frame);
+    entry->flags |= HIST_RETURNED;
+    Keys->Value = entry->returned;
+    return M64ERR_SUCCESS;
+}
+
+m64p_error input_history_confirm(SHistory *hist, unsigned int Frame, unsigned int Value)
+{
+    SHistoryEntry *entry;
+
+    entry = get_entry(hist, Frame);
+    if (entry == NULL)
+        return M64ERR_INPUT_INVALID;
+
+    if ((entry->flags & HIST_RETURNED) && entry->returned != Value)
+    {
+        if (!hist->mispredicted || frame_before(Frame, hist->oldest_wrong))
+            hist->oldest_wrong = Frame;
+        hist->mispredicted = 1;
+    }
+    entry->value = Value;
+    entry->flags |= HIST_CONFIRMED;
+
+    if (!hist->confirmed || !frame_before(Frame, hist->last_confirmed))
+    {
+        hist->last_confirmed = Frame;
+        hist->last_value = Value;
+        hist->confirmed = 1;
+    }
+    return M64ERR_SUCCESS;
+}
+
+int input_history_mispredicted(SHistory *hist, unsigned int *Frame)
+{
+    if (!hist->mispredicted)
+        return 0;
+
+    if (Frame != NULL)
+        *Frame = hist->oldest_wrong;
+    hist->mispredicted = 0;
+    return 1;
+}
+
+void input_history_reset(SHistory *hist)
+{
+    memset(hist, 0, sizeof(SHistory));
+}
+
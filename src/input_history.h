@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_history.h                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_HISTORY_H__
+#define __INPUT_HISTORY_H__
+
+#include "input_ext.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+
+#define HIST_CONFIRMED  0x01
+#define HIST_RETURNED   0x02
+
+typedef struct
+{
+    unsigned int frame;
+    unsigned int value;             // confirmed input; valid with HIST_CONFIRMED
+    unsigned int returned;          // value last returned by input_history_get(); valid with HIST_RETURNED
+    unsigned int flags;             // 0: the slot doesn't hold 'frame'
+} SHistoryEntry;
+
+typedef struct
+{
+    SHistoryEntry entry[INPUT_HISTORY_SIZE];
+    int           used;             // 'newest' is valid
+    unsigned int  newest;           // newest frame passed to get/confirm
+    int           confirmed;        // 'last_confirmed' is valid
+    unsigned int  last_confirmed;   // newest confirmed frame
+    unsigned int  last_value;
+    int           mispredicted;     // 'oldest_wrong' is valid
+    unsigned int  oldest_wrong;
+} SHistory;
+
+/* ring of confirmed and predicted input of one port, see the InputHistory*() functions in input_ext.h */
+extern m64p_error input_history_get(SHistory *hist, unsigned int Frame, BUTTONS *Keys);
+extern m64p_error input_history_confirm(SHistory *hist, unsigned int Frame, unsigned int Value);
+extern int        input_history_mispredicted(SHistory *hist, unsigned int *Frame);
+extern void       input_history_reset(SHistory *hist);
+
+#endif /* __INPUT_HISTORY_H__ */
+
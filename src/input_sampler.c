@@ -0,0 +1,278 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_sampler.c                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "input_sampler.h"
+#include "osal_atomic.h"
+#include "osal_preproc.h"
+#include "plugin.h"
+#include "trace.h"
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#define SAMPLER_MIN_RATE    60
+#define SAMPLER_MAX_RATE    8000
+
+/* configuration, read when the sampler is started */
+static int          l_Rate = 0;
+static int          l_Cpu = -1;
+static int          l_Priority = 0;
+
+static SDL_Thread  *l_SamplerThread = NULL;
+static SDL_mutex   *l_SampleLock = NULL;
+static void       (*l_Sample)(void) = NULL;
+static volatile unsigned int l_SamplerQuit = 0;
+
+/* statistics; the sample counters are written by the sampler thread, the rest by the emulation thread */
+static volatile unsigned int l_Samples = 0, l_Late = 0;
+static unsigned int l_Polls = 0;
+static unsigned int l_AgeUsec[INPUT_LATENCY_BUCKETS];
+
+/* static functions */
+static void load_sampler_config(void)
+{
+    m64p_handle pConfig;
+
+    l_Rate = 0;
+    l_Cpu = -1;
+    l_Priority = 0;
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+
+    ConfigSetDefaultInt(pConfig, "SamplerRate", 0, "Samples per second (60-8000) of a thread which reads the joysticks while the game runs, so that a poll returns the newest sample instead of reading the joysticks itself.  0 to read them at every poll");
+    ConfigSetDefaultInt(pConfig, "SamplerCpu", -1, "CPU core to which the sampler thread is bound.  -1 for any");
+    ConfigSetDefaultInt(pConfig, "SamplerPriority", 0, "Scheduling priority of the sampler thread: 0=normal, 1=high, 2=real-time (SCHED_FIFO on Linux, which needs the permission to use it)");
+    l_Rate = ConfigGetParamInt(pConfig, "SamplerRate");
+    l_Cpu = ConfigGetParamInt(pConfig, "SamplerCpu");
+    l_Priority = ConfigGetParamInt(pConfig, "SamplerPriority");
+
+    if (l_Rate != 0 && (l_Rate < SAMPLER_MIN_RATE || l_Rate > SAMPLER_MAX_RATE))
+    {
+        DebugMessage(M64MSG_WARNING, "Input sampler: SamplerRate %i out of range, using %i", l_Rate, l_Rate < SAMPLER_MIN_RATE ? SAMPLER_MIN_RATE : SAMPLER_MAX_RATE);
+        l_Rate = l_Rate < SAMPLER_MIN_RATE ? SAMPLER_MIN_RATE : SAMPLER_MAX_RATE;
+    }
+}
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+/* binds the calling thread to one cpu */
+static void set_affinity(int cpu)
+{
+#if defined(WIN32)
+    if (cpu >= (int) (sizeof(DWORD_PTR) * 8) || SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << cpu) == 0)
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't bind the thread to cpu %i", cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    int err;
+
+    if (cpu >= CPU_SETSIZE)
+    {
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't bind the thread to cpu %i", cpu);
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't bind the thread to cpu %i: %s", cpu, strerror(err));
+#else
+    DebugMessage(M64MSG_WARNING, "Input sampler: SamplerCpu isn't supported on this platform");
+#endif
+}
+
+/* raises the priority of the calling thread: 1 = high, 2 = real-time, which falls back to high */
+static void set_priority(int priority)
+{
+    if (priority <= 0)
+        return;
+
+    if (priority >= 2)
+    {
+#if defined(WIN32)
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+            return;
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't set real-time priority");
+#else
+        struct sched_param param;
+        int err;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err == 0)
+            return;
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't set real-time priority: %s", strerror(err));
+#endif
+    }
+
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) != 0)
+        DebugMessage(M64MSG_WARNING, "Input sampler: couldn't raise the thread priority: %s", SDL_GetError());
+}
+
+/* sleeps until the performance counter reaches 'deadline' */
+static void sleep_until(Uint64 deadline)
+{
+    Uint64 now = SDL_GetPerformanceCounter(), usec;
+
+    if (now >= deadline)
+        return;
+    usec = input_stats_ticks_to_usec(deadline - now);
+#if defined(WIN32)
+    SDL_Delay((Uint32) ((usec + 999) / 1000));
+#else
+    {
+        struct timespec ts;
+
+        ts.tv_sec = (time_t) (usec / 1000000);
+        ts.tv_nsec = (long) (usec % 1000000) * 1000;
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+            ;
+    }
+#endif
+}
+
+static int InputSampler(void *unused)
+{
+    Uint64 period = SDL_GetPerformanceFrequency() / (Uint64) l_Rate;
+    Uint64 next, now;
+
+    if (l_Cpu >= 0)
+        set_affinity(l_Cpu);
+    set_priority(l_Priority);
+
+    next = SDL_GetPerformanceCounter();
+    while (!osal_atomic_load(&l_SamplerQuit))
+    {
+        (*l_Sample)();
+        osal_atomic_fetch_add(&l_Samples, 1);
+
+        /* a sample which comes a whole period late is counted, and the following ones go on from now instead of
+         * catching up */
+        next += period;
+        now = SDL_GetPerformanceCounter();
+        if (now >= next + period)
+        {
+            osal_atomic_fetch_add(&l_Late, 1);
+            next = now;
+        }
+        sleep_until(next);
+    }
+
+    trace_thread_exit();
+    return 0;
+}
+#endif
+
+/* global functions */
+void input_sampler_start(void (*Sample)(void))
+{
+    if (l_SamplerThread != NULL)
+        return;
+
+    l_Samples = l_Late = 0;
+    l_Polls = 0;
+    memset(l_AgeUsec, 0, sizeof(l_AgeUsec));
+
+    load_sampler_config();
+    if (l_Rate == 0)
+        return;
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    if (l_SampleLock == NULL)
+        l_SampleLock = SDL_CreateMutex();
+    if (l_SampleLock == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Input sampler: couldn't create mutex: %s", SDL_GetError());
+        return;
+    }
+
+    l_Sample = Sample;
+    l_SamplerQuit = 0;
+    l_SamplerThread = SDL_CreateThread(InputSampler, "InputSampler", NULL);
+    if (l_SamplerThread == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Input sampler: couldn't create thread: %s", SDL_GetError());
+        return;
+    }
+
+    DebugMessage(M64MSG_INFO, "Input sampler: reading the joysticks %i times per second", l_Rate);
+#else
+    /* the joystick functions of SDL 1.2 may only be called from one thread */
+    DebugMessage(M64MSG_WARNING, "Input sampler: SamplerRate needs SDL 2");
+#endif
+}
+
+void input_sampler_stop(void)
+{
+    if (l_SamplerThread == NULL)
+        return;
+
+    osal_atomic_store(&l_SamplerQuit, 1);
+    SDL_WaitThread(l_SamplerThread, NULL);
+    l_SamplerThread = NULL;
+    DebugMessage(M64MSG_VERBOSE, "Input sampler: %u samples, %u late", l_Samples, l_Late);
+}
+
+int input_sampler_running(void)
+{
+    return l_SamplerThread != NULL;
+}
+
+void input_sampler_lock(void)
+{
+    SDL_LockMutex(l_SampleLock);
+}
+
+void input_sampler_unlock(void)
+{
+    SDL_UnlockMutex(l_SampleLock);
+}
+
+void input_sampler_record_age(Uint64 SampleTime)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    l_Polls++;
+    l_AgeUsec[input_stats_usec_bucket(now > SampleTime ? input_stats_ticks_to_usec(now - SampleTime) : 0)]++;
+}
+
+void input_sampler_get_stats(input_sampler_stats *Stats)
+{
+    Stats->rate = l_SamplerThread != NULL ? (unsigned int) l_Rate : 0;
+    Stats->samples = osal_atomic_load(&l_Samples);
+    Stats->late = osal_atomic_load(&l_Late);
+    Stats->polls = l_Polls;
+    memcpy(Stats->age_usec, l_AgeUsec, sizeof(Stats->age_usec));
+}
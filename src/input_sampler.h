@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_sampler.h                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_SAMPLER_H__
+#define __INPUT_SAMPLER_H__
+
+#include <SDL.h>
+
+#include "input_ext.h"
+
+/* starts the thread which calls 'Sample' 'SamplerRate' times per second, with the cpu affinity and priority given
+ * by the 'Input-SDL' config section, and clears the statistics.  the thread isn't started if the rate is 0 */
+extern void input_sampler_start(void (*Sample)(void));
+extern void input_sampler_stop(void);
+extern int  input_sampler_running(void);
+
+/* held while a sample is handed over from the sampler thread to the emulation thread */
+extern void input_sampler_lock(void);
+extern void input_sampler_unlock(void);
+
+/* counts a poll which returned the joystick state read at 'SampleTime' (performance counter) */
+extern void input_sampler_record_age(Uint64 SampleTime);
+
+extern void input_sampler_get_stats(input_sampler_stats *Stats);
+
+#endif /* __INPUT_SAMPLER_H__ */
@@ -0,0 +1,389 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_server.c                                *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "input_server.h"
+#include "osal_atomic.h"
+#include "osal_preproc.h"
+#include "plugin.h"
+
+#if OSAL_HAVE_POSIX_IPC
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define SERVER_MAX_CLIENTS  8
+
+typedef struct
+{
+    int           fd;
+    unsigned int  fill;                         // bytes of a partial message in 'partial'
+    unsigned char partial[INPUT_SERVER_MSG_SIZE];
+} SClient;
+
+/* port states published by the server thread for the emulation thread */
+static volatile unsigned int l_PortValue[4];
+static volatile unsigned int l_PortDriven = 0;  // bit n: port n is driven by a client
+
+/* statistics; written by the server thread only */
+static volatile unsigned int l_Clients = 0, l_Messages = 0, l_Stale = 0;
+static volatile unsigned int l_Batches = 0, l_MaxBatch = 0, l_QueueDepth = 0;
+
+#if OSAL_HAVE_POSIX_IPC
+static char         l_SocketPath[108];          // sizeof(sockaddr_un.sun_path)
+static int          l_ListenFd = -1;
+static int          l_WakePipe[2] = { -1, -1 };
+static SClient      l_Client[SERVER_MAX_CLIENTS] = { { -1 }, { -1 }, { -1 }, { -1 }, { -1 }, { -1 }, { -1 }, { -1 } };
+static SDL_Thread  *l_ServerThread = NULL;
+
+/* server thread state */
+static unsigned int l_PortFrame[4];
+static int          l_PortHasFrame[4];
+
+/* static functions */
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void close_client(SClient *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    client->fill = 0;
+    l_Clients--;
+
+    /* without clients nobody can release the ports any more */
+    if (l_Clients == 0)
+    {
+        osal_atomic_store(&l_PortDriven, 0);
+        memset(l_PortHasFrame, 0, sizeof(l_PortHasFrame));
+    }
+}
+
+static void accept_clients(void)
+{
+    int fd, i;
+
+    while ((fd = accept(l_ListenFd, NULL, NULL)) >= 0)
+    {
+        for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+        {
+            if (l_Client[i].fd < 0)
+                break;
+        }
+        if (i == SERVER_MAX_CLIENTS)
+        {
+            DebugMessage(M64MSG_WARNING, "Input server: too many clients, connection refused");
+            close(fd);
+            continue;
+        }
+        set_nonblocking(fd);
+        l_Client[i].fd = fd;
+        l_Client[i].fill = 0;
+        l_Clients++;
+    }
+}
+
+/* decodes one message into the batch; returns 1 if it was applied */
+static int decode_message(const unsigned char *msg, unsigned int *value, unsigned int *drive, unsigned int *touched)
+{
+    unsigned int port = msg[0];
+    unsigned int frame = msg[8] | (msg[9] << 8) | (msg[10] << 16) | ((unsigned int) msg[11] << 24);
+
+    if (port > 3)
+        return 0;
+
+    if (l_PortHasFrame[port] && (int) (frame - l_PortFrame[port]) < 0)
+    {
+        l_Stale++;
+        return 0;
+    }
+    l_PortFrame[port] = frame;
+    l_PortHasFrame[port] = 1;
+
+    *touched |= 1u << port;
+    if (msg[1] & INPUT_SERVER_DRIVE)
+    {
+        value[port] = msg[2] | (msg[3] << 8) | (msg[4] << 16) | ((unsigned int) msg[5] << 24);
+        *drive |= 1u << port;
+    }
+    else
+    {
+        *drive &= ~(1u << port);
+        l_PortHasFrame[port] = 0;
+    }
+    return 1;
+}
+
+/* reads at most one buffer from the client, so that a busy client can't starve the others; the rest
+ * is picked up on the next wakeup.  returns the number of messages */
+static unsigned int read_client(SClient *client, unsigned int *value, unsigned int *drive, unsigned int *touched)
+{
+    unsigned char buffer[INPUT_SERVER_MSG_SIZE * 64];
+    unsigned int count = 0, pos = 0;
+    ssize_t len;
+
+    len = recv(client->fd, buffer, sizeof(buffer), 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        close_client(client);
+        return 0;
+    }
+    if (len < 0)
+        return 0;
+
+    /* complete a message which was split over two reads */
+    if (client->fill > 0)
+    {
+        while (client->fill < INPUT_SERVER_MSG_SIZE && pos < (unsigned int) len)
+            client->partial[client->fill++] = buffer[pos++];
+        if (client->fill < INPUT_SERVER_MSG_SIZE)
+            return 0;
+        count += decode_message(client->partial, value, drive, touched);
+        client->fill = 0;
+    }
+    for (; pos + INPUT_SERVER_MSG_SIZE <= (unsigned int) len; pos += INPUT_SERVER_MSG_SIZE)
+        count += decode_message(buffer + pos, value, drive, touched);
+    while (pos < (unsigned int) len)
+        client->partial[client->fill++] = buffer[pos++];
+
+    return count;
+}
+
+static int InputServer(void *unused)
+{
+    struct pollfd fds[SERVER_MAX_CLIENTS + 2];
+    SClient *polled[SERVER_MAX_CLIENTS + 2];
+    unsigned int value[4], drive, touched, count, depth;
+    int nfds, i, port;
+
+    for (;;)
+    {
+        nfds = 0;
+        fds[nfds].fd = l_WakePipe[0];
+        fds[nfds++].events = POLLIN;
+        fds[nfds].fd = l_ListenFd;
+        fds[nfds++].events = POLLIN;
+        for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+        {
+            if (l_Client[i].fd < 0)
+                continue;
+            polled[nfds] = &l_Client[i];
+            fds[nfds].fd = l_Client[i].fd;
+            fds[nfds++].events = POLLIN;
+        }
+
+        if (poll(fds, nfds, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            DebugMessage(M64MSG_ERROR, "Input server: poll() failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (fds[1].revents & POLLIN)
+            accept_clients();
+
+        /* everything which arrived since the last wakeup is applied as one batch */
+        drive = osal_atomic_load(&l_PortDriven);
+        touched = 0;
+        count = 0;
+        depth = 0;
+        for (i = 2; i < nfds; i++)
+        {
+            int pending = 0;
+            if (!fds[i].revents)
+                continue;
+            if (ioctl(fds[i].fd, FIONREAD, &pending) == 0 && pending > 0)
+                depth += (unsigned int) pending;
+            count += read_client(polled[i], value, &drive, &touched);
+        }
+        if (touched == 0)
+            continue;
+
+        for (port = 0; port < 4; port++)
+        {
+            if ((touched & drive) & (1u << port))
+                osal_atomic_store(&l_PortValue[port], value[port]);
+        }
+        osal_atomic_store(&l_PortDriven, (osal_atomic_load(&l_PortDriven) & ~touched) | (drive & touched));
+
+        l_Messages += count;
+        l_Batches++;
+        l_QueueDepth = depth;
+        if (count > l_MaxBatch)
+            l_MaxBatch = count;
+    }
+
+    return 0;
+}
+
+static void load_server_config(void)
+{
+    m64p_handle pConfig;
+
+    l_SocketPath[0] = 0;
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+
+    ConfigSetDefaultString(pConfig, "SocketPath", "", "Path of a unix domain socket on which the plugin accepts controller input from other programs (see input_ext.h). Empty to disable");
+    if (ConfigGetParameter(pConfig, "SocketPath", M64TYPE_STRING, l_SocketPath, sizeof(l_SocketPath)) != M64ERR_SUCCESS)
+        l_SocketPath[0] = 0;
+}
+#endif /* OSAL_HAVE_POSIX_IPC */
+
+/* global functions */
+void input_server_start(void)
+{
+#if OSAL_HAVE_POSIX_IPC
+    struct sockaddr_un addr;
+    struct stat st;
+    int i;
+
+    if (l_ServerThread != NULL)
+        return;
+
+    load_server_config();
+    if (l_SocketPath[0] == 0)
+        return;
+
+    l_PortDriven = 0;
+    l_Clients = l_Messages = l_Stale = l_Batches = l_MaxBatch = l_QueueDepth = 0;
+    memset(l_PortHasFrame, 0, sizeof(l_PortHasFrame));
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+        l_Client[i].fd = -1;
+
+    /* a socket left behind by an earlier run would make bind() fail */
+    if (lstat(l_SocketPath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(l_SocketPath);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, l_SocketPath, sizeof(addr.sun_path) - 1);
+
+    l_ListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (l_ListenFd < 0 || bind(l_ListenFd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(l_ListenFd, SERVER_MAX_CLIENTS) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Input server: couldn't listen on '%s': %s", l_SocketPath, strerror(errno));
+        if (l_ListenFd >= 0)
+            close(l_ListenFd);
+        l_ListenFd = -1;
+        return;
+    }
+    set_nonblocking(l_ListenFd);
+
+    if (pipe(l_WakePipe) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Input server: couldn't create wakeup pipe: %s", strerror(errno));
+        input_server_stop();
+        return;
+    }
+
+    l_ServerThread = SDL_CreateThread(InputServer, "InputServer", NULL);
+    if (l_ServerThread == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Input server: couldn't create thread: %s", SDL_GetError());
+        input_server_stop();
+        return;
+    }
+
+    DebugMessage(M64MSG_INFO, "Input server listening on '%s'", l_SocketPath);
+#endif
+}
+
+void input_server_stop(void)
+{
+#if OSAL_HAVE_POSIX_IPC
+    int i;
+
+    /* nothing to do if the server wasn't started (no 'SocketPath') */
+    if (l_ServerThread == NULL && l_ListenFd < 0)
+        return;
+
+    if (l_ServerThread != NULL)
+    {
+        if (write(l_WakePipe[1], "q", 1) != 1)
+            DebugMessage(M64MSG_WARNING, "Input server: couldn't wake the server thread");
+        SDL_WaitThread(l_ServerThread, NULL);
+        l_ServerThread = NULL;
+        DebugMessage(M64MSG_VERBOSE, "Input server: %u messages in %u batches (max %u), %u stale",
+                     l_Messages, l_Batches, l_MaxBatch, l_Stale);
+    }
+
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        if (l_Client[i].fd >= 0)
+            close_client(&l_Client[i]);
+    }
+    for (i = 0; i < 2; i++)
+    {
+        if (l_WakePipe[i] >= 0)
+            close(l_WakePipe[i]);
+        l_WakePipe[i] = -1;
+    }
+    if (l_ListenFd >= 0)
+    {
+        close(l_ListenFd);
+        l_ListenFd = -1;
+        unlink(l_SocketPath);
+    }
+    osal_atomic_store(&l_PortDriven, 0);
+#endif
+}
+
+void input_server_apply(int Control, BUTTONS *Keys)
+{
+    if (osal_atomic_load(&l_PortDriven) & (1u << Control))
+        Keys->Value = osal_atomic_load(&l_PortValue[Control]);
+}
+
+void input_server_get_status(input_server_status *Status)
+{
+#if OSAL_HAVE_POSIX_IPC
+    Status->listening = (l_ListenFd >= 0);
+#else
+    Status->listening = 0;
+#endif
+    Status->clients = l_Clients;
+    Status->messages = l_Messages;
+    Status->stale = l_Stale;
+    Status->batches = l_Batches;
+    Status->max_batch = l_MaxBatch;
+    Status->queue_depth = l_QueueDepth;
+}
+
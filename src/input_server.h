@@ -0,0 +1,38 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_server.h                                *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_SERVER_H__
+#define __INPUT_SERVER_H__
+
+#include "input_ext.h"
+#include "m64p_plugin.h"
+
+/* open/close the unix domain socket named by 'SocketPath' in the 'Input-SDL' config section, and the
+ * thread which services it */
+extern void input_server_start(void);
+extern void input_server_stop(void);
+
+/* replaces the state of the port if a client currently drives it */
+extern void input_server_apply(int Control, BUTTONS *Keys);
+
+extern void input_server_get_status(input_server_status *Status);
+
+#endif /* __INPUT_SERVER_H__ */
+
@@ -0,0 +1,169 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_stats.c                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <string.h>
+
+#include "input_ext.h"
+#include "input_stats.h"
+#include "m64p_plugin.h"
+#include "osal_atomic.h"
+#include "plugin.h"
+
+volatile unsigned int input_counters[NUM_COUNTERS];
+
+static Uint64       l_NsecPerTick = 1 << 16;        // 48.16 fixed point
+static Uint64       l_TicksPerUsec = 1;
+
+/* static functions */
+
+/* buckets 0 to 3 hold 0 to 3 ns, then each power of 2 is split into 4 buckets */
+static unsigned int nsec_bucket(unsigned int nsec)
+{
+    unsigned int bits = 0;
+
+    if (nsec < 4)
+        return nsec;
+    while ((nsec >> bits) >= 8)
+        bits++;
+    return 4 * (bits + 1) + ((nsec >> bits) & 3);
+}
+
+/* the highest latency which falls into a bucket */
+static unsigned int bucket_nsec(unsigned int bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    return ((4 + (bucket & 3) + 1) << (bucket / 4 - 1)) - 1;
+}
+
+static unsigned int counter(volatile unsigned int *Counter, unsigned int Base)
+{
+    return osal_atomic_load(Counter) - Base;
+}
+
+/* global functions */
+void input_stats_init(void)
+{
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++)
+        osal_atomic_store(&input_counters[i], 0);
+
+    l_NsecPerTick = ((Uint64) 1000000000 << 16) / freq;
+    if (l_NsecPerTick == 0)
+        l_NsecPerTick = 1;
+    l_TicksPerUsec = freq / 1000000;
+    if (l_TicksPerUsec == 0)
+        l_TicksPerUsec = 1;
+}
+
+unsigned int input_stats_usec(Uint64 Start)
+{
+    return (unsigned int) input_stats_ticks_to_usec(SDL_GetPerformanceCounter() - Start);
+}
+
+Uint64 input_stats_ticks_to_usec(Uint64 Ticks)
+{
+    return Ticks / l_TicksPerUsec;
+}
+
+unsigned int input_stats_usec_bucket(Uint64 Usec)
+{
+    unsigned int bucket = 0;
+
+    while (Usec != 0 && bucket < INPUT_LATENCY_BUCKETS - 1)
+    {
+        Usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void input_stats_latency(SInputCounters *Counters, Uint64 Start)
+{
+    Uint64 ticks = SDL_GetPerformanceCounter() - Start;
+    unsigned int nsec;
+
+    /* anything above a second lands in the last bucket anyway */
+    if (ticks >= ((Uint64) 1 << 46) / l_NsecPerTick)
+        nsec = 0xffffffff;
+    else
+        nsec = (unsigned int) ((ticks * l_NsecPerTick) >> 16);
+    input_stats_bump(&Counters->latency[nsec_bucket(nsec)]);
+}
+
+void input_stats_get(SInputCounters *Counters, const SInputCounters *Base, input_stats *Stats)
+{
+    static const unsigned int permille[4] = { 500, 900, 990, 999 };
+    unsigned int latency[INPUT_STATS_BUCKETS];
+    unsigned int samples = 0, seen = 0;
+    int i, b;
+
+    Stats->version = INPUT_STATS_VERSION;
+    for (i = 0; i < 4; i++)
+    {
+        Stats->polls[i] = counter(&Counters->polls[i], Base->polls[i]);
+        Stats->state_changes[i] = counter(&Counters->state_changes[i], Base->state_changes[i]);
+    }
+    Stats->device_reads = counter(&input_counters[COUNTER_DEVICE_READS], Base->shared[COUNTER_DEVICE_READS]);
+    Stats->hotplug_events = counter(&input_counters[COUNTER_HOTPLUG], Base->shared[COUNTER_HOTPLUG]);
+    Stats->rumble_commands = counter(&input_counters[COUNTER_RUMBLE_COMMANDS], Base->shared[COUNTER_RUMBLE_COMMANDS]);
+    Stats->rumble_coalesced = counter(&input_counters[COUNTER_RUMBLE_COALESCED], Base->shared[COUNTER_RUMBLE_COALESCED]);
+    Stats->config_loads = counter(&input_counters[COUNTER_CONFIG_LOADS], Base->shared[COUNTER_CONFIG_LOADS]);
+    Stats->config_usec = counter(&input_counters[COUNTER_CONFIG_USEC], Base->shared[COUNTER_CONFIG_USEC]);
+    Stats->autoconfig_lookups = counter(&input_counters[COUNTER_AUTOCONFIG_LOOKUPS], Base->shared[COUNTER_AUTOCONFIG_LOOKUPS]);
+    Stats->autoconfig_usec = counter(&input_counters[COUNTER_AUTOCONFIG_USEC], Base->shared[COUNTER_AUTOCONFIG_USEC]);
+
+    /* the percentiles are the upper ends of the buckets in which they fall */
+    for (b = 0; b < INPUT_STATS_BUCKETS; b++)
+    {
+        latency[b] = counter(&Counters->latency[b], Base->latency[b]);
+        samples += latency[b];
+    }
+    Stats->latency_samples = samples;
+    memset(Stats->latency_ns, 0, sizeof(Stats->latency_ns));
+    Stats->latency_max_ns = 0;
+    for (b = 0, i = 0; b < INPUT_STATS_BUCKETS; b++)
+    {
+        if (latency[b] == 0)
+            continue;
+        seen += latency[b];
+        for (; i < 4 && (Uint64) seen * 1000 >= (Uint64) samples * permille[i]; i++)
+            Stats->latency_ns[i] = bucket_nsec(b);
+        Stats->latency_max_ns = bucket_nsec(b);
+    }
+}
+
+void input_stats_reset(SInputCounters *Counters, SInputCounters *Base)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        Base->polls[i] = osal_atomic_load(&Counters->polls[i]);
+        Base->state_changes[i] = osal_atomic_load(&Counters->state_changes[i]);
+    }
+    for (i = 0; i < INPUT_STATS_BUCKETS; i++)
+        Base->latency[i] = osal_atomic_load(&Counters->latency[i]);
+    for (i = 0; i < NUM_COUNTERS; i++)
+        Base->shared[i] = osal_atomic_load(&input_counters[i]);
+}
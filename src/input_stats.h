@@ -0,0 +1,106 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - input_stats.h                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __INPUT_STATS_H__
+#define __INPUT_STATS_H__
+
+#include <SDL.h>
+
+#include "input_ext.h"
+#include "osal_atomic.h"
+#include "osal_preproc.h"
+
+/* the latency histogram has 4 buckets per power of 2 nanoseconds */
+#define INPUT_STATS_BUCKETS     128
+
+/* the counters of the devices and the configuration, which are shared by all instances */
+enum EInputCounter
+{
+    COUNTER_DEVICE_READS = 0,
+    COUNTER_HOTPLUG,
+    COUNTER_RUMBLE_COMMANDS,
+    COUNTER_RUMBLE_COALESCED,
+    COUNTER_CONFIG_LOADS,
+    COUNTER_CONFIG_USEC,
+    COUNTER_AUTOCONFIG_LOOKUPS,
+    COUNTER_AUTOCONFIG_USEC,
+    NUM_COUNTERS
+};
+
+/* the counters of one instance.  only the thread which drives the instance writes them, so they are bumped
+ * without a locked instruction; the atomic stores still let other threads read them */
+typedef struct
+{
+    volatile unsigned int polls[4];
+    volatile unsigned int state_changes[4];
+    volatile unsigned int latency[INPUT_STATS_BUCKETS];
+    unsigned int          last_value[4];    // state returned by the previous poll of each port
+    unsigned int          shared[NUM_COUNTERS]; // only in a base: input_counters[] at the instance's last reset
+} SInputCounters;
+
+extern volatile unsigned int input_counters[NUM_COUNTERS];
+
+/* clears the shared counters and reads the frequency of the performance counter */
+extern void input_stats_init(void);
+
+/* for counters which only one thread at a time writes */
+static osal_inline void input_stats_bump(volatile unsigned int *Counter)
+{
+    osal_atomic_store(Counter, *Counter + 1);
+}
+
+/* for counters which any thread may write */
+static osal_inline void input_stats_add(enum EInputCounter Counter, unsigned int Value)
+{
+    osal_atomic_fetch_add(&input_counters[Counter], Value);
+}
+
+/* microseconds from 'Start' (performance counter) until now */
+extern unsigned int input_stats_usec(Uint64 Start);
+
+/* microseconds in a number of performance counter ticks */
+extern Uint64 input_stats_ticks_to_usec(Uint64 Ticks);
+
+/* the bucket of the microsecond histograms in input_ext.h: bucket 0 < 1 us, bucket n from 2^(n-1) to 2^n - 1 us,
+ * and the last bucket takes everything above */
+extern unsigned int input_stats_usec_bucket(Uint64 Usec);
+
+/* counts a poll of a port, which returned 'Value' */
+static osal_inline void input_stats_poll(SInputCounters *Counters, int Control, unsigned int Value)
+{
+    input_stats_bump(&Counters->polls[Control]);
+    if (Value != Counters->last_value[Control])
+    {
+        input_stats_bump(&Counters->state_changes[Control]);
+        Counters->last_value[Control] = Value;
+    }
+}
+
+/* adds the time from 'Start' (performance counter) until now to the latency histogram */
+extern void input_stats_latency(SInputCounters *Counters, Uint64 Start);
+
+/* fills in the fields of 'Stats' after 'size' from the counters of an instance and the shared ones, minus
+ * their values at the last input_stats_reset() of that instance */
+extern void input_stats_get(SInputCounters *Counters, const SInputCounters *Base, input_stats *Stats);
+
+/* takes the current counters as the new zero */
+extern void input_stats_reset(SInputCounters *Counters, SInputCounters *Base);
+
+#endif /* __INPUT_STATS_H__ */
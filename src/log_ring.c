@@ -0,0 +1,562 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - log_ring.c                                    *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "log_ring.h"
+#include "m64p_config.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "osal_atomic.h"
+#include "plugin.h"
+
+/* the queue is a bounded ring whose slots carry a sequence number, so that any thread can add a message with one
+ * compare-and-swap and the writer thread takes them in order.  a message is queued as its format string (which
+ * is always a literal) and the raw values of its arguments; the strings among them are copied into the slot */
+#define LOG_RING_SIZE       256                 // power of 2
+#define LOG_MAX_ARGS        16
+#define LOG_TEXT_SIZE       512
+#define LOG_MAX_SPEC        24                  // longest conversion spec which is formatted by the thread
+#define LOG_MESSAGE_SIZE    1024
+
+enum { LOG_ARG_NONE, LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_SIZE, LOG_ARG_DOUBLE, LOG_ARG_PTR,
+       LOG_ARG_STR, LOG_ARG_INVALID };
+
+typedef union
+{
+    int          i;
+    long         l;
+    long long    ll;
+    size_t       z;
+    double       d;
+    const void  *p;
+    unsigned int text;                          // offset of a string argument in text[]
+} ULogArg;
+
+typedef struct
+{
+    volatile unsigned int sequence;             // == position when free, position + 1 when it holds a message
+    int          level;
+    const char  *format;                        // NULL if text[] holds the formatted message
+    ULogArg      arg[LOG_MAX_ARGS];
+    char         text[LOG_TEXT_SIZE];
+} SLogEntry;
+
+/* one conversion of a format string */
+typedef struct
+{
+    const char  *start;                         // the '%'
+    const char  *end;                           // just past the conversion character
+    int          star_width, star_precision;    // width or precision given by an int argument
+    int          precision;                     // -1 if none or given by an argument
+    int          type;
+} SLogSpec;
+
+typedef struct
+{
+    volatile unsigned int window;               // second of SDL_GetTicks() which is counted
+    volatile unsigned int count;
+    volatile unsigned int dropped;
+} SRateLimit;
+
+/* configuration */
+static int          l_Async = 0;
+static unsigned int l_RateLimit = 0;
+#ifdef _DEBUG
+static int          l_LogInput = 1;
+#else
+static int          l_LogInput = 0;
+#endif
+
+static SLogEntry    l_Ring[LOG_RING_SIZE];
+static volatile unsigned int l_Head = 0;        // next position to be claimed by a writer of messages
+static unsigned int l_Tail = 0;                 // next position to be delivered
+static volatile unsigned int l_Overflow = 0;    // messages lost because the ring was full
+static SRateLimit   l_Limit[8];
+
+static void       (*l_Callback)(void *, int, const char *) = NULL;
+static void        *l_Context = NULL;
+static SDL_Thread  *l_LogThread = NULL;
+static SDL_sem     *l_Wakeup = NULL;
+static volatile unsigned int l_Running = 0, l_Quit = 0, l_Sleeping = 0;
+static int          l_RingReady = 0;
+static SDL_mutex   *l_DrainLock = NULL;         // held by whoever delivers the queued messages
+
+/* static functions */
+static void load_log_config(void)
+{
+    m64p_handle pConfig;
+    int limit;
+
+    l_Async = 0;
+    l_RateLimit = 0;
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+
+    ConfigSetDefaultBool(pConfig, "LogAsync", 0, "Format the plugin's log messages and pass them to the front-end on a separate thread, so that logging doesn't stall the emulation.  The front-end's log callback has to accept calls from any thread");
+    ConfigSetDefaultInt(pConfig, "LogRateLimit", 200, "Most log messages of each level per second; the rest are counted and dropped.  0 for no limit");
+#ifdef _DEBUG
+    ConfigSetDefaultBool(pConfig, "LogInput", 1, "Log every poll of the controllers and every pif command");
+#else
+    ConfigSetDefaultBool(pConfig, "LogInput", 0, "Log every poll of the controllers and every pif command");
+#endif
+    l_Async = ConfigGetParamBool(pConfig, "LogAsync");
+    limit = ConfigGetParamInt(pConfig, "LogRateLimit");
+    l_RateLimit = limit > 0 ? (unsigned int) limit : 0;
+    l_LogInput = ConfigGetParamBool(pConfig, "LogInput");
+}
+
+/* parses the conversion which starts at the '%' at 'p', and returns the character after it */
+static const char *parse_spec(const char *p, SLogSpec *spec)
+{
+    int length = 0;     // 1 = l, 2 = ll or j, 3 = z or t
+
+    spec->start = p++;
+    spec->star_width = spec->star_precision = 0;
+    spec->precision = -1;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+        p++;
+    if (*p == '*')
+    {
+        spec->star_width = 1;
+        p++;
+    }
+    else
+        while (*p >= '0' && *p <= '9')
+            p++;
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            spec->star_precision = 1;
+            p++;
+        }
+        else
+        {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9')
+                spec->precision = spec->precision * 10 + *p++ - '0';
+        }
+    }
+
+    if (*p == 'h')
+        p += p[1] == 'h' ? 2 : 1;
+    else if (*p == 'l')
+    {
+        length = p[1] == 'l' ? 2 : 1;
+        p += length;
+    }
+    else if (*p == 'j')
+    {
+        length = 2;
+        p++;
+    }
+    else if (*p == 'z' || *p == 't')
+    {
+        length = 3;
+        p++;
+    }
+
+    switch (*p)
+    {
+        case '%':
+            spec->type = p == spec->start + 1 ? LOG_ARG_NONE : LOG_ARG_INVALID;
+            break;
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            spec->type = length == 0 ? LOG_ARG_INT : length == 1 ? LOG_ARG_LONG : length == 2 ? LOG_ARG_LLONG : LOG_ARG_SIZE;
+            break;
+        case 'c':
+            spec->type = length == 0 ? LOG_ARG_INT : LOG_ARG_INVALID;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->type = length <= 1 ? LOG_ARG_DOUBLE : LOG_ARG_INVALID;
+            break;
+        case 's':
+            spec->type = length == 0 ? LOG_ARG_STR : LOG_ARG_INVALID;
+            break;
+        case 'p':
+            spec->type = length == 0 ? LOG_ARG_PTR : LOG_ARG_INVALID;
+            break;
+        default:
+            spec->type = LOG_ARG_INVALID;
+            return p;
+    }
+    spec->end = p + 1;
+    if (spec->end - spec->start > LOG_MAX_SPEC)
+        spec->type = LOG_ARG_INVALID;
+    return spec->end;
+}
+
+/* copies the arguments of a message into its slot; returns 0 if the format has a conversion which isn't supported,
+ * or the arguments don't fit */
+static int capture_args(SLogEntry *e, const char *format, va_list args)
+{
+    const char *p = format, *s;
+    unsigned int n = 0, used = 0, len, max;
+    SLogSpec spec;
+    int precision;
+
+    while ((p = strchr(p, '%')) != NULL)
+    {
+        p = parse_spec(p, &spec);
+        if (spec.type == LOG_ARG_INVALID)
+            return 0;
+        if (spec.type == LOG_ARG_NONE)
+            continue;
+        if (n + spec.star_width + spec.star_precision >= LOG_MAX_ARGS)
+            return 0;
+
+        if (spec.star_width)
+            e->arg[n++].i = va_arg(args, int);
+        precision = spec.precision;
+        if (spec.star_precision)
+            precision = e->arg[n++].i = va_arg(args, int);
+
+        switch (spec.type)
+        {
+            case LOG_ARG_INT:
+                e->arg[n].i = va_arg(args, int);
+                break;
+            case LOG_ARG_LONG:
+                e->arg[n].l = va_arg(args, long);
+                break;
+            case LOG_ARG_LLONG:
+                e->arg[n].ll = va_arg(args, long long);
+                break;
+            case LOG_ARG_SIZE:
+                e->arg[n].z = va_arg(args, size_t);
+                break;
+            case LOG_ARG_DOUBLE:
+                e->arg[n].d = va_arg(args, double);
+                break;
+            case LOG_ARG_PTR:
+                e->arg[n].p = va_arg(args, const void *);
+                break;
+            case LOG_ARG_STR:
+                /* only the characters which are printed are read, a precision may limit a string without a 0 */
+                s = va_arg(args, const char *);
+                if (s == NULL)
+                    s = "(null)";
+                max = precision >= 0 ? (unsigned int) precision : LOG_TEXT_SIZE;
+                for (len = 0; len < max && s[len] != 0; len++)
+                {
+                    if (used + len >= LOG_TEXT_SIZE - 1)
+                        return 0;
+                    e->text[used + len] = s[len];
+                }
+                e->text[used + len] = 0;
+                e->arg[n].text = used;
+                used += len + 1;
+                break;
+        }
+        n++;
+    }
+
+    return 1;
+}
+
+/* formats a queued message the way vsnprintf() would have formatted it at the call */
+static void format_entry(const SLogEntry *e, char *msg, size_t size)
+{
+    const char *p = e->format, *q;
+    size_t len = 0, chunk;
+    unsigned int n = 0;
+    char spec_format[LOG_MAX_SPEC * 2];
+    SLogSpec spec;
+    int j, r = 0;
+
+    if (p == NULL)
+    {
+        snprintf(msg, size, "%s", e->text);
+        return;
+    }
+
+    while (*p != 0 && len < size - 1)
+    {
+        q = strchr(p, '%');
+        chunk = q != NULL ? (size_t) (q - p) : strlen(p);
+        if (chunk > size - 1 - len)
+            chunk = size - 1 - len;
+        memcpy(msg + len, p, chunk);
+        len += chunk;
+        if (q == NULL || len >= size - 1)
+            break;
+
+        p = parse_spec(q, &spec);
+        if (spec.type == LOG_ARG_NONE)
+        {
+            msg[len++] = '%';
+            continue;
+        }
+
+        /* the conversion alone, with the values of the '*'s written in */
+        for (j = 0, q = spec.start; q < spec.end; q++)
+        {
+            if (*q == '*')
+                j += sprintf(spec_format + j, "%i", e->arg[n++].i);
+            else
+                spec_format[j++] = *q;
+        }
+        spec_format[j] = 0;
+
+        switch (spec.type)
+        {
+            case LOG_ARG_INT:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].i);
+                break;
+            case LOG_ARG_LONG:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].l);
+                break;
+            case LOG_ARG_LLONG:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].ll);
+                break;
+            case LOG_ARG_SIZE:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].z);
+                break;
+            case LOG_ARG_DOUBLE:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].d);
+                break;
+            case LOG_ARG_PTR:
+                r = snprintf(msg + len, size - len, spec_format, e->arg[n].p);
+                break;
+            case LOG_ARG_STR:
+                r = snprintf(msg + len, size - len, spec_format, e->text + e->arg[n].text);
+                break;
+        }
+        n++;
+        if (r > 0)
+            len += (size_t) r < size - 1 - len ? (size_t) r : size - 1 - len;
+    }
+    msg[len] = 0;
+}
+
+/* passes the queued messages to the front-end; returns how many there were */
+static unsigned int deliver_queued(void)
+{
+    char msg[LOG_MESSAGE_SIZE];
+    unsigned int delivered = 0, lost;
+    SLogEntry *e;
+
+    for (;;)
+    {
+        e = &l_Ring[l_Tail & (LOG_RING_SIZE - 1)];
+        if (osal_atomic_load(&e->sequence) != l_Tail + 1)
+            break;
+
+        format_entry(e, msg, sizeof(msg));
+        (*l_Callback)(l_Context, e->level, msg);
+        osal_atomic_store(&e->sequence, l_Tail + LOG_RING_SIZE);
+        l_Tail++;
+        delivered++;
+    }
+
+    lost = osal_atomic_fetch_and(&l_Overflow, 0);
+    if (lost != 0)
+    {
+        snprintf(msg, sizeof(msg), "Log: %u messages were lost because the queue was full", lost);
+        (*l_Callback)(l_Context, M64MSG_WARNING, msg);
+    }
+
+    return delivered;
+}
+
+static int LogWriter(void *unused)
+{
+    unsigned int delivered;
+
+    for (;;)
+    {
+        SDL_LockMutex(l_DrainLock);
+        delivered = deliver_queued();
+        SDL_UnlockMutex(l_DrainLock);
+        if (delivered != 0)
+            continue;
+        if (osal_atomic_load(&l_Quit))
+            break;
+
+        /* a message queued after this is seen by the second look at the ring, or it posts the semaphore */
+        osal_atomic_store(&l_Sleeping, 1);
+        if (osal_atomic_load(&l_Ring[l_Tail & (LOG_RING_SIZE - 1)].sequence) == l_Tail + 1)
+        {
+            osal_atomic_store(&l_Sleeping, 0);
+            continue;
+        }
+        SDL_SemWaitTimeout(l_Wakeup, 100);
+        osal_atomic_store(&l_Sleeping, 0);
+    }
+
+    return 0;
+}
+
+/* global functions */
+void log_ring_start(void (*Callback)(void *, int, const char *), void *Context)
+{
+    unsigned int i;
+
+    load_log_config();
+    memset(l_Limit, 0, sizeof(l_Limit));
+    if (!l_Async || Callback == NULL || l_LogThread != NULL)
+        return;
+
+    /* the ring is only set up once: a caller which claimed a slot before the last log_ring_stop() may still be
+     * writing it, and its message is then delivered by the new thread */
+    if (!l_RingReady)
+    {
+        for (i = 0; i < LOG_RING_SIZE; i++)
+            l_Ring[i].sequence = i;
+        l_Head = l_Tail = 0;
+        l_RingReady = 1;
+    }
+
+    if (l_Wakeup == NULL)
+        l_Wakeup = SDL_CreateSemaphore(0);
+    if (l_DrainLock == NULL)
+        l_DrainLock = SDL_CreateMutex();
+    if (l_Wakeup == NULL || l_DrainLock == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Log: couldn't create semaphore: %s", SDL_GetError());
+        return;
+    }
+
+    l_Callback = Callback;
+    l_Context = Context;
+    l_Quit = l_Sleeping = 0;
+    l_LogThread = SDL_CreateThread(LogWriter, "InputLog", NULL);
+    if (l_LogThread == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Log: couldn't create thread: %s", SDL_GetError());
+        return;
+    }
+    osal_atomic_store(&l_Running, 1);
+}
+
+void log_ring_stop(void)
+{
+    if (l_LogThread == NULL)
+        return;
+
+    /* new messages are delivered by their callers from now on */
+    osal_atomic_store(&l_Running, 0);
+    osal_atomic_fence();
+    osal_atomic_store(&l_Quit, 1);
+    SDL_SemPost(l_Wakeup);
+    SDL_WaitThread(l_LogThread, NULL);
+    l_LogThread = NULL;
+
+    /* anything a caller queued while the thread was stopping.  a caller which saw l_Running still set and
+     * publishes its message after this delivers it itself, see log_ring_push() */
+    SDL_LockMutex(l_DrainLock);
+    deliver_queued();
+    SDL_UnlockMutex(l_DrainLock);
+}
+
+int log_ring_allow(int Level, unsigned int *Dropped)
+{
+    SRateLimit *limit = &l_Limit[Level & 7];
+    unsigned int window, current;
+
+    *Dropped = 0;
+    if (l_RateLimit == 0)
+        return 1;
+
+    window = SDL_GetTicks() / 1000;
+    current = osal_atomic_load(&limit->window);
+    if (window != current && osal_atomic_cas(&limit->window, current, window))
+    {
+        osal_atomic_store(&limit->count, 0);
+        *Dropped = osal_atomic_fetch_and(&limit->dropped, 0);
+    }
+
+    if (osal_atomic_fetch_add(&limit->count, 1) < l_RateLimit)
+        return 1;
+    osal_atomic_fetch_add(&limit->dropped, 1);
+    return 0;
+}
+
+int log_ring_push(int Level, const char *Format, va_list Args)
+{
+    unsigned int pos;
+    SLogEntry *e;
+    va_list copy;
+    int diff, ok;
+
+    if (!osal_atomic_load(&l_Running))
+        return 0;
+
+    /* claim a slot; a full ring drops the message rather than making the caller wait */
+    pos = osal_atomic_load(&l_Head);
+    for (;;)
+    {
+        e = &l_Ring[pos & (LOG_RING_SIZE - 1)];
+        diff = (int) (osal_atomic_load(&e->sequence) - pos);
+        if (diff == 0)
+        {
+            if (osal_atomic_cas(&l_Head, pos, pos + 1))
+                break;
+            pos = osal_atomic_load(&l_Head);
+        }
+        else if (diff < 0)
+        {
+            osal_atomic_fetch_add(&l_Overflow, 1);
+            return 1;
+        }
+        else
+            pos = osal_atomic_load(&l_Head);
+    }
+
+    e->level = Level;
+    e->format = Format;
+    va_copy(copy, Args);
+    ok = capture_args(e, Format, copy);
+    va_end(copy);
+    if (!ok)
+    {
+        vsnprintf(e->text, LOG_TEXT_SIZE, Format, Args);
+        e->format = NULL;
+    }
+    osal_atomic_store(&e->sequence, pos + 1);
+
+    if (osal_atomic_load(&l_Sleeping) && osal_atomic_cas(&l_Sleeping, 1, 0))
+        SDL_SemPost(l_Wakeup);
+
+    /* pairs with log_ring_stop(): either its last look at the ring sees this message, or this caller sees
+     * l_Running cleared and delivers it */
+    osal_atomic_fence();
+    if (!osal_atomic_load(&l_Running))
+    {
+        SDL_LockMutex(l_DrainLock);
+        deliver_queued();
+        SDL_UnlockMutex(l_DrainLock);
+    }
+    return 1;
+}
+
+int log_ring_input_enabled(void)
+{
+    return l_LogInput;
+}
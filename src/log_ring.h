@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - log_ring.h                                    *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+#include <stdarg.h>
+
+/* reads the log settings of the 'Input-SDL' config section and, if 'LogAsync' is set, starts the thread which
+ * formats the queued messages and passes them to 'Callback' */
+extern void log_ring_start(void (*Callback)(void *, int, const char *), void *Context);
+
+/* delivers the messages which are still queued and stops the thread */
+extern void log_ring_stop(void);
+
+/* applies the 'LogRateLimit' of the message's level; returns 0 if the message has to be dropped.  the messages
+ * of that level which were dropped in the last second are returned in *Dropped when a new second begins */
+extern int  log_ring_allow(int Level, unsigned int *Dropped);
+
+/* queues a message for the thread; returns 0 if it isn't running, and the caller has to deliver the message */
+extern int  log_ring_push(int Level, const char *Format, va_list Args);
+
+/* is the logging of every poll and pif command ('LogInput') enabled */
+extern int  log_ring_input_enabled(void);
+
+#endif /* __LOG_RING_H__ */
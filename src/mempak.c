@@ -0,0 +1,140 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - mempak.c                                      *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_types.h"
+#include "mempak.h"
+#include "pak_file.h"
+#include "plugin.h"
+
+#define MEMPAK_SIZE         0x8000
+#define MEMPAK_PAGE_SIZE    256
+
+/* static data definitions */
+static SPakFile l_Mempak[4];
+
+/* static functions */
+static void write_id_block(unsigned char *block)
+{
+    static const unsigned char id[28] = {
+        0xff,0xff,0xff,0xff, 0x05,0x1a,0x5f,0x13, 0x00,0x00,0x00,0x00, 0x00,0x00,0x00,0x00,  // serial
+        0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,
+        0x00,0x01,                                                                          // device id
+        0x01,                                                                               // banks
+        0x00                                                                                // version
+    };
+    unsigned int sum = 0;
+    int i;
+
+    memcpy(block, id, sizeof(id));
+    for (i = 0; i < 28; i += 2)
+        sum += (block[i] << 8) | block[i + 1];
+    sum &= 0xffff;
+    block[28] = sum >> 8;
+    block[29] = sum & 0xff;
+    block[30] = (0xfff2 - sum) >> 8;
+    block[31] = (0xfff2 - sum) & 0xff;
+}
+
+/* lay out an empty, valid file system like a freshly formatted controller pak */
+static void format_mempak(unsigned char *mem)
+{
+    unsigned char *inodes = mem + MEMPAK_PAGE_SIZE;
+    int i;
+
+    memset(mem, 0, MEMPAK_SIZE);
+
+    /* page 0: label and the id block with its three backups */
+    for (i = 0; i < 32; i++)
+        mem[i] = (unsigned char) i;
+    mem[0] = 0x81;
+    write_id_block(mem + 0x20);
+    write_id_block(mem + 0x60);
+    write_id_block(mem + 0x80);
+    write_id_block(mem + 0xc0);
+
+    /* page 1: inode table with all data pages free, page 2 is its backup */
+    for (i = 5; i < 128; i++)
+    {
+        inodes[2 * i] = 0x00;
+        inodes[2 * i + 1] = 0x03;
+    }
+    inodes[1] = (unsigned char) (123 * 0x03);
+    memcpy(mem + 2 * MEMPAK_PAGE_SIZE, inodes, MEMPAK_PAGE_SIZE);
+}
+
+/* global functions */
+void mempak_open(int cntrl)
+{
+    char path[1024];
+    const char *dir;
+    size_t len;
+    int result;
+
+    if (l_Mempak[cntrl].map.data != NULL)
+        return;
+
+    dir = ConfigGetUserDataPath();
+    if (dir == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't get user data path for controller pak #%i", cntrl + 1);
+        return;
+    }
+    len = strlen(dir);
+    if (len > 0 && (dir[len - 1] == '/' || dir[len - 1] == '\\'))
+        snprintf(path, sizeof(path), "%smempak%i.mpk", dir, cntrl + 1);
+    else
+        snprintf(path, sizeof(path), "%s/mempak%i.mpk", dir, cntrl + 1);
+
+    result = pak_file_open(&l_Mempak[cntrl], path, MEMPAK_SIZE);
+    if (result == 2)
+    {
+        DebugMessage(M64MSG_INFO, "Formatting new controller pak '%s'", path);
+        format_mempak(l_Mempak[cntrl].map.data);
+        pak_file_touch(&l_Mempak[cntrl], 0, MEMPAK_SIZE);
+    }
+}
+
+void mempak_close(int cntrl)
+{
+    pak_file_close(&l_Mempak[cntrl]);
+}
+
+void mempak_read(int cntrl, unsigned int address, unsigned char *data)
+{
+    /* nothing answers above the pak's 32 KiB */
+    if (address < MEMPAK_SIZE && l_Mempak[cntrl].map.data != NULL)
+        memcpy(data, l_Mempak[cntrl].map.data + address, 32);
+    else
+        memset(data, 0x00, 32);
+}
+
+void mempak_write(int cntrl, unsigned int address, const unsigned char *data)
+{
+    if (address < MEMPAK_SIZE)
+        pak_file_write(&l_Mempak[cntrl], address, data, 32);
+}
+
@@ -0,0 +1,111 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - osal_atomic.h                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* this header file provides the few atomic operations which are shared between
+ * the emulation thread and the plugin's helper threads.  SDL 1.2 has no atomics
+ * and SDL 2's set has no fetch-or/fetch-and, so we use the compiler intrinsics. */
+
+#if !defined(OSAL_ATOMIC_H)
+#define OSAL_ATOMIC_H
+
+#include "osal_preproc.h"
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+static osal_inline unsigned int osal_atomic_load(volatile unsigned int *p)
+{
+    return (unsigned int) _InterlockedOr((volatile long *) p, 0);
+}
+
+static osal_inline void osal_atomic_store(volatile unsigned int *p, unsigned int v)
+{
+    _InterlockedExchange((volatile long *) p, (long) v);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_add(volatile unsigned int *p, unsigned int v)
+{
+    return (unsigned int) _InterlockedExchangeAdd((volatile long *) p, (long) v);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_or(volatile unsigned int *p, unsigned int v)
+{
+    return (unsigned int) _InterlockedOr((volatile long *) p, (long) v);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_and(volatile unsigned int *p, unsigned int v)
+{
+    return (unsigned int) _InterlockedAnd((volatile long *) p, (long) v);
+}
+
+static osal_inline int osal_atomic_cas(volatile unsigned int *p, unsigned int expected, unsigned int desired)
+{
+    return (unsigned int) _InterlockedCompareExchange((volatile long *) p, (long) desired, (long) expected) == expected;
+}
+
+static osal_inline void osal_atomic_fence(void)
+{
+    /* interlocked operations are full barriers */
+    volatile long dummy = 0;
+    _InterlockedOr(&dummy, 0);
+}
+
+#else  /* GCC / Clang */
+
+static osal_inline unsigned int osal_atomic_load(volatile unsigned int *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static osal_inline void osal_atomic_store(volatile unsigned int *p, unsigned int v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_add(volatile unsigned int *p, unsigned int v)
+{
+    return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_or(volatile unsigned int *p, unsigned int v)
+{
+    return __atomic_fetch_or(p, v, __ATOMIC_RELEASE);
+}
+
+static osal_inline unsigned int osal_atomic_fetch_and(volatile unsigned int *p, unsigned int v)
+{
+    return __atomic_fetch_and(p, v, __ATOMIC_RELEASE);
+}
+
+static osal_inline int osal_atomic_cas(volatile unsigned int *p, unsigned int expected, unsigned int desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static osal_inline void osal_atomic_fence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+#endif // OSAL_ATOMIC_H
+
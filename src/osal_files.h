@@ -0,0 +1,52 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - osal_files.h                                  *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+/* this header file declares the memory mapped file helpers used for the plugin's pak images */
+
+#if !defined(OSAL_FILES_H)
+#define OSAL_FILES_H
+
+#include <stddef.h>
+
+typedef struct
+{
+    unsigned char *data;    // start of the mapping; NULL if not mapped
+    size_t         size;
+    int            readonly;
+    void          *file;    // platform handles (only used on win32)
+    void          *mapping;
+} osal_mapped_file;
+
+/* maps the first 'size' bytes of the file at 'path' for reading and writing.  the file is created (or
+ * grown) as needed, newly created bytes read as zero.  returns 0 on failure, 1 if the file existed with
+ * at least 'size' bytes, and 2 if the mapping contains new bytes which the caller has to initialize. */
+int  osal_file_map(osal_mapped_file *map, const char *path, size_t size);
+
+/* maps the whole existing file at 'path' read-only.  returns 0 on failure */
+int  osal_file_map_readonly(osal_mapped_file *map, const char *path);
+
+/* writes the given range of the mapping back to the file.  blocks until the data has been written */
+void osal_file_sync(osal_mapped_file *map, size_t offset, size_t length);
+
+void osal_file_unmap(osal_mapped_file *map);
+
+#endif /* OSAL_FILES_H */
+
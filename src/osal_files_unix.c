@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - osal_files_unix.c                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "osal_files.h"
+
+int osal_file_map(osal_mapped_file *map, const char *path, size_t size)
+{
+    struct stat st;
+    void *data;
+    int fd, result = 1;
+
+    memset(map, 0, sizeof(osal_mapped_file));
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    if ((size_t) st.st_size < size)
+    {
+        /* the new part of the file reads back as zeros */
+        if (ftruncate(fd, (off_t) size) != 0)
+        {
+            close(fd);
+            return 0;
+        }
+        result = 2;
+    }
+
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    /* the mapping keeps its own reference to the file */
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+
+    map->data = (unsigned char *) data;
+    map->size = size;
+    return result;
+}
+
+int osal_file_map_readonly(osal_mapped_file *map, const char *path)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    memset(map, 0, sizeof(osal_mapped_file));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+
+    map->data = (unsigned char *) data;
+    map->size = (size_t) st.st_size;
+    map->readonly = 1;
+    return 1;
+}
+
+void osal_file_sync(osal_mapped_file *map, size_t offset, size_t length)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start;
+
+    if (map->data == NULL || map->readonly || offset >= map->size)
+        return;
+    if (length > map->size - offset)
+        length = map->size - offset;
+
+    /* msync() wants a page aligned address */
+    start = offset - (offset % page);
+    msync(map->data + start, length + (offset - start), MS_SYNC);
+}
+
+void osal_file_unmap(osal_mapped_file *map)
+{
+    if (map->data == NULL)
+        return;
+
+    if (!map->readonly)
+        msync(map->data, map->size, MS_SYNC);
+    munmap(map->data, map->size);
+    memset(map, 0, sizeof(osal_mapped_file));
+}
+
@@ -0,0 +1,140 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - osal_files_win32.c                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+#include <windows.h>
+
+#include "osal_files.h"
+
+int osal_file_map(osal_mapped_file *map, const char *path, size_t size)
+{
+    LARGE_INTEGER fileSize;
+    HANDLE hFile, hMapping;
+    void *data;
+    int result = 1;
+
+    memset(map, 0, sizeof(osal_mapped_file));
+
+    hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return 0;
+
+    if (!GetFileSizeEx(hFile, &fileSize))
+    {
+        CloseHandle(hFile);
+        return 0;
+    }
+    /* CreateFileMapping() grows the file with zeros if it is too short */
+    if ((ULONGLONG) fileSize.QuadPart < (ULONGLONG) size)
+        result = 2;
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, 0, (DWORD) size, NULL);
+    if (hMapping == NULL)
+    {
+        CloseHandle(hFile);
+        return 0;
+    }
+
+    data = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (data == NULL)
+    {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return 0;
+    }
+
+    map->data = (unsigned char *) data;
+    map->size = size;
+    map->file = hFile;
+    map->mapping = hMapping;
+    return result;
+}
+
+int osal_file_map_readonly(osal_mapped_file *map, const char *path)
+{
+    LARGE_INTEGER fileSize;
+    HANDLE hFile, hMapping;
+    void *data;
+
+    memset(map, 0, sizeof(osal_mapped_file));
+
+    hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return 0;
+
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return 0;
+    }
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL)
+    {
+        CloseHandle(hFile);
+        return 0;
+    }
+
+    data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return 0;
+    }
+
+    /* the mapping keeps its own reference to the file */
+    CloseHandle(hFile);
+    map->data = (unsigned char *) data;
+    map->size = (size_t) fileSize.QuadPart;
+    map->readonly = 1;
+    map->mapping = hMapping;
+    return 1;
+}
+
+void osal_file_sync(osal_mapped_file *map, size_t offset, size_t length)
+{
+    if (map->data == NULL || map->readonly || offset >= map->size)
+        return;
+    if (length > map->size - offset)
+        length = map->size - offset;
+
+    /* FlushViewOfFile() only starts the write, FlushFileBuffers() waits for it */
+    FlushViewOfFile(map->data + offset, length);
+    FlushFileBuffers((HANDLE) map->file);
+}
+
+void osal_file_unmap(osal_mapped_file *map)
+{
+    if (map->data == NULL)
+        return;
+
+    if (!map->readonly)
+    {
+        FlushViewOfFile(map->data, map->size);
+        FlushFileBuffers((HANDLE) map->file);
+    }
+    UnmapViewOfFile(map->data);
+    CloseHandle((HANDLE) map->mapping);
+    if (map->file != NULL)
+        CloseHandle((HANDLE) map->file);
+    memset(map, 0, sizeof(osal_mapped_file));
+}
+
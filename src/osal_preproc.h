@@ -34,12 +34,39 @@
 
   // macros
   #define osal_inline __inline
+  #define osal_thread_local __declspec(thread)
+  #define osal_align(bytes) __declspec(align(bytes))
 
 #else  /* Not WIN32 */
 
   // macros
   #define osal_inline inline
+  #define osal_thread_local __thread
+  #define osal_align(bytes) __attribute__((aligned(bytes)))
 
 #endif
 
+// memory for types with an alignment above that of malloc(); the alignment must be a power of 2
+#if defined(WIN32)
+  #include <malloc.h>
+  #define osal_aligned_malloc(size, alignment) _aligned_malloc(size, alignment)
+  #define osal_aligned_free _aligned_free
+#else
+  #include <stdlib.h>
+  static osal_inline void *osal_aligned_malloc(size_t size, size_t alignment)
+  {
+    void *p;
+
+    return (posix_memalign(&p, alignment, size) == 0) ? p : NULL;
+  }
+  #define osal_aligned_free free
+#endif
+
+// POSIX shared memory (shm_open) and unix domain sockets
+#if !defined(WIN32) && !defined(__ANDROID__) && !EMSCRIPTEN
+  #define OSAL_HAVE_POSIX_IPC 1
+#else
+  #define OSAL_HAVE_POSIX_IPC 0
+#endif
+
 #endif // OSAL_PREPROC_H
@@ -0,0 +1,204 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - pak_file.c                                    *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <string.h>
+
+#include "m64p_types.h"
+#include "osal_atomic.h"
+#include "osal_files.h"
+#include "pak_file.h"
+#include "plugin.h"
+
+/* 4 mempaks + 4 transfer pak cartridge saves */
+#define PAK_FILE_MAX        8
+/* how often the flusher thread looks for dirty blocks */
+#define PAK_FLUSH_MS        1000
+
+/* static data definitions */
+static SPakFile     *l_Files[PAK_FILE_MAX];
+static SDL_mutex    *l_FilesLock = NULL;
+static SDL_sem      *l_FlusherWakeup = NULL;
+static SDL_Thread   *l_FlusherThread = NULL;
+static volatile unsigned int l_FlusherQuit = 0;
+
+/* static functions */
+static void flush_file(SPakFile *pak)
+{
+    unsigned int dirty = osal_atomic_fetch_and(&pak->dirty, 0);
+    int first, last;
+
+    /* write back each run of adjacent dirty blocks with a single call */
+    for (first = 0; dirty != 0 && first < 32; first++)
+    {
+        if (!(dirty & (1u << first)))
+            continue;
+        for (last = first; last + 1 < 32 && (dirty & (1u << (last + 1))); last++)
+            ;
+        osal_file_sync(&pak->map, first * pak->block_size, (last - first + 1) * pak->block_size);
+        dirty &= ~(((last < 31) ? (1u << (last + 1)) : 0u) - (1u << first));
+        first = last;
+    }
+}
+
+static void flush_all(void)
+{
+    int i;
+
+    if (l_FilesLock != NULL)
+        SDL_LockMutex(l_FilesLock);
+    for (i = 0; i < PAK_FILE_MAX; i++)
+    {
+        if (l_Files[i] != NULL && osal_atomic_load(&l_Files[i]->dirty) != 0)
+            flush_file(l_Files[i]);
+    }
+    if (l_FilesLock != NULL)
+        SDL_UnlockMutex(l_FilesLock);
+}
+
+static int PakFlusher(void *unused)
+{
+    while (!osal_atomic_load(&l_FlusherQuit))
+    {
+        SDL_SemWaitTimeout(l_FlusherWakeup, PAK_FLUSH_MS);
+        flush_all();
+    }
+
+    return 0;
+}
+
+/* global functions */
+int pak_file_open(SPakFile *pak, const char *path, size_t size)
+{
+    int i, result;
+
+    memset(pak, 0, sizeof(SPakFile));
+
+    result = osal_file_map(&pak->map, path, size);
+    if (result == 0)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't map pak file '%s'", path);
+        return 0;
+    }
+    pak->block_size = (size + 31) / 32;
+
+    if (l_FilesLock == NULL)
+        l_FilesLock = SDL_CreateMutex();
+    if (l_FilesLock != NULL)
+        SDL_LockMutex(l_FilesLock);
+    for (i = 0; i < PAK_FILE_MAX; i++)
+    {
+        if (l_Files[i] == NULL)
+        {
+            l_Files[i] = pak;
+            break;
+        }
+    }
+    if (l_FilesLock != NULL)
+        SDL_UnlockMutex(l_FilesLock);
+
+    return result;
+}
+
+void pak_file_close(SPakFile *pak)
+{
+    int i;
+
+    if (pak->map.data == NULL)
+        return;
+
+    if (l_FilesLock != NULL)
+        SDL_LockMutex(l_FilesLock);
+    for (i = 0; i < PAK_FILE_MAX; i++)
+    {
+        if (l_Files[i] == pak)
+            l_Files[i] = NULL;
+    }
+    if (l_FilesLock != NULL)
+        SDL_UnlockMutex(l_FilesLock);
+
+    /* writes back whatever the flusher didn't get to */
+    osal_file_unmap(&pak->map);
+    pak->dirty = 0;
+}
+
+void pak_file_write(SPakFile *pak, size_t offset, const unsigned char *data, size_t length)
+{
+    if (pak->map.data == NULL || offset >= pak->map.size)
+        return;
+    if (length > pak->map.size - offset)
+        length = pak->map.size - offset;
+
+    memcpy(pak->map.data + offset, data, length);
+    pak_file_touch(pak, offset, length);
+}
+
+void pak_file_touch(SPakFile *pak, size_t offset, size_t length)
+{
+    unsigned int first, last, mask;
+
+    if (pak->map.data == NULL || length == 0)
+        return;
+
+    first = (unsigned int) (offset / pak->block_size);
+    last = (unsigned int) ((offset + length - 1) / pak->block_size);
+    mask = ((last < 31) ? (1u << (last + 1)) : 0u) - (1u << first);
+
+    /* the common case is a block which is already waiting for the flusher */
+    if ((osal_atomic_load(&pak->dirty) & mask) != mask)
+        osal_atomic_fetch_or(&pak->dirty, mask);
+}
+
+void pak_file_start_flusher(void)
+{
+    if (l_FlusherThread != NULL)
+        return;
+
+    l_FlusherQuit = 0;
+    l_FlusherWakeup = SDL_CreateSemaphore(0);
+    if (l_FlusherWakeup == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't create pak flusher semaphore: %s", SDL_GetError());
+        return;
+    }
+
+    l_FlusherThread = SDL_CreateThread(PakFlusher, "InputPakFlush", NULL);
+    if (l_FlusherThread == NULL)
+    {
+        /* no threads: the pak files are written back when they are closed */
+        DebugMessage(M64MSG_VERBOSE, "Couldn't create pak flusher thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(l_FlusherWakeup);
+        l_FlusherWakeup = NULL;
+    }
+}
+
+void pak_file_stop_flusher(void)
+{
+    if (l_FlusherThread == NULL)
+        return;
+
+    osal_atomic_store(&l_FlusherQuit, 1);
+    SDL_SemPost(l_FlusherWakeup);
+    SDL_WaitThread(l_FlusherThread, NULL);
+    l_FlusherThread = NULL;
+    SDL_DestroySemaphore(l_FlusherWakeup);
+    l_FlusherWakeup = NULL;
+}
+
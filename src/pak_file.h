@@ -0,0 +1,48 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - pak_file.h                                    *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __PAK_FILE_H__
+#define __PAK_FILE_H__
+
+#include <stddef.h>
+
+#include "osal_files.h"
+
+/* a pak image stored in a memory mapped file.  the emulation thread reads and writes the mapping
+ * directly and only marks the written blocks as dirty; the flusher thread writes them back to disk */
+typedef struct
+{
+    osal_mapped_file      map;
+    size_t                block_size;   // bytes covered by one bit in 'dirty'
+    volatile unsigned int dirty;        // blocks written since the last flush
+} SPakFile;
+
+/* returns 0 on failure, 1 for an existing image, and 2 for a new (zero filled) image */
+extern int  pak_file_open(SPakFile *pak, const char *path, size_t size);
+extern void pak_file_close(SPakFile *pak);
+
+extern void pak_file_write(SPakFile *pak, size_t offset, const unsigned char *data, size_t length);
+extern void pak_file_touch(SPakFile *pak, size_t offset, size_t length);
+
+extern void pak_file_start_flusher(void);
+extern void pak_file_stop_flusher(void);
+
+#endif /* __PAK_FILE_H__ */
+
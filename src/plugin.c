@@ -32,34 +32,34 @@
 #define M64P_CORE_PROTOTYPES 1
 #endif
 #define M64P_PLUGIN_PROTOTYPES 1
+#include "button_eval.h"
 #include "config.h"
+#include "input_delay.h"
+#include "input_ext.h"
+#include "input_hash.h"
+#include "input_history.h"
+#include "input_sampler.h"
+#include "input_server.h"
+#include "log_ring.h"
 #include "m64p_common.h"
 #include "m64p_config.h"
 #include "m64p_plugin.h"
 #include "m64p_types.h"
+#include "mempak.h"
+#include "osal_atomic.h"
 #include "osal_dynamiclib.h"
+#include "osal_preproc.h"
+#include "pak_file.h"
 #include "plugin.h"
+#include "probes.h"
+#include "rumble.h"
+#include "shm_input.h"
+#include "tpak.h"
+#include "trace.h"
 #include "version.h"
 
-#ifdef __linux__
-#include <dirent.h>
-#include <fcntl.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <linux/input.h>
-#endif /* __linux__ */
-
 #include <errno.h>
 
-/* defines for the force feedback rumble support */
-#ifdef __linux__
-#define BITS_PER_LONG (sizeof(long) * 8)
-#define OFF(x)  ((x)%BITS_PER_LONG)
-#define BIT(x)  (1UL<<OFF(x))
-#define LONG(x) ((x)/BITS_PER_LONG)
-#define test_bit(bit, array)    ((array[LONG(bit)] >> OFF(bit)) & 1)
-#endif //__linux__
-
 
 #if (!M64P_STATIC_PLUGINS)
 /* definitions of pointers to Core config functions */
@@ -86,14 +86,30 @@ ptr_ConfigGetUserCachePath      ConfigGetUserCachePath = NULL;
 #endif
 
 /* global data definitions */
-SController controller[4];   // 4 controllers
+SPluginInstance default_instance;   // the emulator which the standard plugin API talks to
 
 /* static data definitions */
 static void (*l_DebugCallback)(void *, int, const char *) = NULL;
 static void *l_DebugCallContext = NULL;
 static int l_PluginInit = 0;
 static int l_joyWasInit = 0;
-static int l_hapticWasInit = 0;
+
+/* the core's config functions aren't thread safe, so the instances take turns reading the configuration */
+static SDL_mutex *l_ConfigLock = NULL;
+static volatile unsigned int l_NextInstanceId = 1;
+
+/* instance used by the calling thread, see InputInstanceBind(); NULL for the default instance */
+static osal_thread_local SPluginInstance *l_BoundInstance = NULL;
+
+#if defined(HAVE_SYS_SDT_H)
+/* the semaphores of the USDT probes, which a tracer increments while it is attached to the probe */
+#define PROBE_DEFINE_SEMAPHORE(name) volatile unsigned short PROBE_SEMAPHORE(name) __attribute__ ((section (".probes"))) = 0;
+PROBE_LIST(PROBE_DEFINE_SEMAPHORE)
+#endif
+
+/* the newest sample of the sampler thread, handed over under input_sampler_lock(), and the one it reads into */
+static SJoystickSample l_SamplerLatest;
+static SJoystickSample l_SamplerBuffer;
 
 static unsigned short button_bits[] = {
     0x0001,  // R_DPAD
@@ -114,34 +130,109 @@ static unsigned short button_bits[] = {
     0x8000   // Rumblepak switch
 };
 
-static int romopen = 0;         // is a rom opened
+/* static function declarations */
+static void sample_devices(SPluginInstance *inst);
+static void evaluate_port(SPluginInstance *inst, int Control, BUTTONS *Keys);
 
-static unsigned char myKeyState[SDL_NUM_SCANCODES];
-
-#if __linux__ && !SDL_VERSION_ATLEAST(2,0,0)
-static struct ff_effect ffeffect[4];
-static struct ff_effect ffstrong[4];
-static struct ff_effect ffweak[4];
-#endif //__linux__
+/* serialized form of the runtime state; all values are 32 bit words */
+#define STATE_MAGIC     0x54534953      // "SIST"
+#define STATE_VERSION   1
+enum { STATE_WORD_MAGIC, STATE_WORD_VERSION, STATE_WORD_SWITCH_ELAPSED, STATE_WORD_SWITCH_TYPE = STATE_WORD_SWITCH_ELAPSED + 4,
+       STATE_WORD_PLUGIN = STATE_WORD_SWITCH_TYPE + 4, STATE_WORD_RUMBLE = STATE_WORD_PLUGIN + 4,
+       STATE_WORD_MOUSE = STATE_WORD_RUMBLE + 4, STATE_WORD_GRAB = STATE_WORD_MOUSE + 2, STATE_WORDS };
 
 /* Global functions */
-void DebugMessage(int level, const char *message, ...)
+/* queues the message for the log thread, or formats and delivers it right away if that isn't running */
+static void deliver_message(int level, const char *message, va_list args)
 {
   char msgbuf[1024];
+
+  if (log_ring_push(level, message, args))
+      return;
+
+  vsnprintf(msgbuf, sizeof(msgbuf), message, args);
+  (*l_DebugCallback)(l_DebugCallContext, level, msgbuf);
+}
+
+static void deliver_notice(int level, const char *message, ...)
+{
+  va_list args;
+
+  va_start(args, message);
+  deliver_message(level, message, args);
+  va_end(args);
+}
+
+void DebugMessage(int level, const char *message, ...)
+{
+  unsigned int dropped;
   va_list args;
 
   if (l_DebugCallback == NULL)
       return;
+  if (!log_ring_allow(level, &dropped))
+      return;
+  if (dropped != 0)
+      deliver_notice(level, "Log: %u messages of this level were dropped by LogRateLimit", dropped);
 
   va_start(args, message);
-  vsprintf(msgbuf, message, args);
+  deliver_message(level, message, args);
+  va_end(args);
+}
 
-  (*l_DebugCallback)(l_DebugCallContext, level, msgbuf);
+static SPluginInstance *current_instance(void)
+{
+    return l_BoundInstance != NULL ? l_BoundInstance : &default_instance;
+}
 
-  va_end(args);
+/* the duration argument of the getkeys_exit probe */
+static unsigned int probe_duration_ns(Uint64 start)
+{
+    Uint64 ticks = SDL_GetPerformanceCounter() - start;
+
+    return (unsigned int) (ticks * 1000000000 / SDL_GetPerformanceFrequency());
 }
 
-static CONTROL temp_core_controlinfo[4];
+/* clears the controllers of an instance and points them at 'Controls' (the core's CONTROL structs, or the
+ * instance's own until the core passes them), then reads the configuration into them and compiles it */
+static void setup_instance(SPluginInstance *inst, CONTROL *Controls, int bPreConfig)
+{
+    const SBinding *button_bind[4];
+    unsigned int button_count[4];
+    int i;
+
+    memset(inst->controller, 0, sizeof(inst->controller));
+    memset(inst->pressed, 0, sizeof(inst->pressed));
+    for (i = 0; i < KEY_STATE_WORDS; i++)
+        osal_atomic_store(&inst->key_bits[i], 0);
+    osal_atomic_fetch_add(&inst->key_generation, 1);
+    for (i = 0; i < 4; i++)
+        inst->controller[i].control = Controls + i;
+    inst->last_port = 4;
+
+    if (l_ConfigLock != NULL)
+        SDL_LockMutex(l_ConfigLock);
+    load_configuration(inst->controller, bPreConfig);
+    if (l_ConfigLock != NULL)
+        SDL_UnlockMutex(l_ConfigLock);
+
+    for (i = 0; i < 4; i++)
+    {
+        if (inst->headless)
+        {
+            // the joysticks and the mouse stay with the default instance
+            inst->controller[i].device = DEVICE_NO_JOYSTICK;
+            inst->controller[i].mouse = 0;
+            if (inst->controller[i].control->Plugin == PLUGIN_RAW)
+                inst->controller[i].control->Plugin = PLUGIN_MEMPAK;
+        }
+        compile_bindings(&inst->controller[i]);
+        inst->controller[i].generation = 1;     // 'local' hasn't been computed yet
+        button_bind[i] = inst->controller[i].bindings.button;
+        button_count[i] = inst->controller[i].bindings.num_buttons;
+    }
+    button_eval_build(&inst->button_prog, button_bind, button_count);
+}
 
 /* Mupen64Plus plugin functions */
 EXPORT m64p_error CALL
@@ -154,8 +245,9 @@ PluginStartup
                                    void (*DebugCallback)(void *, int, const char *))
 {
     ptr_CoreGetAPIVersions CoreAPIVersionFunc;
+    Uint64 startup_start = SDL_GetPerformanceCounter(), start;
 
-    int i, ConfigAPIVersion, DebugAPIVersion, VidextAPIVersion;
+    int ConfigAPIVersion, DebugAPIVersion, VidextAPIVersion;
 
     if (l_PluginInit)
         return M64ERR_ALREADY_INIT;
@@ -221,19 +313,15 @@ PluginStartup
 
 #endif
 
-    /* reset controllers */
-    memset(controller, 0, sizeof(SController) * 4);
-    for (i = 0; i < SDL_NUM_SCANCODES; i++)
-    {
-        myKeyState[i] = 0;
-    }
-    /* set CONTROL struct pointers to the temporary static array */
-    /* this small struct is used to tell the core whether each controller is plugged in, and what type of pak is connected */
-    /* we only need it so that we can call load_configuration below, to auto-config for a GUI front-end */
-    for (i = 0; i < 4; i++)
-        controller[i].control = temp_core_controlinfo + i;
+    /* from here on the log messages may go through the log thread */
+    log_ring_start(DebugCallback, Context);
+    trace_start(startup_start);
+    input_stats_init();
+    input_stats_reset(&default_instance.stats, &default_instance.stats_base);
+    trace_span("PluginStartup: connect core", startup_start, -1);
 
     /* initialize the joystick subsystem if necessary */
+    start = trace_now();
     l_joyWasInit = SDL_WasInit(SDL_INIT_JOYSTICK);
     if (!l_joyWasInit)
         if (SDL_InitSubSystem(SDL_INIT_JOYSTICK) == -1)
@@ -241,10 +329,27 @@ PluginStartup
             DebugMessage(M64MSG_ERROR, "Couldn't init SDL joystick subsystem: %s", SDL_GetError() );
             return M64ERR_SYSTEM_FAIL;
         }
+    trace_span("PluginStartup: joystick subsystem", start, -1);
+
+    l_ConfigLock = SDL_CreateMutex();
+
+    start = trace_now();
+    button_eval_init();
+    trace_span("PluginStartup: button evaluator", start, -1);
+    DebugMessage(M64MSG_VERBOSE, "Using the %s button evaluator", button_eval_name());
+
+    /* reset the default instance; its CONTROL struct pointers go to its own array until InitiateControllers() */
+    /* this small struct is used to tell the core whether each controller is plugged in, and what type of pak is connected */
+    /* we only need it so that we can read the configuration here, to auto-config for a GUI front-end */
+    memset(&default_instance, 0, sizeof(default_instance));
+    default_instance.runtime.grab_mouse = 1;
 
     /* read plugin config from core config database, auto-config if necessary and update core database */
-    load_configuration(1);
+    start = trace_now();
+    setup_instance(&default_instance, default_instance.control_info, 1);
+    trace_span("PluginStartup: configuration", start, -1);
 
+    trace_span("PluginStartup", startup_start, -1);
     l_PluginInit = 1;
     return M64ERR_SUCCESS;
 }
@@ -260,7 +365,12 @@ PluginShutdown
     if (!l_PluginInit)
         return M64ERR_NOT_INIT;
 
+    /* close the cached force feedback devices */
+    rumble_release_all();
+
     /* reset some local variables */
+    trace_stop();
+    log_ring_stop();
     l_DebugCallback = NULL;
     l_DebugCallContext = NULL;
 
@@ -268,6 +378,10 @@ PluginShutdown
     if (!l_joyWasInit)
         SDL_QuitSubSystem(SDL_INIT_JOYSTICK);
 
+    if (l_ConfigLock != NULL)
+        SDL_DestroyMutex(l_ConfigLock);
+    l_ConfigLock = NULL;
+
     l_PluginInit = 0;
     return M64ERR_SUCCESS;
 }
@@ -296,141 +410,180 @@ PluginGetVersion
 
     if (Capabilities != NULL)
     {
-        *Capabilities = 0;
+        *Capabilities = INPUT_CAPS_GET_ALL_KEYS | INPUT_CAPS_INPUT_SERVER | INPUT_CAPS_INPUT_HISTORY |
+                        INPUT_CAPS_SAVE_STATE | INPUT_CAPS_INPUT_DELAY | INPUT_CAPS_INPUT_HASH |
+                        INPUT_CAPS_INSTANCES | INPUT_CAPS_INPUT_SAMPLER | INPUT_CAPS_INPUT_STATS;
     }
 
     return M64ERR_SUCCESS;
 }
 
+/* is 'type' one of the PLUGIN_* pak types, which a saved state may hand to the core */
+static int valid_pak_type(Uint32 type)
+{
+    switch (type)
+    {
+        case PLUGIN_NONE:
+        case PLUGIN_MEMPAK:
+        case PLUGIN_RUMBLE_PAK:
+        case PLUGIN_TRANSFER_PAK:
+        case PLUGIN_RAW:
+#ifdef PLUGIN_BIO_PAK
+        case PLUGIN_BIO_PAK:
+#endif
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void grab_mouse(SPluginInstance *inst, int grab)
+{
+    inst->runtime.grab_mouse = grab;
+#if SDL_VERSION_ATLEAST(2,0,0)
+    SDL_SetRelativeMouseMode(grab ? SDL_TRUE : SDL_FALSE);
+#else
+    SDL_WM_GrabInput( grab ? SDL_GRAB_ON : SDL_GRAB_OFF );
+#endif
+    SDL_ShowCursor( grab ? 0 : 1 );
+}
+
+/* is 'key' down on the keyboard (if 'keystate' isn't NULL) or according to SDL_KeyDown()/SDL_KeyUp()? */
+static osal_inline int key_down(const SPluginInstance *inst, const unsigned char *keystate, int key)
+{
+    if ((unsigned int) key >= SDL_NUM_SCANCODES)
+        return 0;
+    return (keystate != NULL && keystate[key]) || ((inst->keys[key >> 5] >> (key & 31)) & 1);
+}
+
 /* Helper function to handle the SDL keys */
 static void
-doSdlKeys(const unsigned char* keystate)
+doSdlKeys(SPluginInstance *inst, const unsigned char* keystate)
 {
-    int c, b, axis_val, axis_max_val;
-    static int grabmouse = 1, grabtoggled = 0;
+    int c, i, axis_max_val;
 
     axis_max_val = 80;
-    if (keystate[SDL_SCANCODE_RCTRL])
+    if (key_down(inst, keystate, SDL_SCANCODE_RCTRL))
         axis_max_val -= 40;
-    if (keystate[SDL_SCANCODE_RSHIFT])
+    if (key_down(inst, keystate, SDL_SCANCODE_RSHIFT))
         axis_max_val -= 25;
 
     for( c = 0; c < 4; c++ )
     {
-        for( b = 0; b < 16; b++ )
-        {
-            if( controller[c].button[b].key == SDL_SCANCODE_UNKNOWN || ((int) controller[c].button[b].key) < 0)
-                continue;
-            if( keystate[controller[c].button[b].key] )
-                controller[c].buttons.Value |= button_bits[b];
-        }
-        for( b = 0; b < 2; b++ )
+        SController *cntrl = &inst->controller[c];
+        const SBinding *bind = cntrl->bindings.stick;
+        unsigned int changed = 0;
+
+        /* a key moves the stick by axis_max_val, so that the modifiers count as a change too */
+        for( i = 0; i < cntrl->bindings.num_stick_keys; i++, bind++ )
         {
-            // from the N64 func ref: The 3D Stick data is of type signed char and in
-            // the range between 80 and -80. (32768 / 409 = ~80.1)
-            if( b == 0 )
-                axis_val = controller[c].buttons.X_AXIS;
-            else
-                axis_val = -controller[c].buttons.Y_AXIS;
-
-            if( controller[c].axis[b].key_a != SDL_SCANCODE_UNKNOWN && ((int) controller[c].axis[b].key_a) > 0)
-                if( keystate[controller[c].axis[b].key_a] )
-                    axis_val = -axis_max_val;
-            if( controller[c].axis[b].key_b != SDL_SCANCODE_UNKNOWN && ((int) controller[c].axis[b].key_b) > 0)
-                if( keystate[controller[c].axis[b].key_b] )
-                    axis_val = axis_max_val;
-
-            if( b == 0 )
-                controller[c].buttons.X_AXIS = axis_val;
-            else
-                controller[c].buttons.Y_AXIS = -axis_val;
+            Sint32 value = key_down(inst, keystate, bind->index) ? axis_max_val : 0;
+            changed |= value ^ cntrl->stick_value[i];
+            cntrl->stick_value[i] = value;
         }
-        if (controller[c].mouse)
+        if (changed)
+            cntrl->generation++;
+
+        if (cntrl->mouse)
         {
-            if (keystate[SDL_SCANCODE_LCTRL] && keystate[SDL_SCANCODE_LALT])
+            if (key_down(inst, keystate, SDL_SCANCODE_LCTRL) && key_down(inst, keystate, SDL_SCANCODE_LALT))
             {
-                if (!grabtoggled)
+                if (!inst->runtime.grab_toggled)
                 {
-                    grabtoggled = 1;
-                    grabmouse = !grabmouse;
-                    // grab/ungrab mouse
-#if SDL_VERSION_ATLEAST(2,0,0)
-                    SDL_SetRelativeMouseMode(grabmouse ? SDL_TRUE : SDL_FALSE);
-#else
-                    SDL_WM_GrabInput( grabmouse ? SDL_GRAB_ON : SDL_GRAB_OFF );
-#endif
-                    SDL_ShowCursor( grabmouse ? 0 : 1 );
+                    inst->runtime.grab_toggled = 1;
+                    grab_mouse(inst, !inst->runtime.grab_mouse);
                 }
             }
-            else grabtoggled = 0;
+            else inst->runtime.grab_toggled = 0;
         }
     }
 }
 
-static unsigned char DataCRC( unsigned char *Data, int iLenght )
+/* CRC-8 with polynomial 0x85 (MSB first, initial value 0) used for controller pak data, one entry per byte value */
+static const unsigned char crc_table[256] = {
+    0x00, 0x85, 0x8F, 0x0A, 0x9B, 0x1E, 0x14, 0x91, 0xB3, 0x36, 0x3C, 0xB9, 0x28, 0xAD, 0xA7, 0x22,
+    0xE3, 0x66, 0x6C, 0xE9, 0x78, 0xFD, 0xF7, 0x72, 0x50, 0xD5, 0xDF, 0x5A, 0xCB, 0x4E, 0x44, 0xC1,
+    0x43, 0xC6, 0xCC, 0x49, 0xD8, 0x5D, 0x57, 0xD2, 0xF0, 0x75, 0x7F, 0xFA, 0x6B, 0xEE, 0xE4, 0x61,
+    0xA0, 0x25, 0x2F, 0xAA, 0x3B, 0xBE, 0xB4, 0x31, 0x13, 0x96, 0x9C, 0x19, 0x88, 0x0D, 0x07, 0x82,
+    0x86, 0x03, 0x09, 0x8C, 0x1D, 0x98, 0x92, 0x17, 0x35, 0xB0, 0xBA, 0x3F, 0xAE, 0x2B, 0x21, 0xA4,
+    0x65, 0xE0, 0xEA, 0x6F, 0xFE, 0x7B, 0x71, 0xF4, 0xD6, 0x53, 0x59, 0xDC, 0x4D, 0xC8, 0xC2, 0x47,
+    0xC5, 0x40, 0x4A, 0xCF, 0x5E, 0xDB, 0xD1, 0x54, 0x76, 0xF3, 0xF9, 0x7C, 0xED, 0x68, 0x62, 0xE7,
+    0x26, 0xA3, 0xA9, 0x2C, 0xBD, 0x38, 0x32, 0xB7, 0x95, 0x10, 0x1A, 0x9F, 0x0E, 0x8B, 0x81, 0x04,
+    0x89, 0x0C, 0x06, 0x83, 0x12, 0x97, 0x9D, 0x18, 0x3A, 0xBF, 0xB5, 0x30, 0xA1, 0x24, 0x2E, 0xAB,
+    0x6A, 0xEF, 0xE5, 0x60, 0xF1, 0x74, 0x7E, 0xFB, 0xD9, 0x5C, 0x56, 0xD3, 0x42, 0xC7, 0xCD, 0x48,
+    0xCA, 0x4F, 0x45, 0xC0, 0x51, 0xD4, 0xDE, 0x5B, 0x79, 0xFC, 0xF6, 0x73, 0xE2, 0x67, 0x6D, 0xE8,
+    0x29, 0xAC, 0xA6, 0x23, 0xB2, 0x37, 0x3D, 0xB8, 0x9A, 0x1F, 0x15, 0x90, 0x01, 0x84, 0x8E, 0x0B,
+    0x0F, 0x8A, 0x80, 0x05, 0x94, 0x11, 0x1B, 0x9E, 0xBC, 0x39, 0x33, 0xB6, 0x27, 0xA2, 0xA8, 0x2D,
+    0xEC, 0x69, 0x63, 0xE6, 0x77, 0xF2, 0xF8, 0x7D, 0x5F, 0xDA, 0xD0, 0x55, 0xC4, 0x41, 0x4B, 0xCE,
+    0x4C, 0xC9, 0xC3, 0x46, 0xD7, 0x52, 0x58, 0xDD, 0xFF, 0x7A, 0x70, 0xF5, 0x64, 0xE1, 0xEB, 0x6E,
+    0xAF, 0x2A, 0x20, 0xA5, 0x34, 0xB1, 0xBB, 0x3E, 0x1C, 0x99, 0x93, 0x16, 0x87, 0x02, 0x08, 0x8D
+};
+
+static unsigned char DataCRC( const unsigned char *Data, int iLength )
 {
-    unsigned char Remainder = Data[0];
+    unsigned char Remainder = 0;
+    int iByte;
 
-    int iByte = 1;
-    unsigned char bBit = 0;
+    for (iByte = 0; iByte < iLength; iByte++)
+        Remainder = crc_table[Remainder ^ Data[iByte]];
 
-    while( iByte <= iLenght )
-    {
-        int HighBit = ((Remainder & 0x80) != 0);
-        Remainder = Remainder << 1;
+    return Remainder;
+}
 
-        Remainder += ( iByte < iLenght && Data[iByte] & (0x80 >> bBit )) ? 1 : 0;
+/* answers for a RawData port, written straight into the pif command buffer */
+static void WriteStatus(SPluginInstance *inst, int Control, unsigned char *Command)
+{
+    Command[3] = 0x05;  // standard controller
+    Command[4] = 0x00;
+    Command[5] = (inst->controller[Control].control->Plugin == PLUGIN_NONE) ? 0x02 : 0x01;
+}
 
-        Remainder ^= (HighBit) ? 0x85 : 0;
+static void WriteKeys(SPluginInstance *inst, int Control, unsigned char *Command)
+{
+    BUTTONS Keys;
 
-        bBit++;
-        iByte += bBit/8;
-        bBit %= 8;
-    }
+    /* the devices have been sampled for the whole pif pass by ProcessPendingCommands() */
+    evaluate_port(inst, Control, &Keys);
 
-    return Remainder;
+    Command[3] = (unsigned char) (Keys.Value & 0xFF);
+    Command[4] = (unsigned char) ((Keys.Value >> 8) & 0x3F);   // bits 14/15 are our pak switches, not N64 buttons
+    Command[5] = (unsigned char) Keys.X_AXIS;
+    Command[6] = (unsigned char) Keys.Y_AXIS;
 }
 
-/******************************************************************
-  Function: ControllerCommand
-  Purpose:  To process the raw data that has just been sent to a
-            specific controller.
-  input:    - Controller Number (0 to 3) and -1 signalling end of
-              processing the pif ram.
-            - Pointer of data to be processed.
-  output:   none
-
-  note:     This function is only needed if the DLL is allowing raw
-            data, or the plugin is set to raw
-
-            the data that is being processed looks like this:
-            initilize controller: 01 03 00 FF FF FF
-            read controller:      01 04 01 FF FF FF FF
-*******************************************************************/
-EXPORT void CALL ControllerCommand(int Control, unsigned char *Command)
+static void ProcessCommand(SPluginInstance *inst, int Control, unsigned char *Command)
 {
     unsigned char *Data = &Command[5];
+    int log_input = log_ring_input_enabled();
 
-    if (Control == -1)
+    if (PROBE_ENABLED(controller_command))
+        PROBE3(controller_command, Control, Command[2],
+               Command[2] == RD_READPAK || Command[2] == RD_WRITEPAK ? (Command[3] << 8) + (Command[4] & 0xE0) : 0);
+
+    if (inst->controller[Control].control->RawData && !inst->controller[Control].control->Present)
+    {
+        Command[1] |= 0x80;     // nothing answers on this channel
         return;
+    }
 
     switch (Command[2])
     {
         case RD_GETSTATUS:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Get status");
-#endif
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Get status");
+            if (inst->controller[Control].control->RawData)
+                WriteStatus(inst, Control, Command);
             break;
         case RD_READKEYS:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Read keys");
-#endif
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Read keys");
+            if (inst->controller[Control].control->RawData)
+                WriteKeys(inst, Control, Command);
             break;
         case RD_READPAK:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Read pak");
-#endif
-            if (controller[Control].control->Plugin == PLUGIN_RAW)
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Read pak");
+            if (inst->controller[Control].control->Plugin == PLUGIN_RAW)
             {
                 unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
 
@@ -441,68 +594,138 @@ EXPORT void CALL ControllerCommand(int Control, unsigned char *Command)
 
                 Data[32] = DataCRC( Data, 32 );
             }
+            else if (inst->headless && inst->controller[Control].control->RawData)
+            {
+                /* the pak files belong to the default instance; other instances see an empty pak */
+                memset( Data, 0x00, 32 );
+                Data[32] = DataCRC( Data, 32 );
+            }
+            else if (inst->controller[Control].control->Plugin == PLUGIN_MEMPAK && inst->controller[Control].control->RawData)
+            {
+                unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
+
+                mempak_read(Control, dwAddress, Data);
+                Data[32] = DataCRC( Data, 32 );
+            }
+            else if (inst->controller[Control].control->Plugin == PLUGIN_TRANSFER_PAK && inst->controller[Control].control->RawData)
+            {
+                unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
+
+                tpak_read(Control, dwAddress, Data);
+                Data[32] = DataCRC( Data, 32 );
+            }
             break;
         case RD_WRITEPAK:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Write pak");
-#endif
-            if (controller[Control].control->Plugin == PLUGIN_RAW)
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Write pak");
+            if (inst->controller[Control].control->Plugin == PLUGIN_RAW)
             {
                 unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
-              if (dwAddress == PAK_IO_RUMBLE && *Data)
+                if (dwAddress == PAK_IO_RUMBLE && *Data)
                     DebugMessage(M64MSG_VERBOSE, "Triggering rumble pack.");
-#if SDL_VERSION_ATLEAST(2,0,0)
-                if(dwAddress == PAK_IO_RUMBLE && controller[Control].event_joystick) {
-                    if (*Data) {
-                        SDL_HapticRumblePlay(controller[Control].event_joystick, 1, SDL_HAPTIC_INFINITY);
-                    } else {
-                        SDL_HapticRumbleStop(controller[Control].event_joystick);
-                    }
-                }
-#elif __linux__
-                struct input_event play;
-                if( dwAddress == PAK_IO_RUMBLE && controller[Control].event_joystick != 0)
-                {
-                    if( *Data )
-                    {
-                        play.type = EV_FF;
-                        play.code = ffeffect[Control].id;
-                        play.value = 1;
-
-                        if (write(controller[Control].event_joystick, (const void*) &play, sizeof(play)) == -1)
-                            perror("Error starting rumble effect");
-
-                    }
-                    else
-                    {
-                        play.type = EV_FF;
-                        play.code = ffeffect[Control].id;
-                        play.value = 0;
-
-                        if (write(controller[Control].event_joystick, (const void*) &play, sizeof(play)) == -1)
-                            perror("Error stopping rumble effect");
-                    }
-                }
-#endif //__linux__
+                if (dwAddress == PAK_IO_RUMBLE && inst->controller[Control].event_joystick)
+                    rumble_set(Control, *Data);
+                Data[32] = DataCRC( Data, 32 );
+            }
+            else if (inst->headless && inst->controller[Control].control->RawData)
+            {
+                Data[32] = DataCRC( Data, 32 );
+            }
+            else if (inst->controller[Control].control->Plugin == PLUGIN_MEMPAK && inst->controller[Control].control->RawData)
+            {
+                unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
+
+                mempak_write(Control, dwAddress, Data);
+                Data[32] = DataCRC( Data, 32 );
+            }
+            else if (inst->controller[Control].control->Plugin == PLUGIN_TRANSFER_PAK && inst->controller[Control].control->RawData)
+            {
+                unsigned int dwAddress = (Command[3] << 8) + (Command[4] & 0xE0);
+
+                tpak_write(Control, dwAddress, Data);
                 Data[32] = DataCRC( Data, 32 );
             }
             break;
         case RD_RESETCONTROLLER:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Reset controller");
-#endif
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Reset controller");
+            if (inst->controller[Control].control->RawData)
+                WriteStatus(inst, Control, Command);
             break;
         case RD_READEEPROM:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Read eeprom");
-#endif
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Read eeprom");
             break;
         case RD_WRITEEPROM:
-#ifdef _DEBUG
-            DebugMessage(M64MSG_INFO, "Write eeprom");
-#endif
+            if (log_input)
+                DebugMessage(M64MSG_INFO, "Write eeprom");
             break;
         }
+
+    if (Command[2] == RD_READPAK || Command[2] == RD_WRITEPAK)
+        input_hash_command(&inst->hash, Control, Command);
+}
+
+/* runs the commands queued for the RawData ports during this pass.  the devices are sampled and the
+ * rumble worker is woken at most once for all four ports */
+static void ProcessPendingCommands(SPluginInstance *inst)
+{
+    int i, sampled = 0;
+
+    if (!inst->headless)
+        rumble_begin_batch();
+    for (i = 0; i < 4; i++)
+    {
+        if (inst->pending_command[i] == NULL)
+            continue;
+        if (!sampled && inst->pending_command[i][2] == RD_READKEYS)
+        {
+            sample_devices(inst);
+            sampled = 1;
+        }
+        ProcessCommand(inst, i, inst->pending_command[i]);
+        inst->pending_command[i] = NULL;
+    }
+    if (!inst->headless)
+        rumble_end_batch();
+}
+
+/******************************************************************
+  Function: ControllerCommand
+  Purpose:  To process the raw data that has just been sent to a
+            specific controller.
+  input:    - Controller Number (0 to 3) and -1 signalling end of
+              processing the pif ram.
+            - Pointer of data to be processed.
+  output:   none
+
+  note:     This function is only needed if the DLL is allowing raw
+            data, or the plugin is set to raw
+
+            the data that is being processed looks like this:
+            initilize controller: 01 03 00 FF FF FF
+            read controller:      01 04 01 FF FF FF FF
+*******************************************************************/
+EXPORT void CALL ControllerCommand(int Control, unsigned char *Command)
+{
+    SPluginInstance *inst = current_instance();
+
+    if (Control == -1)
+    {
+        ProcessPendingCommands(inst);
+        return;
+    }
+
+    /* commands for RawData ports are answered at the end of the pass; the pif ram isn't read before that */
+    if (inst->controller[Control].control->RawData)
+    {
+        if (inst->pending_command[Control] != NULL)
+            ProcessPendingCommands(inst);
+        inst->pending_command[Control] = Command;
+        return;
+    }
+
+    ProcessCommand(inst, Control, Command);
 }
 
 /******************************************************************
@@ -515,136 +738,678 @@ EXPORT void CALL ControllerCommand(int Control, unsigned char *Command)
 *******************************************************************/
 EXPORT void CALL GetKeys( int Control, BUTTONS *Keys )
 {
-    static int mousex_residual = 0;
-    static int mousey_residual = 0;
-    int b, axis_val;
-    SDL_Event event;
-    unsigned char mstate;
-
-    SDL_PumpEvents();
+    SPluginInstance *inst = current_instance();
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    PROBE1(getkeys_entry, Control);
+    /* the devices are sampled once per frame, which starts at a port lower than or equal to the last one (as in
+     * input_hash.c); the later ports of the frame are built from the same sample */
+    if (Control <= inst->last_port)
+        sample_devices(inst);
+    inst->last_port = Control;
+    evaluate_port(inst, Control, Keys);
+    input_stats_latency(&inst->stats, start);
+    if (PROBE_ENABLED(getkeys_exit))
+        PROBE3(getkeys_exit, Control, Keys->Value, probe_duration_ns(start));
+    trace_span("GetKeys", start, Control);
+}
 
-    // Handle keyboard input first
-    doSdlKeys(SDL_GetKeyboardState(NULL));
-    doSdlKeys(myKeyState);
+/******************************************************************
+  Function: GetAllKeys
+  Purpose:  To get the current state of all 4 controllers with a
+            single sample of the input devices.
+  input:    - A pointer to an array of 4 BUTTONS structures to be
+            filled with the controller states.
+  output:   none
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT void CALL GetAllKeys( BUTTONS *Keys )
+{
+    SPluginInstance *inst = current_instance();
+    Uint64 start = SDL_GetPerformanceCounter();
+    int i;
 
-    for ( b = 0; b < 4; ++b )
+    PROBE1(getkeys_entry, -1);
+    sample_devices(inst);
+    for (i = 0; i < 4; i++)
     {
-        if (controller[b].device >= 0)
-        {
-#if SDL_VERSION_ATLEAST(2,0,0)
-            if (!SDL_JoystickGetAttached(controller[b].joystick))
-#else
-            if (!SDL_JoystickOpened(controller[b].device))
-#endif
-                controller[b].joystick = SDL_JoystickOpen(controller[b].device);
-        }
+        evaluate_port(inst, i, &Keys[i]);
+        if (PROBE_ENABLED(getkeys_exit))
+            PROBE3(getkeys_exit, i, Keys[i].Value, probe_duration_ns(start));
     }
+    inst->last_port = 4;    // the next GetKeys() starts a new frame
+    input_stats_latency(&inst->stats, start);
+    trace_span("GetAllKeys", start, -1);
+}
 
-    // read joystick state
-    SDL_JoystickUpdate();
+/******************************************************************
+  Function: GetInputServerStatus
+  Purpose:  To get the statistics of the unix domain socket input
+            server.
+  input:    - A pointer to an input_server_status structure whose
+            size member has been set by the caller.
+  output:   M64ERR_INPUT_INVALID if the structure has the wrong
+            size
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL GetInputServerStatus( input_server_status *Status )
+{
+    if (Status == NULL || Status->size != sizeof(input_server_status))
+        return M64ERR_INPUT_INVALID;
 
-    if( controller[Control].device >= 0 )
-    {
-        for( b = 0; b < 16; b++ )
-        {
-            if( controller[Control].button[b].button >= 0 )
-                if( SDL_JoystickGetButton( controller[Control].joystick, controller[Control].button[b].button ) )
-                    controller[Control].buttons.Value |= button_bits[b];
+    input_server_get_status(Status);
+    return M64ERR_SUCCESS;
+}
 
-            if( controller[Control].button[b].axis >= 0 )
-            {
-                int deadzone = controller[Control].button[b].axis_deadzone;
-                axis_val = SDL_JoystickGetAxis( controller[Control].joystick, controller[Control].button[b].axis );
-                if (deadzone < 0)
-                    deadzone = 16384; /* default */
-                if( (controller[Control].button[b].axis_dir < 0) && (axis_val <= -deadzone) )
-                    controller[Control].buttons.Value |= button_bits[b];
-                else if( (controller[Control].button[b].axis_dir > 0) && (axis_val >= deadzone) )
-                    controller[Control].buttons.Value |= button_bits[b];
-            }
+/******************************************************************
+  Function: InputHistoryGet
+  Purpose:  To get the confirmed or predicted state of a controller
+            for a frame of the input history (rollback netplay).
+  input:    - Controller Number (0 to 3)
+            - Frame number
+            - A pointer to a BUTTONS structure to be filled with
+            the controller state.
+  output:   M64ERR_INPUT_INVALID if the frame isn't in the history
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL InputHistoryGet( int Control, unsigned int Frame, BUTTONS *Keys )
+{
+    if (Control < 0 || Control > 3)
+        return M64ERR_INPUT_INVALID;
+    return input_history_get(&current_instance()->controller[Control].history, Frame, Keys);
+}
 
-            if( controller[Control].button[b].hat >= 0 )
-            {
-                if( controller[Control].button[b].hat_pos > 0 )
-                    if( SDL_JoystickGetHat( controller[Control].joystick, controller[Control].button[b].hat ) & controller[Control].button[b].hat_pos )
-                        controller[Control].buttons.Value |= button_bits[b];
-            }
-        }
-        int iX = controller[Control].buttons.X_AXIS;
-        int iY = controller[Control].buttons.Y_AXIS;
-        for( b = 0; b < 2; b++ )
-        {
-            /* from the N64 func ref: The 3D Stick data is of type signed char and in the range between -80 and +80 */
-            int deadzone = controller[Control].axis_deadzone[b];
-            int range = controller[Control].axis_peak[b] - controller[Control].axis_deadzone[b];
-            /* skip this axis if the deadzone/peak values are invalid */
-            if (deadzone < 0 || range < 1)
-                continue;
-
-            if( b == 0 )
-                axis_val = iX;
-            else
-                axis_val = -iY;
-
-            if( controller[Control].axis[b].axis_a >= 0 )  /* up and left for N64 */
-            {
-                int joy_val = SDL_JoystickGetAxis(controller[Control].joystick, controller[Control].axis[b].axis_a);
-                int axis_dir = controller[Control].axis[b].axis_dir_a;
-                if (joy_val * axis_dir > deadzone)
-                    axis_val = -((abs(joy_val) - deadzone) * 80 / range);
-            }
-            if( controller[Control].axis[b].axis_b >= 0 ) /* down and right for N64 */
-            {
-                int joy_val = SDL_JoystickGetAxis(controller[Control].joystick, controller[Control].axis[b].axis_b);
-                int axis_dir = controller[Control].axis[b].axis_dir_b;
-                if (joy_val * axis_dir > deadzone)
-                    axis_val = ((abs(joy_val) - deadzone) * 80 / range);
-            }
-            if( controller[Control].axis[b].hat >= 0 )
-            {
-                if( controller[Control].axis[b].hat_pos_a >= 0 )
-                    if( SDL_JoystickGetHat( controller[Control].joystick, controller[Control].axis[b].hat ) & controller[Control].axis[b].hat_pos_a )
-                        axis_val = -80;
-                if( controller[Control].axis[b].hat_pos_b >= 0 )
-                    if( SDL_JoystickGetHat( controller[Control].joystick, controller[Control].axis[b].hat ) & controller[Control].axis[b].hat_pos_b )
-                        axis_val = 80;
-            }
+/******************************************************************
+  Function: InputHistoryConfirm
+  Purpose:  To store (or revise) the real state of a controller for
+            a frame of the input history.
+  input:    - Controller Number (0 to 3)
+            - Frame number
+            - The controller state
+  output:   M64ERR_INPUT_INVALID if the frame isn't in the history
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL InputHistoryConfirm( int Control, unsigned int Frame, BUTTONS Keys )
+{
+    if (Control < 0 || Control > 3)
+        return M64ERR_INPUT_INVALID;
+    return input_history_confirm(&current_instance()->controller[Control].history, Frame, Keys.Value);
+}
 
-            if( controller[Control].axis[b].button_a >= 0 )
-                if( SDL_JoystickGetButton( controller[Control].joystick, controller[Control].axis[b].button_a ) )
-                    axis_val = -80;
-            if( controller[Control].axis[b].button_b >= 0 )
-                if( SDL_JoystickGetButton( controller[Control].joystick, controller[Control].axis[b].button_b ) )
-                    axis_val = 80;
-
-            if( b == 0 )
-                iX = axis_val;
-            else
-                iY = -axis_val;
-        }
-        /* store the result */
-        if (iX < -80) iX = -80;
-        if (iX >  80) iX =  80;
-        if (iY < -80) iY = -80;
-        if (iY >  80) iY =  80;
-        controller[Control].buttons.X_AXIS = iX;
-        controller[Control].buttons.Y_AXIS = iY;
-    }
+/******************************************************************
+  Function: InputHistoryMispredicted
+  Purpose:  To find the oldest frame whose confirmed state differs
+            from the one returned by InputHistoryGet().
+  input:    - Controller Number (0 to 3)
+            - A pointer which receives the frame number
+  output:   1 if there was a misprediction since the last call,
+            otherwise 0
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT int CALL InputHistoryMispredicted( int Control, unsigned int *Frame )
+{
+    if (Control < 0 || Control > 3)
+        return 0;
+    return input_history_mispredicted(&current_instance()->controller[Control].history, Frame);
+}
+
+/******************************************************************
+  Function: InputHistoryReset
+  Purpose:  To clear the input history of a controller.
+  input:    - Controller Number (0 to 3), or -1 for all of them
+  output:   none
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT void CALL InputHistoryReset( int Control )
+{
+    SPluginInstance *inst = current_instance();
+    int i;
 
-    // process mouse events
-    mstate = SDL_GetMouseState( NULL, NULL );
-    for( b = 0; b < 16; b++ )
+    for (i = 0; i < 4; i++)
     {
-        if( controller[Control].button[b].mouse < 1 )
-            continue;
-        if( mstate & SDL_BUTTON(controller[Control].button[b].mouse) )
-            controller[Control].buttons.Value |= button_bits[b];
+        if (Control == -1 || Control == i)
+            input_history_reset(&inst->controller[i].history);
     }
+}
 
-    if (controller[Control].mouse)
-    {
-#if SDL_VERSION_ATLEAST(2,0,0)
-        if (SDL_GetRelativeMouseMode())
+/******************************************************************
+  Function: InputSaveState
+  Purpose:  To save the runtime state of the plugin (paks, pak
+            switches, rumble, mouse) into a buffer.
+  input:    - A pointer to the buffer
+            - Size of the buffer, at least INPUT_STATE_SIZE bytes
+  output:   M64ERR_INPUT_INVALID if the buffer is too small
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL InputSaveState( void *Buffer, unsigned int Size )
+{
+    SPluginInstance *inst = current_instance();
+    Uint32 state[INPUT_STATE_SIZE / 4];
+    unsigned int now = SDL_GetTicks();
+    int i;
+
+    if (Buffer == NULL || Size < INPUT_STATE_SIZE)
+        return M64ERR_INPUT_INVALID;
+
+    memset(state, 0, sizeof(state));
+    state[STATE_WORD_MAGIC] = STATE_MAGIC;
+    state[STATE_WORD_VERSION] = STATE_VERSION;
+    for (i = 0; i < 4; i++)
+    {
+        /* pak switches are stored as the time which has passed since, plus 1 (0: no switch) */
+        if (inst->runtime.switch_pack_time[i] != 0)
+            state[STATE_WORD_SWITCH_ELAPSED + i] = now - inst->runtime.switch_pack_time[i] + 1;
+        state[STATE_WORD_SWITCH_TYPE + i] = inst->runtime.switch_pack_type[i];
+        state[STATE_WORD_PLUGIN + i] = inst->controller[i].control->Plugin;
+        state[STATE_WORD_RUMBLE + i] = inst->headless ? 0 : rumble_get(i);
+    }
+    state[STATE_WORD_MOUSE] = inst->runtime.mouse_residual[0];
+    state[STATE_WORD_MOUSE + 1] = inst->runtime.mouse_residual[1];
+    state[STATE_WORD_GRAB] = (inst->runtime.grab_mouse ? 1 : 0) | (inst->runtime.grab_toggled ? 2 : 0);
+
+    memcpy(Buffer, state, INPUT_STATE_SIZE);
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: InputLoadState
+  Purpose:  To restore the runtime state of the plugin from a
+            buffer written by InputSaveState().
+  input:    - A pointer to the buffer
+            - Size of the buffer, at least INPUT_STATE_SIZE bytes
+  output:   M64ERR_INPUT_INVALID if the buffer is too small or
+            doesn't hold a compatible state
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL InputLoadState( const void *Buffer, unsigned int Size )
+{
+    SPluginInstance *inst = current_instance();
+    Uint32 state[INPUT_STATE_SIZE / 4];
+    unsigned int now = SDL_GetTicks();
+    int i, grab;
+
+    if (Buffer == NULL || Size < INPUT_STATE_SIZE)
+        return M64ERR_INPUT_INVALID;
+
+    memcpy(state, Buffer, INPUT_STATE_SIZE);
+    if (state[STATE_WORD_MAGIC] != STATE_MAGIC || state[STATE_WORD_VERSION] != STATE_VERSION)
+        return M64ERR_INPUT_INVALID;
+
+    /* nothing is changed if a pak type is invalid; the switch type is 0 while no pak switch is pending */
+    for (i = 0; i < 4; i++)
+    {
+        if (!valid_pak_type(state[STATE_WORD_PLUGIN + i]) ||
+            (state[STATE_WORD_SWITCH_TYPE + i] != 0 && !valid_pak_type(state[STATE_WORD_SWITCH_TYPE + i])))
+            return M64ERR_INPUT_INVALID;
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        inst->runtime.switch_pack_time[i] = 0;
+        if (state[STATE_WORD_SWITCH_ELAPSED + i] != 0)
+        {
+            inst->runtime.switch_pack_time[i] = now - (state[STATE_WORD_SWITCH_ELAPSED + i] - 1);
+            if (inst->runtime.switch_pack_time[i] == 0)
+                inst->runtime.switch_pack_time[i] = 1;
+        }
+        inst->runtime.switch_pack_type[i] = state[STATE_WORD_SWITCH_TYPE + i];
+        inst->controller[i].control->Plugin = state[STATE_WORD_PLUGIN + i];
+        if (!inst->headless)
+            rumble_set(i, state[STATE_WORD_RUMBLE + i]);
+    }
+    inst->runtime.mouse_residual[0] = (int) state[STATE_WORD_MOUSE];
+    inst->runtime.mouse_residual[1] = (int) state[STATE_WORD_MOUSE + 1];
+    inst->runtime.grab_toggled = (state[STATE_WORD_GRAB] & 2) != 0;
+    grab = (state[STATE_WORD_GRAB] & 1) != 0;
+    if (grab != inst->runtime.grab_mouse && inst->romopen && !inst->headless)
+        grab_mouse(inst, grab);
+    inst->runtime.grab_mouse = grab;
+
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: SetInputDelay
+  Purpose:  To change the number of frames by which the input of a
+            controller is delayed.
+  input:    - Controller Number (0 to 3), or -1 for all of them
+            - Number of frames (0 to INPUT_DELAY_MAX)
+  output:   M64ERR_INPUT_INVALID if an argument is out of range
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL SetInputDelay( int Control, int Frames )
+{
+    SPluginInstance *inst = current_instance();
+    int i;
+
+    if (Control < -1 || Control > 3 || Frames < 0 || Frames > INPUT_DELAY_MAX)
+        return M64ERR_INPUT_INVALID;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (Control == -1 || Control == i)
+            input_delay_set(&inst->controller[i].delay, Frames);
+    }
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: GetInputDelayStats
+  Purpose:  To get the input delay counters and histograms of a
+            controller.
+  input:    - Controller Number (0 to 3)
+            - A pointer to an input_delay_stats structure whose
+            size member has been set by the caller.
+  output:   M64ERR_INPUT_INVALID if an argument is invalid
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL GetInputDelayStats( int Control, input_delay_stats *Stats )
+{
+    if (Control < 0 || Control > 3 || Stats == NULL || Stats->size != sizeof(input_delay_stats))
+        return M64ERR_INPUT_INVALID;
+
+    input_delay_get_stats(&current_instance()->controller[Control].delay, Stats);
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: GetInputSamplerStats
+  Purpose:  To get the counters of the sampler thread and the
+            histogram of the age of the joystick state.
+  input:    - A pointer to an input_sampler_stats structure whose
+            size member has been set by the caller.
+  output:   M64ERR_INPUT_INVALID if the structure has the wrong
+            size
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL GetInputSamplerStats( input_sampler_stats *Stats )
+{
+    if (Stats == NULL || Stats->size != sizeof(input_sampler_stats))
+        return M64ERR_INPUT_INVALID;
+
+    input_sampler_get_stats(Stats);
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: GetInputStats
+  Purpose:  To get the counters of the polls of the calling
+            thread's instance and of the device, rumble and
+            configuration work since the last ResetInputStats().
+  input:    - A pointer to an input_stats structure whose size
+            member has been set by the caller.
+  output:   M64ERR_INPUT_INVALID if the structure has the wrong
+            size
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL GetInputStats( input_stats *Stats )
+{
+    SPluginInstance *inst = current_instance();
+
+    if (Stats == NULL || Stats->size != sizeof(input_stats))
+        return M64ERR_INPUT_INVALID;
+
+    input_stats_get(&inst->stats, &inst->stats_base, Stats);
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: ResetInputStats
+  Purpose:  To start the counters of GetInputStats() over.
+  input:    none
+  output:   none
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT void CALL ResetInputStats( void )
+{
+    SPluginInstance *inst = current_instance();
+
+    input_stats_reset(&inst->stats, &inst->stats_base);
+}
+
+/******************************************************************
+  Function: GetInputHash
+  Purpose:  To get the rolling hash of all controller input since
+            the rom was opened, for desync detection.
+  input:    - A pointer which receives the hash
+            - A pointer which receives the number of frames
+  output:   M64ERR_SUCCESS
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL GetInputHash( uint64_t *Hash, unsigned int *Frames )
+{
+    input_hash_get(&current_instance()->hash, Hash, Frames);
+    return M64ERR_SUCCESS;
+}
+
+/******************************************************************
+  Function: InputInstanceCreate
+  Purpose:  To create a plugin instance for another emulator in the
+            same process.
+  input:    none
+  output:   A handle of the new instance, NULL if out of memory
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_handle CALL InputInstanceCreate( void )
+{
+    /* the instance has members which are aligned to a cache line */
+    SPluginInstance *inst = (SPluginInstance *) osal_aligned_malloc(sizeof(SPluginInstance), CACHE_LINE_SIZE);
+    int i;
+
+    if (inst == NULL)
+        return NULL;
+    memset(inst, 0, sizeof(SPluginInstance));
+
+    inst->id = (int) osal_atomic_fetch_add(&l_NextInstanceId, 1);
+    inst->headless = 1;
+    inst->runtime.grab_mouse = 1;
+    for (i = 0; i < 4; i++)
+    {
+        inst->controller[i].control = inst->control_info + i;
+        inst->controller[i].device = DEVICE_NO_JOYSTICK;
+    }
+
+    return (m64p_handle) inst;
+}
+
+/******************************************************************
+  Function: InputInstanceDestroy
+  Purpose:  To free an instance created by InputInstanceCreate().
+  input:    - The handle of the instance
+  output:   none
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT void CALL InputInstanceDestroy( m64p_handle Instance )
+{
+    SPluginInstance *inst = (SPluginInstance *) Instance;
+
+    if (inst == NULL || inst == &default_instance)
+        return;
+    if (l_BoundInstance == inst)
+    {
+        osal_atomic_fetch_add(&inst->bound_threads, (unsigned int) -1);
+        l_BoundInstance = NULL;
+    }
+    /* freeing it would leave the other threads with a dangling instance; it is leaked instead */
+    if (osal_atomic_load(&inst->bound_threads) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "InputInstanceDestroy(): instance %i is still bound to %u other thread(s), not destroyed",
+                     inst->id, osal_atomic_load(&inst->bound_threads));
+        return;
+    }
+    osal_aligned_free(inst);
+}
+
+/******************************************************************
+  Function: InputInstanceBind
+  Purpose:  To select the instance which the plugin functions called
+            from this thread work on.
+  input:    - The handle of the instance, or NULL for the default
+            instance
+  output:   M64ERR_SUCCESS
+  note:     This is an extension of the input plugin API, see
+            input_ext.h
+*******************************************************************/
+EXPORT m64p_error CALL InputInstanceBind( m64p_handle Instance )
+{
+    SPluginInstance *inst = (SPluginInstance *) Instance;
+
+    if (inst == &default_instance)
+        inst = NULL;
+    if (inst == l_BoundInstance)
+        return M64ERR_SUCCESS;
+    if (inst != NULL)
+        osal_atomic_fetch_add(&inst->bound_threads, 1);
+    if (l_BoundInstance != NULL)
+        osal_atomic_fetch_add(&l_BoundInstance->bound_threads, (unsigned int) -1);
+    l_BoundInstance = inst;
+    return M64ERR_SUCCESS;
+}
+
+/* reads the joystick inputs of all ports, after the joysticks which were unplugged are reattached.  called by the
+ * emulation thread, or by the sampler thread while it runs */
+static void read_joysticks(SPluginInstance *inst, SJoystickSample *sample)
+{
+    const SButtonProgram *prog = &inst->button_prog;
+    unsigned int i, end;
+    int c;
+
+    for ( c = 0; c < 4; ++c )
+    {
+        if (inst->controller[c].device >= 0)
+        {
+#if SDL_VERSION_ATLEAST(2,0,0)
+            if (!SDL_JoystickGetAttached(inst->controller[c].joystick))
+#else
+            if (!SDL_JoystickOpened(inst->controller[c].device))
+#endif
+            {
+                Uint64 start = trace_now();
+
+                inst->controller[c].joystick = SDL_JoystickOpen(inst->controller[c].device);
+                trace_span("SDL_JoystickOpen (hotplug)", start, c);
+                if (inst->controller[c].joystick != NULL)
+                    input_stats_bump(&input_counters[COUNTER_HOTPLUG]);
+                PROBE3(hotplug, c, inst->controller[c].device, inst->controller[c].joystick != NULL);
+            }
+        }
+    }
+
+    // read joystick state
+    input_stats_bump(&input_counters[COUNTER_DEVICE_READS]);
+    sample->time = SDL_GetPerformanceCounter();
+    SDL_JoystickUpdate();
+
+    for( c = 0; c < 4; c++ )
+    {
+        SController *cntrl = &inst->controller[c];
+        SDL_Joystick *joystick = cntrl->joystick;
+        const unsigned int *type_end = prog->type_end[c];
+        const SBinding *bind;
+
+        i = type_end[BIND_KEY];
+        for( end = type_end[BIND_JOY_BUTTON]; i < end; i++ )
+            sample->button[i] = SDL_JoystickGetButton( joystick, prog->source[i].index );
+        for( end = type_end[BIND_JOY_AXIS_POS]; i < end; i++ )
+            sample->button[i] = SDL_JoystickGetAxis( joystick, prog->source[i].index );
+        for( end = type_end[BIND_JOY_HAT]; i < end; i++ )
+            sample->button[i] = SDL_JoystickGetHat( joystick, prog->source[i].index );
+
+        bind = cntrl->bindings.stick;
+        for( i = cntrl->bindings.num_stick_keys, end = i + cntrl->bindings.num_stick_joy; i < end; i++ )
+        {
+            switch( bind[i].type )
+            {
+                case BIND_JOY_BUTTON:
+                    sample->stick[c][i] = SDL_JoystickGetButton( joystick, bind[i].index );
+                    break;
+                case BIND_JOY_HAT:
+                    sample->stick[c][i] = SDL_JoystickGetHat( joystick, bind[i].index );
+                    break;
+                case BIND_STICK_AXIS:
+                    sample->stick[c][i] = SDL_JoystickGetAxis( joystick, bind[i].index );
+                    break;
+            }
+        }
+    }
+}
+
+/* the sampler thread: reads the joysticks of the default instance, and hands the sample over */
+static void sample_joysticks(void)
+{
+    read_joysticks(&default_instance, &l_SamplerBuffer);
+
+    input_sampler_lock();
+    l_SamplerBuffer.serial = l_SamplerLatest.serial + 1;
+    memcpy(&l_SamplerLatest, &l_SamplerBuffer, sizeof(SJoystickSample));
+    input_sampler_unlock();
+}
+
+/* reads the keys and mouse buttons bound to the ports, takes the joystick inputs from the sample in inst->joy, and
+ * evaluates the button program.  a port whose inputs changed since the last sample gets a new generation */
+static void sample_bindings(SPluginInstance *inst, const unsigned char *keystate)
+{
+    SButtonProgram *prog = &inst->button_prog;
+    Uint16 pressed[4];
+    unsigned char mstate = 0;
+    unsigned int i, end;
+    int c;
+
+    if (prog->uses_mouse && !inst->headless)
+        mstate = SDL_GetMouseState( NULL, NULL );
+
+    for( c = 0; c < 4; c++ )
+    {
+        const unsigned int *type_end = prog->type_end[c];
+
+        i = prog->start[c];
+        for( end = type_end[BIND_KEY]; i < end; i++ )
+            prog->value[i] = key_down(inst, keystate, prog->source[i].index);
+        if (type_end[BIND_JOY_HAT] > i)
+            memcpy(&prog->value[i], &inst->joy.button[i], (type_end[BIND_JOY_HAT] - i) * sizeof(Sint32));
+        for( i = type_end[BIND_JOY_HAT], end = type_end[BIND_MOUSE]; i < end; i++ )
+            prog->value[i] = mstate;
+    }
+
+    button_eval_run(prog, pressed);
+
+    for( c = 0; c < 4; c++ )
+    {
+        SController *cntrl = &inst->controller[c];
+        unsigned int changed = pressed[c] ^ inst->pressed[c];
+
+        for( i = cntrl->bindings.num_stick_keys, end = i + cntrl->bindings.num_stick_joy; i < end; i++ )
+        {
+            changed |= inst->joy.stick[c][i] ^ cntrl->stick_value[i];
+            cntrl->stick_value[i] = inst->joy.stick[c][i];
+        }
+        inst->pressed[c] = pressed[c];
+        if (changed)
+            cntrl->generation++;
+    }
+}
+
+/* reads the keyboard and the joysticks, or takes the newest sample of the sampler thread, and evaluates the button
+ * inputs; the N64 controller state is then built by evaluate_port() */
+static void sample_devices(SPluginInstance *inst)
+{
+    const unsigned char *keystate;
+    unsigned int key_generation;
+    int b;
+
+    /* headless instances only have the keys from SDL_KeyDown()/SDL_KeyUp(), so if none of them changed, the
+     * last sample still holds */
+    key_generation = osal_atomic_load(&inst->key_generation);
+    if (inst->headless && key_generation == inst->sampled_key_generation)
+        return;
+    inst->sampled_key_generation = key_generation;
+
+    /* one consistent copy of the keys for this sample; a change after the generation was read bumps it again */
+    for (b = 0; b < KEY_STATE_WORDS; b++)
+        inst->keys[b] = osal_atomic_load(&inst->key_bits[b]);
+
+    if (inst->headless)
+    {
+        doSdlKeys(inst, NULL);
+        sample_bindings(inst, NULL);
+        return;
+    }
+
+    SDL_PumpEvents();
+
+    // Handle keyboard input first
+    keystate = SDL_GetKeyboardState(NULL);
+    doSdlKeys(inst, keystate);
+
+    if (input_sampler_running())
+    {
+        input_sampler_lock();
+        if (inst->joy.serial != l_SamplerLatest.serial)
+            memcpy(&inst->joy, &l_SamplerLatest, sizeof(SJoystickSample));
+        input_sampler_unlock();
+    }
+    else
+        read_joysticks(inst, &inst->joy);
+    if (inst->joy.time != 0)
+        input_sampler_record_age(inst->joy.time);
+
+    sample_bindings(inst, keystate);
+}
+
+/* builds the state of a port from the last sample of the local devices: the buttons come from the button program,
+ * the stick from its keys and joystick inputs, where the last active input of an axis wins, or from the mouse */
+static void evaluate_local(SPluginInstance *inst, int Control)
+{
+    SController *cntrl = &inst->controller[Control];
+    const SBinding *bind = cntrl->bindings.stick;
+    const Sint32 *value = cntrl->stick_value;
+    unsigned int i, count = cntrl->bindings.num_stick_keys + cntrl->bindings.num_stick_joy;
+    /* from the N64 func ref: The 3D Stick data is of type signed char and in the range between -80 and +80 */
+    int stick[2] = { 0, 0 };
+    SDL_Event event;
+
+    for( i = 0; i < count; i++, bind++, value++ )
+    {
+        int axis = (bind->target - 16) >> 1;
+        int axis_val = 80;
+        int active = 0;
+
+        switch( bind->type )
+        {
+            case BIND_KEY:
+                /* 0, or the deflection given by the modifier keys */
+                active = (*value != 0);
+                axis_val = *value;
+                break;
+            case BIND_JOY_BUTTON:
+                active = (*value != 0);
+                break;
+            case BIND_JOY_HAT:
+                active = (*value & bind->param) != 0;
+                break;
+            case BIND_STICK_AXIS:
+            {
+                int deadzone = cntrl->bindings.deadzone[axis];
+                active = (*value * bind->param > deadzone);
+                if (active)
+                    axis_val = (abs(*value) - deadzone) * 80 / cntrl->bindings.range[axis];
+                break;
+            }
+        }
+        if( active )
+            stick[axis] = (bind->target & 1) ? axis_val : -axis_val;
+    }
+
+    /* store the result */
+    stick[1] = -stick[1];
+    if (stick[0] < -80) stick[0] = -80;
+    if (stick[0] >  80) stick[0] =  80;
+    if (stick[1] < -80) stick[1] = -80;
+    if (stick[1] >  80) stick[1] =  80;
+    cntrl->local.Value = inst->pressed[Control];
+    cntrl->local.X_AXIS = stick[0];
+    cntrl->local.Y_AXIS = stick[1];
+
+    if (inst->controller[Control].mouse)
+    {
+#if SDL_VERSION_ATLEAST(2,0,0)
+        if (SDL_GetRelativeMouseMode())
 #else
         if (SDL_WM_GrabInput(SDL_GRAB_QUERY) == SDL_GRAB_ON)
 #endif
@@ -662,11 +1427,11 @@ EXPORT void CALL GetKeys( int Control, BUTTONS *Keys )
 
                 if (event.motion.xrel)
                 {
-                    mousex_residual += (int) (event.motion.xrel * controller[Control].mouse_sens[0]);
+                    inst->runtime.mouse_residual[0] += (int) (event.motion.xrel * inst->controller[Control].mouse_sens[0]);
                 }
                 if (event.motion.yrel)
                 {
-                    mousey_residual += (int) (event.motion.yrel * controller[Control].mouse_sens[1]);
+                    inst->runtime.mouse_residual[1] += (int) (event.motion.yrel * inst->controller[Control].mouse_sens[1]);
                 }
 
 #if SDL_VERSION_ATLEAST(2,0,0)
@@ -675,272 +1440,114 @@ EXPORT void CALL GetKeys( int Control, BUTTONS *Keys )
                     SDL_GetWindowSize(focus, &w, &h);
                     SDL_WarpMouseInWindow(focus, w / 2, h / 2);
                 } else {
-                    mousex_residual = 0;
-                    mousey_residual = 0;
+                    inst->runtime.mouse_residual[0] = 0;
+                    inst->runtime.mouse_residual[1] = 0;
                 }
 #endif
             }
 
             /* store the result */
-            int iX = mousex_residual;
-            int iY = -mousey_residual;
+            int iX = inst->runtime.mouse_residual[0];
+            int iY = -inst->runtime.mouse_residual[1];
             if (iX < -80) iX = -80;
             if (iX >  80) iX =  80;
             if (iY < -80) iY = -80;
             if (iY >  80) iY =  80;
-            controller[Control].buttons.X_AXIS = iX;
-            controller[Control].buttons.Y_AXIS = iY;
+            cntrl->local.X_AXIS = iX;
+            cntrl->local.Y_AXIS = iY;
 
             /* the mouse x/y values decay exponentially (returns to center), unless the left "Windows" key is held down */
-            if (!myKeyState[SDL_SCANCODE_LGUI])
+            if (!key_down(inst, NULL, SDL_SCANCODE_LGUI))
             {
-                mousex_residual = (mousex_residual * 224) / 256;
-                mousey_residual = (mousey_residual * 224) / 256;
+                inst->runtime.mouse_residual[0] = (inst->runtime.mouse_residual[0] * 224) / 256;
+                inst->runtime.mouse_residual[1] = (inst->runtime.mouse_residual[1] * 224) / 256;
             }
         }
         else
         {
-            mousex_residual = 0;
-            mousey_residual = 0;
+            inst->runtime.mouse_residual[0] = 0;
+            inst->runtime.mouse_residual[1] = 0;
         }
     }
+}
 
-#ifdef _DEBUG
-    DebugMessage(M64MSG_VERBOSE, "Controller #%d value: 0x%8.8X", Control, *(int *)&controller[Control].buttons );
-#endif
-    *Keys = controller[Control].buttons;
+static void evaluate_port(SPluginInstance *inst, int Control, BUTTONS *Keys)
+{
+    SController *cntrl = &inst->controller[Control];
 
-    /* handle mempack / rumblepak switching (only if rumble is active on joystick) */
-#if SDL_VERSION_ATLEAST(2,0,0)
-    if (controller[Control].event_joystick) {
-        static unsigned int SwitchPackTime[4] = {0, 0, 0, 0}, SwitchPackType[4] = {0, 0, 0, 0};
-        if (controller[Control].buttons.Value & button_bits[14]) {
-            SwitchPackTime[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
-            SwitchPackType[Control] = PLUGIN_MEMPAK;          // type of new pack to insert
-            controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
-            SDL_HapticRumblePlay(controller[Control].event_joystick, 0.5, 500);
-        }
-        if (controller[Control].buttons.Value & button_bits[15]) {
-            SwitchPackTime[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
-            SwitchPackType[Control] = PLUGIN_RAW;             // type of new pack to insert
-            controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
-            SDL_HapticRumblePlay(controller[Control].event_joystick, 1, 500);
-        }
-        // handle inserting new pack if the time has arrived
-        if (SwitchPackTime[Control] != 0 && (SDL_GetTicks() - SwitchPackTime[Control]) >= 1000)
-        {
-            SDL_HapticRumbleStop(controller[Control].event_joystick);
-            controller[Control].control->Plugin = SwitchPackType[Control];
-            SwitchPackTime[Control] = 0;
-        }
+    /* most polls see no change, and then the state computed last time still holds.  the mouse has its own events
+     * and decays over time, so a port which uses it is evaluated on every poll */
+    if (cntrl->local_generation != cntrl->generation || cntrl->mouse)
+    {
+        evaluate_local(inst, Control);
+        cntrl->local_generation = cntrl->generation;
     }
-#elif __linux__
-    if (controller[Control].event_joystick != 0)
+    cntrl->buttons = cntrl->local;
+
+    /* input injected by other processes takes the place of the local devices; shared memory wins */
+    if (!inst->headless)
+    {
+        input_server_apply(Control, &inst->controller[Control].buttons);
+        shm_input_apply(Control, &inst->controller[Control].buttons);
+    }
+
+    if (log_ring_input_enabled())
+        DebugMessage(M64MSG_VERBOSE, "Controller #%d value: 0x%8.8X", Control, *(int *)&inst->controller[Control].buttons );
+    *Keys = inst->controller[Control].buttons;
+    input_delay_apply(&inst->controller[Control].delay, Keys);
+    input_hash_keys(&inst->hash, Control, Keys->Value);
+    input_stats_poll(&inst->stats, Control, Keys->Value);
+
+    /* handle mempack / rumblepak switching (only if rumble is active on joystick) */
+#if SDL_VERSION_ATLEAST(2,0,0) || defined(__linux__)
+    if (inst->controller[Control].event_joystick)
     {
-        struct input_event play;
-        static unsigned int SwitchPackTime[4] = {0, 0, 0, 0}, SwitchPackType[4] = {0, 0, 0, 0};
         // when the user switches packs, we should mimick the act of removing 1 pack, and then inserting another 1 second later
-        if (controller[Control].buttons.Value & button_bits[14])
+        if (inst->controller[Control].buttons.Value & button_bits[14])
         {
-            SwitchPackTime[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
-            SwitchPackType[Control] = PLUGIN_MEMPAK;          // type of new pack to insert
-            controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
-            play.type = EV_FF;
-            play.code = ffweak[Control].id;
-            play.value = 1;
-            if (write(controller[Control].event_joystick, (const void*) &play, sizeof(play)) == -1)
-                perror("Error starting rumble effect");
+            inst->runtime.switch_pack_time[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
+            inst->runtime.switch_pack_type[Control] = PLUGIN_MEMPAK;          // type of new pack to insert
+            inst->controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
+            rumble_pulse(Control, 0);
         }
-        if (controller[Control].buttons.Value & button_bits[15])
+        if (inst->controller[Control].buttons.Value & button_bits[15])
         {
-            SwitchPackTime[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
-            SwitchPackType[Control] = PLUGIN_RAW;             // type of new pack to insert
-            controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
-            play.type = EV_FF;
-            play.code = ffstrong[Control].id;
-            play.value = 1;
-            if (write(controller[Control].event_joystick, (const void*) &play, sizeof(play)) == -1)
-                perror("Error starting rumble effect");
+            inst->runtime.switch_pack_time[Control] = SDL_GetTicks();         // time at which the 'switch pack' command was given
+            inst->runtime.switch_pack_type[Control] = PLUGIN_RAW;             // type of new pack to insert
+            inst->controller[Control].control->Plugin = PLUGIN_NONE;// remove old pack
+            rumble_pulse(Control, 1);
         }
         // handle inserting new pack if the time has arrived
-        if (SwitchPackTime[Control] != 0 && (SDL_GetTicks() - SwitchPackTime[Control]) >= 1000)
+        if (inst->runtime.switch_pack_time[Control] != 0 && (SDL_GetTicks() - inst->runtime.switch_pack_time[Control]) >= 1000)
         {
-            controller[Control].control->Plugin = SwitchPackType[Control];
-            SwitchPackTime[Control] = 0;
+            rumble_stop(Control);
+            inst->controller[Control].control->Plugin = inst->runtime.switch_pack_type[Control];
+            inst->runtime.switch_pack_time[Control] = 0;
         }
     }
 #endif /* __linux__ */
-
-    controller[Control].buttons.Value = 0;
 }
 
-static void InitiateJoysticks(int cntrl)
+static void InitiateJoysticks(SPluginInstance *inst, int cntrl)
 {
-    if (controller[cntrl].device >= 0) {
-        controller[cntrl].joystick = SDL_JoystickOpen(controller[cntrl].device);
-        if (!controller[cntrl].joystick)
+    if (inst->controller[cntrl].device >= 0) {
+        Uint64 start = trace_now();
+
+        inst->controller[cntrl].joystick = SDL_JoystickOpen(inst->controller[cntrl].device);
+        trace_span("SDL_JoystickOpen", start, cntrl);
+        if (!inst->controller[cntrl].joystick)
             DebugMessage(M64MSG_WARNING, "Couldn't open joystick for controller #%d: %s", cntrl + 1, SDL_GetError());
     } else {
-        controller[cntrl].joystick = NULL;
+        inst->controller[cntrl].joystick = NULL;
     }
 }
 
-static void DeinitJoystick(int cntrl)
+static void DeinitJoystick(SPluginInstance *inst, int cntrl)
 {
 #if SDL_VERSION_ATLEAST(2,0,0)
-    if (controller[cntrl].joystick) {
-        SDL_JoystickClose(controller[cntrl].joystick);
-        controller[cntrl].joystick = NULL;
-    }
-#endif
-}
-
-static void InitiateRumble(int cntrl)
-{
-#if SDL_VERSION_ATLEAST(2,0,0)
-    l_hapticWasInit = SDL_WasInit(SDL_INIT_HAPTIC);
-    if (!l_hapticWasInit) {
-        if (SDL_InitSubSystem(SDL_INIT_HAPTIC) == -1) {
-            DebugMessage(M64MSG_ERROR, "Couldn't init SDL haptic subsystem: %s", SDL_GetError() );
-            return;
-        }
-    }
-
-    controller[cntrl].event_joystick = SDL_HapticOpenFromJoystick(controller[cntrl].joystick);
-    if (!controller[cntrl].event_joystick) {
-        DebugMessage(M64MSG_WARNING, "Couldn't open rumble support for joystick #%i", cntrl + 1);
-        return;
-    }
-
-    if (SDL_HapticRumbleSupported(controller[cntrl].event_joystick) == SDL_FALSE) {
-        SDL_HapticClose(controller[cntrl].event_joystick);
-        controller[cntrl].event_joystick = NULL;
-        DebugMessage(M64MSG_WARNING, "Joystick #%i doesn't support rumble effect", cntrl + 1);
-        return;
-    }
-
-    if (SDL_HapticRumbleInit(controller[cntrl].event_joystick) != 0) {
-        SDL_HapticClose(controller[cntrl].event_joystick);
-        controller[cntrl].event_joystick = NULL;
-        DebugMessage(M64MSG_WARNING, "Rumble initialization failed for Joystick #%i", cntrl + 1);
-        return;
-    }
-
-    DebugMessage(M64MSG_INFO, "Rumble activated on N64 joystick #%i", cntrl + 1);
-#elif __linux__
-    DIR* dp;
-    struct dirent* ep;
-    unsigned long features[4];
-    char temp[128];
-    char temp2[128];
-    int iFound = 0;
-
-    controller[cntrl].event_joystick = 0;
-
-    sprintf(temp,"/sys/class/input/js%d/device", controller[cntrl].device);
-    dp = opendir(temp);
-
-    if(dp==NULL)
-        return;
-
-    while ((ep=readdir(dp)))
-        {
-        if (strncmp(ep->d_name, "event",5)==0)
-            {
-            sprintf(temp, "/dev/input/%s", ep->d_name);
-            iFound = 1;
-            break;
-            }
-        else if(strncmp(ep->d_name,"input:event", 11)==0)
-            {
-            sscanf(ep->d_name, "input:%s", temp2);
-            sprintf(temp, "/dev/input/%s", temp2);
-            iFound = 1;
-            break;
-            }
-        else if(strncmp(ep->d_name,"input:input", 11)==0)
-            {
-            strcat(temp, "/");
-            strcat(temp, ep->d_name);
-            closedir (dp);
-            dp = opendir(temp);
-            if(dp==NULL)
-                return;
-            }
-       }
-
-    closedir(dp);
-
-    if (!iFound)
-    {
-        DebugMessage(M64MSG_WARNING, "Couldn't find input event for rumble support.");
-        return;
-    }
-
-    controller[cntrl].event_joystick = open(temp, O_RDWR);
-    if(controller[cntrl].event_joystick==-1)
-        {
-        DebugMessage(M64MSG_WARNING, "Couldn't open device file '%s' for rumble support.", temp);
-        controller[cntrl].event_joystick = 0;
-        return;
-        }
-
-    if(ioctl(controller[cntrl].event_joystick, EVIOCGBIT(EV_FF, sizeof(unsigned long) * 4), features)==-1)
-        {
-        DebugMessage(M64MSG_WARNING, "Linux kernel communication failed for force feedback (rumble).\n");
-        controller[cntrl].event_joystick = 0;
-        return;
-        }
-
-    if(!test_bit(FF_RUMBLE, features))
-        {
-        DebugMessage(M64MSG_WARNING, "No rumble supported on N64 joystick #%i", cntrl + 1);
-        controller[cntrl].event_joystick = 0;
-        return;
-        }
-
-    ffeffect[cntrl].type = FF_RUMBLE;
-    ffeffect[cntrl].id = -1;
-    ffeffect[cntrl].u.rumble.strong_magnitude = 0xFFFF;
-    ffeffect[cntrl].u.rumble.weak_magnitude = 0xFFFF;
-    ffeffect[cntrl].replay.length = 0x7fff;             // hack: xboxdrv is buggy and doesn't support infinite replay.
-                                                        // when xboxdrv is fixed (https://github.com/Grumbel/xboxdrv/issues/47),
-                                                        // please remove this
-
-    ioctl(controller[cntrl].event_joystick, EVIOCSFF, &ffeffect[cntrl]);
-
-    ffstrong[cntrl].type = FF_RUMBLE;
-    ffstrong[cntrl].id = -1;
-    ffstrong[cntrl].u.rumble.strong_magnitude = 0xFFFF;
-    ffstrong[cntrl].u.rumble.weak_magnitude = 0x0000;
-    ffstrong[cntrl].replay.length = 500;
-    ffstrong[cntrl].replay.delay = 0;
-
-    ioctl(controller[cntrl].event_joystick, EVIOCSFF, &ffstrong[cntrl]);
-
-    ffweak[cntrl].type = FF_RUMBLE;
-    ffweak[cntrl].id = -1;
-    ffweak[cntrl].u.rumble.strong_magnitude = 0x0000;
-    ffweak[cntrl].u.rumble.weak_magnitude = 0xFFFF;
-    ffweak[cntrl].replay.length = 500;
-    ffweak[cntrl].replay.delay = 0;
-
-    ioctl(controller[cntrl].event_joystick, EVIOCSFF, &ffweak[cntrl]);
-
-    DebugMessage(M64MSG_INFO, "Rumble activated on N64 joystick #%i", cntrl + 1);
-#endif /* __linux__ */
-}
-
-static void DeinitRumble(int cntrl)
-{
-#if SDL_VERSION_ATLEAST(2,0,0)
-	/* quit the haptic subsystem if necessary */
-    if (!l_hapticWasInit)
-        SDL_QuitSubSystem(SDL_INIT_HAPTIC);
-
-    if (controller[cntrl].event_joystick) {
-        SDL_HapticClose(controller[cntrl].event_joystick);
-        controller[cntrl].event_joystick = NULL;
+    if (inst->controller[cntrl].joystick) {
+        SDL_JoystickClose(inst->controller[cntrl].joystick);
+        inst->controller[cntrl].joystick = NULL;
     }
 #endif
 }
@@ -956,32 +1563,24 @@ static void DeinitRumble(int cntrl)
 *******************************************************************/
 EXPORT void CALL InitiateControllers(CONTROL_INFO ControlInfo)
 {
+    SPluginInstance *inst = current_instance();
     int i;
 
-    // reset controllers
-    memset( controller, 0, sizeof( SController ) * 4 );
-    for ( i = 0; i < SDL_NUM_SCANCODES; i++)
-    {
-        myKeyState[i] = 0;
-    }
-    // set our CONTROL struct pointers to the array that was passed in to this function from the core
-    // this small struct tells the core whether each controller is plugged in, and what type of pak is connected
-    for (i = 0; i < 4; i++)
-        controller[i].control = ControlInfo.Controls + i;
-
-    // read configuration
-    load_configuration(0);
+    // reset controllers, set our CONTROL struct pointers to the array that was passed in to this function from the core
+    // (this small struct tells the core whether each controller is plugged in, and what type of pak is connected)
+    // and read the configuration
+    setup_instance(inst, ControlInfo.Controls, 0);
 
-    for( i = 0; i < 4; i++ )
+    for( i = 0; i < 4 && !inst->headless; i++ )
     {
         // test for rumble support for this joystick
-        InitiateJoysticks(i);
-        InitiateRumble(i);
+        InitiateJoysticks(inst, i);
+        rumble_open(i);
         // if rumble not supported, switch to mempack
-        if (controller[i].control->Plugin == PLUGIN_RAW && controller[i].event_joystick == 0)
-            controller[i].control->Plugin = PLUGIN_MEMPAK;
-        DeinitRumble(i);
-        DeinitJoystick(i);
+        if (inst->controller[i].control->Plugin == PLUGIN_RAW && inst->controller[i].event_joystick == 0)
+            inst->controller[i].control->Plugin = PLUGIN_MEMPAK;
+        rumble_close(i);
+        DeinitJoystick(inst, i);
     }
 
     DebugMessage(M64MSG_INFO, "%s version %i.%i.%i initialized.", PLUGIN_NAME, VERSION_PRINTF_SPLIT(PLUGIN_VERSION));
@@ -1000,11 +1599,15 @@ EXPORT void CALL InitiateControllers(CONTROL_INFO ControlInfo)
 *******************************************************************/
 EXPORT void CALL ReadController(int Control, unsigned char *Command)
 {
-#ifdef _DEBUG
-    if (Command != NULL)
+    SPluginInstance *inst = current_instance();
+
+    /* in case the core didn't send the -1 command after the last pass */
+    if (inst->pending_command[0] || inst->pending_command[1] || inst->pending_command[2] || inst->pending_command[3])
+        ProcessPendingCommands(inst);
+
+    if (Command != NULL && log_ring_input_enabled())
         DebugMessage(M64MSG_INFO, "Raw Read (cont=%d):  %02X %02X %02X %02X %02X %02X", Control,
                      Command[0], Command[1], Command[2], Command[3], Command[4], Command[5]);
-#endif
 }
 
 /******************************************************************
@@ -1021,12 +1624,29 @@ RomClosed
 #endif
 (void)
 {
+    SPluginInstance *inst = current_instance();
     int i;
 
-    // close joysticks
+    memset(inst->pending_command, 0, sizeof(inst->pending_command));
+    inst->romopen = 0;
+    if (inst->headless)
+        return;
+
+    // let the rumble worker finish its queue before the haptic devices are closed
+    rumble_stop_worker();
+    pak_file_stop_flusher();
+    shm_input_close();
+    input_server_stop();
+    input_sampler_stop();
+    // the worker threads are stopped, so the spans of all threads can be written out
+    trace_flush();
+
+    // close joysticks and the plugin's controller paks
     for( i = 0; i < 4; i++ ) {
-        DeinitRumble(i);
-        DeinitJoystick(i);
+        rumble_close(i);
+        DeinitJoystick(inst, i);
+        mempak_close(i);
+        tpak_close(i);
     }
 
     // release/ungrab mouse
@@ -1036,8 +1656,6 @@ RomClosed
     SDL_WM_GrabInput( SDL_GRAB_OFF );
 #endif
     SDL_ShowCursor( 1 );
-
-    romopen = 0;
 }
 
 /******************************************************************
@@ -1055,16 +1673,47 @@ RomOpen
 #endif
 (void)
 {
+    SPluginInstance *inst = current_instance();
     int i;
 
-    // open joysticks
     for (i = 0; i < 4; i++) {
-        InitiateJoysticks(i);
-        InitiateRumble(i);
+        SController *c = &inst->controller[i];
+
+        input_history_reset(&c->history);
+        input_delay_reset(&c->delay, c->input_delay);
+        if (c->delay.delay != 0)
+            DebugMessage(M64MSG_INFO, "Controller #%i: input delayed by %u frames", i + 1, c->delay.delay);
     }
+    if (l_ConfigLock != NULL)
+        SDL_LockMutex(l_ConfigLock);
+    input_hash_reset(&inst->hash);
+    if (l_ConfigLock != NULL)
+        SDL_UnlockMutex(l_ConfigLock);
+
+    inst->romopen = 1;
+    if (inst->headless)
+        return 1;
+
+    // open joysticks, and the plugin's own controller paks for ports which get raw pif commands
+    for (i = 0; i < 4; i++) {
+        InitiateJoysticks(inst, i);
+        rumble_open(i);
+        if (inst->controller[i].control->Present && inst->controller[i].control->RawData)
+        {
+            mempak_open(i);
+            tpak_open(i);
+        }
+    }
+    rumble_start_worker();
+    pak_file_start_flusher();
+    shm_input_open();
+    input_server_start();
+    // the button program may have changed, so a sample of the last rom mustn't be handed over
+    memset(&l_SamplerLatest, 0, sizeof(SJoystickSample));
+    input_sampler_start(sample_joysticks);
 
     // grab mouse
-    if (controller[0].mouse || controller[1].mouse || controller[2].mouse || controller[3].mouse)
+    if (inst->controller[0].mouse || inst->controller[1].mouse || inst->controller[2].mouse || inst->controller[3].mouse)
     {
         SDL_ShowCursor( 0 );
 #if SDL_VERSION_ATLEAST(2,0,0)
@@ -1079,7 +1728,6 @@ RomOpen
 #endif
     }
 
-    romopen = 1;
     return 1;
 }
 
@@ -1092,7 +1740,13 @@ RomOpen
 *******************************************************************/
 EXPORT void CALL SDL_KeyDown(int keymod, int keysym)
 {
-    myKeyState[keysym] = 1;
+    SPluginInstance *inst = current_instance();
+    unsigned int bit = 1u << (keysym & 31);
+
+    /* usually called from the front-end's event thread, while the emulation thread reads the keys.  key repeats
+     * don't change anything, and leave the generation alone */
+    if ((unsigned int) keysym < SDL_NUM_SCANCODES && !(osal_atomic_fetch_or(&inst->key_bits[keysym >> 5], bit) & bit))
+        osal_atomic_fetch_add(&inst->key_generation, 1);
 }
 
 /******************************************************************
@@ -1104,6 +1758,10 @@ EXPORT void CALL SDL_KeyDown(int keymod, int keysym)
 *******************************************************************/
 EXPORT void CALL SDL_KeyUp(int keymod, int keysym)
 {
-    myKeyState[keysym] = 0;
+    SPluginInstance *inst = current_instance();
+    unsigned int bit = 1u << (keysym & 31);
+
+    if ((unsigned int) keysym < SDL_NUM_SCANCODES && (osal_atomic_fetch_and(&inst->key_bits[keysym >> 5], ~bit) & bit))
+        osal_atomic_fetch_add(&inst->key_generation, 1);
 }
 
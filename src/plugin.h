@@ -44,6 +44,10 @@
 #define SDL_SCANCODE_LGUI SDLK_LSUPER
 #define SDL_Scancode SDLKey
 
+#define SDL_CreateThread(fn, name, data) SDL_CreateThread(fn, data)
+#define SDL_GetPerformanceCounter() ((Uint64) SDL_GetTicks())
+#define SDL_GetPerformanceFrequency() ((Uint64) 1000)
+
 #endif
 
 #if SDL_VERSION_ATLEAST(2,0,0)
@@ -76,6 +80,12 @@ static inline const char* _SDL_JoystickName(int device_index)
 #define M64P_PLUGIN_PROTOTYPES 1
 #include "m64p_config.h"
 #include "m64p_plugin.h"
+#include "button_eval.h"
+#include "input_delay.h"
+#include "input_hash.h"
+#include "input_history.h"
+#include "input_stats.h"
+#include "osal_preproc.h"
 
 #define DEVICE_NO_JOYSTICK  (-1)
 
@@ -134,12 +144,24 @@ typedef struct
 
 typedef struct
 {
+    Uint8    num_buttons;                   // inputs of the N64 buttons, evaluated by button_eval.c
+    Uint8    num_stick_keys;                // stick[] holds the keys first,
+    Uint8    num_stick_joy;                 // then the joystick inputs (only if a joystick is used)
+    Uint8    reserved;
+    int      deadzone[2];                   // of the stick axes
+    int      range[2];                      // peak - deadzone
+    SBinding stick[MAX_STICK_BINDINGS];     // inputs of the N64 stick
+    SBinding button[MAX_BUTTON_BINDINGS];
+} SBindings;
+
+typedef struct
+{
+    // state read on every poll
     CONTROL *control;               // pointer to CONTROL struct in Core library
     BUTTONS buttons;
-
-    // mappings
-    SButtonMap    button[16];       // 14 buttons; in the order of EButton + mempak/rumblepak switches
-    SAxisMap      axis[2];          // 2 axis
+    BUTTONS       local;            // the state from the local devices, as last computed by evaluate_port()
+    unsigned int  generation;       // bumped by every sample in which an input of this port changed
+    unsigned int  local_generation; // generation from which 'local' was computed
     int           device;           // joystick device; -1 = keyboard; -2 = none
     int           mouse;            // mouse enabled: 0 = no; 1 = yes
     SDL_Joystick *joystick;         // SDL joystick device
@@ -148,13 +170,79 @@ typedef struct
 #else
     int           event_joystick;   // the /dev/input/eventX device for force feeback
 #endif
+    Sint32        stick_value[MAX_STICK_BINDINGS]; // the inputs of bindings.stick[] as read by the last sample
+    SBindings     bindings;         // compiled from the mappings below
+
+    // mappings, as read from the configuration
+    SButtonMap    button[16];       // 14 buttons; in the order of EButton + mempak/rumblepak switches
+    SAxisMap      axis[2];          // 2 axis
     int           axis_deadzone[2]; // minimum absolute value before analog movement is recognized
     int           axis_peak[2];     // highest analog value returned by SDL, used for scaling
     float         mouse_sens[2];    // mouse sensitivity
+    int           input_delay;      // frames the input is held back before GetKeys() returns it
+
+    // per port state of the input history and input delay modules
+    SHistory      history;
+    SDelayQueue   delay;
 } SController;
 
+/* runtime state which isn't part of the configuration; saved and restored by InputSaveState()/InputLoadState() */
+typedef struct
+{
+    unsigned int switch_pack_time[4];   // SDL ticks at which a 'switch pack' button was pressed, 0 if none
+    unsigned int switch_pack_type[4];   // type of the pak to insert when the switch is done
+    int          mouse_residual[2];     // mouse motion which hasn't moved the stick yet
+    int          grab_mouse;
+    int          grab_toggled;          // the grab key combination is held down
+} SRuntimeState;
+
+/* the joystick inputs of all ports as read by one sample, by the emulation thread or by the sampler thread */
+typedef struct
+{
+    Sint32       button[BUTTON_EVAL_SIZE];          // at the index of their entry in the button program
+    Sint32       stick[4][MAX_STICK_BINDINGS];      // at the index of their input in bindings.stick[]
+    Uint64       time;                              // performance counter just before the joysticks were read
+    unsigned int serial;                            // counts the samples of the sampler thread
+} SJoystickSample;
+
+/* the key state from SDL_KeyDown()/SDL_KeyUp() is a bitset, so that the event thread can update it atomically */
+#define KEY_STATE_WORDS     ((SDL_NUM_SCANCODES + 31) / 32)
+
+/* the state written by the front-end's event thread has its own cache lines, so the emulation thread doesn't lose
+ * the lines of its own state to every key event */
+#define CACHE_LINE_SIZE     64
+
+/* everything which belongs to one emulator.  the default instance also owns the input devices (keyboard,
+ * joysticks, mouse, rumble), the controller pak files and the shared memory / socket input; the other
+ * instances are headless and never touch them, so that they can run on any thread */
+typedef struct
+{
+    int            id;                              // 0 for the default instance
+    volatile unsigned int bound_threads;            // threads which have bound the instance with InputInstanceBind()
+    int            headless;
+    SController    controller[4];                   // 4 controllers
+    CONTROL        control_info[4];                 // used until the core passes its CONTROL structs
+    osal_align(CACHE_LINE_SIZE)
+    volatile unsigned int key_bits[KEY_STATE_WORDS]; // keys pressed according to SDL_KeyDown()/SDL_KeyUp(), one bit each;
+                                                    // written by the front-end's event thread (64 bytes with SDL 2)
+    volatile unsigned int key_generation;           // bumped after every change of key_bits
+    osal_align(CACHE_LINE_SIZE)
+    unsigned int   sampled_key_generation;          // key_generation as of the last copy into keys
+    unsigned int   keys[KEY_STATE_WORDS];           // copy of key_bits taken by each sample of the devices
+    int            last_port;                       // port of the last GetKeys(); a lower or equal port starts a frame
+    SButtonProgram button_prog;                     // the button inputs of all ports
+    Uint16         pressed[4];                      // buttons pressed according to the last sample, per port
+    SJoystickSample joy;                            // the joystick inputs of the last sample
+    unsigned char *pending_command[4];              // pif commands of the RawData ports, queued until the end of the pass
+    SRuntimeState  runtime;
+    SInputHash     hash;
+    SInputCounters stats;                           // counters for GetInputStats()
+    SInputCounters stats_base;                      // their values at the last ResetInputStats()
+    int            romopen;                         // is a rom opened
+} SPluginInstance;
+
 /* global data definitions */
-extern SController controller[4];   // 4 controllers
+extern SPluginInstance default_instance;
 
 /* global function definitions */
 
@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - probes.h                                      *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+/* USDT probes of the provider 'm64p_input', for perf, bpftrace and SystemTap; see tools/bpftrace for examples.
+ * they are only compiled in with HAVE_SYS_SDT_H (USDT=1 for the unix makefile), and each one is a nop in the
+ * code until a tracer attaches to it.  arguments which cost something to compute are only computed while
+ * PROBE_ENABLED() reports that a tracer is attached, which it tells through the probe's semaphore.
+ *
+ *   getkeys_entry(port)                            GetKeys(); port -1 for GetAllKeys()
+ *   getkeys_exit(port, value, duration_ns)         the BUTTONS value returned for a port, and the time since the
+ *                                                  entry.  GetAllKeys() fires one per port
+ *   controller_command(port, command, address)     a pif command, with the pak address of pak reads and writes
+ *   rumble_start(port, level), rumble_stop(port)   motor commands which the rumble worker gives to the device
+ *   hotplug(port, device, opened)                  a poll found the port's joystick unplugged and tried to open it
+ *   config_phase(phase, preconfig, controllers)    load_configuration() finished a phase (EProbeConfigPhase),
+ *                                                  with the number of controllers set up so far
+ */
+
+enum EProbeConfigPhase
+{
+    PROBE_CONFIG_BEGIN = 0,
+    PROBE_CONFIG_SECTIONS,          // the controller sections were read
+    PROBE_CONFIG_MANUAL,            // the manually configured controllers were set up
+    PROBE_CONFIG_NAMED_AUTO,        // the controllers auto-configured by device name
+    PROBE_CONFIG_FULL_AUTO,         // the controllers auto-configured from any free device
+    PROBE_CONFIG_END
+};
+
+#if defined(HAVE_SYS_SDT_H)
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* every probe has a semaphore; they are defined in plugin.c */
+#define PROBE_LIST(X) \
+    X(getkeys_entry) X(getkeys_exit) X(controller_command) X(rumble_start) X(rumble_stop) X(hotplug) X(config_phase)
+
+#define PROBE_SEMAPHORE(name)       m64p_input_##name##_semaphore
+#define PROBE_DECLARE_SEMAPHORE(name) extern volatile unsigned short PROBE_SEMAPHORE(name);
+PROBE_LIST(PROBE_DECLARE_SEMAPHORE)
+
+#define PROBE_ENABLED(name)         (PROBE_SEMAPHORE(name) != 0)
+#define PROBE1(name, a)             DTRACE_PROBE1(m64p_input, name, a)
+#define PROBE2(name, a, b)          DTRACE_PROBE2(m64p_input, name, a, b)
+#define PROBE3(name, a, b, c)       DTRACE_PROBE3(m64p_input, name, a, b, c)
+
+#else
+
+/* the arguments are never evaluated, but they count as used */
+#define PROBE_ENABLED(name)         0
+#define PROBE1(name, a)             do { if (0) { (void) (a); } } while (0)
+#define PROBE2(name, a, b)          do { if (0) { (void) (a); (void) (b); } } while (0)
+#define PROBE3(name, a, b, c)       do { if (0) { (void) (a); (void) (b); (void) (c); } } while (0)
+
+#endif
+
+#endif /* __PROBES_H__ */
@@ -0,0 +1,857 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - rumble.c                                      *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2008-2011 Richard Goedeken                              *
+ *   Copyright (C) 2008 Tillin9                                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#define M64P_PLUGIN_PROTOTYPES 1
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_stats.h"
+#include "osal_atomic.h"
+#include "plugin.h"
+#include "probes.h"
+#include "rumble.h"
+#include "trace.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/input.h>
+#endif /* __linux__ */
+
+/* defines for the force feedback rumble support */
+#ifdef __linux__
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define OFF(x)  ((x)%BITS_PER_LONG)
+#define BIT(x)  (1UL<<OFF(x))
+#define LONG(x) ((x)/BITS_PER_LONG)
+#define test_bit(bit, array)    ((array[LONG(bit)] >> OFF(bit)) & 1)
+#endif //__linux__
+
+/* size of the command queue between the emulation thread and the worker; must be a power of 2 */
+#define RUMBLE_QUEUE_SIZE   64
+
+/* many games switch the rumble pak on and off every frame (or faster) to get a weaker effect.
+ * the worker turns the duty cycle seen over RUMBLE_WINDOW_US into one of RUMBLE_LEVELS strengths,
+ * changes the strength at most once per RUMBLE_UPDATE_US, and stops the motor once the game has
+ * left it off for RUMBLE_IDLE_US.  all times are in microseconds. */
+#define RUMBLE_WINDOW_US    100000
+#define RUMBLE_UPDATE_US    33000
+#define RUMBLE_IDLE_US      50000
+#define RUMBLE_TICK_MS      10
+#define RUMBLE_LEVELS       4
+#define RUMBLE_HISTORY      32      // on-periods remembered per controller
+
+typedef enum {
+    RUMBLE_CMD_ON = 0,
+    RUMBLE_CMD_OFF,
+    RUMBLE_CMD_STOP,
+    RUMBLE_CMD_PULSE_WEAK,
+    RUMBLE_CMD_PULSE_STRONG
+} ERumbleCmd;
+
+typedef struct {
+    volatile unsigned int sequence;
+    unsigned int          time;
+    unsigned char         cntrl;
+    unsigned char         cmd;
+} SRumbleCmd;
+
+/* rumble state machine for one controller; only touched by the worker thread */
+typedef struct {
+    int          active;                    // in a burst of rumble activity
+    int          on;                        // motor state last written by the game
+    unsigned int last_change;               // time of the last on/off transition
+    unsigned int burst_start;               // time at which the current burst started
+    unsigned int on_start[RUMBLE_HISTORY];  // ring of the most recent on-periods
+    unsigned int on_end[RUMBLE_HISTORY];
+    int          periods;                   // number of valid entries in the ring
+    int          current;                   // index of the newest entry
+    int          level;                     // strength applied to the device, 0 = stopped
+    unsigned int last_update;               // time of the last strength change
+} SRumbleState;
+
+/* force feedback effects are created once per device and then only triggered by id.  the cache
+ * entry stays alive across RomClosed/RomOpen, and is only rebuilt when the port's device changes. */
+typedef struct {
+    int           device;                       // SDL joystick index, -1 = empty
+#if SDL_VERSION_ATLEAST(2,0,0)
+    SDL_Joystick *joystick;                     // own reference; the haptic device must not outlive it
+    SDL_Haptic   *haptic;
+    int           use_rumble_api;               // no effects could be created: use SDL_HapticRumblePlay()
+#elif __linux__
+    int           fd;
+#endif
+    int           level_effect[RUMBLE_LEVELS];  // effect ids for each strength, -1 if not available
+    int           weak_effect, strong_effect;   // 500ms pulses used when switching paks
+    int           playing;                      // id of the running level effect, -1 if none
+} SRumbleDevice;
+
+/* static data definitions */
+static int l_hapticInitialized = 0;      // the haptic subsystem was started by us
+static SRumbleDevice l_Devices[4] = { { -1 }, { -1 }, { -1 }, { -1 } };
+
+/* bounded lock-free multi-producer/single-consumer queue (cells carry a sequence number) */
+static SRumbleCmd            l_Queue[RUMBLE_QUEUE_SIZE];
+static volatile unsigned int l_QueueHead = 0;   // next cell to be written by a producer
+static unsigned int          l_QueueTail = 0;   // next cell to be read by the worker
+
+static SDL_Thread   *l_WorkerThread = NULL;
+static SDL_sem      *l_WorkerWakeup = NULL;
+static volatile unsigned int l_WorkerQuit = 0;
+static volatile unsigned int l_WorkerRunning = 0;
+static int          l_Batch = 0;               // inside rumble_begin_batch()/rumble_end_batch()
+static int          l_BatchPosted = 0;         // commands were queued during the batch
+
+static int           l_GameRumble[4];           // last motor state written by the game (emulation thread)
+static SRumbleState  l_State[4];
+
+/* statistics, reported when the worker is stopped */
+static volatile unsigned int l_GameWrites = 0;
+static volatile unsigned int l_GameWritesCoalesced = 0;
+static volatile unsigned int l_CmdsDropped = 0;
+static unsigned int l_DeviceCalls = 0;
+static Uint64       l_DeviceTicks = 0;
+static Uint64       l_DeviceTicksMax = 0;
+
+/* local functions */
+static unsigned int rumble_time(void)
+{
+    Uint64 count = SDL_GetPerformanceCounter();
+    Uint64 freq = SDL_GetPerformanceFrequency();
+
+    return (unsigned int) ((count / freq) * 1000000 + (count % freq) * 1000000 / freq);
+}
+
+#if __linux__ && !SDL_VERSION_ATLEAST(2,0,0)
+static void play_effect(int fd, int id, int value)
+{
+    struct input_event play;
+
+    if (id < 0)
+        return;
+
+    memset(&play, 0, sizeof(play));
+    play.type = EV_FF;
+    play.code = id;
+    play.value = value;
+    if (write(fd, (const void*) &play, sizeof(play)) == -1)
+        perror(value ? "Error starting rumble effect" : "Error stopping rumble effect");
+}
+#endif
+
+static void apply_command(int cntrl, ERumbleCmd cmd, int level)
+{
+    SRumbleDevice *dev = &l_Devices[cntrl];
+    int effect = -1, i;
+
+    if (default_instance.controller[cntrl].event_joystick == 0 || dev->device < 0)
+        return;
+
+    if (cmd == RUMBLE_CMD_ON)
+        PROBE2(rumble_start, cntrl, level);
+    else if (cmd == RUMBLE_CMD_OFF || cmd == RUMBLE_CMD_STOP)
+        PROBE1(rumble_stop, cntrl);
+
+    switch (cmd)
+    {
+        case RUMBLE_CMD_ON:
+            /* use the strongest uploaded effect which isn't stronger than requested; 'level' stays the requested
+             * strength for the rumble api */
+            for (i = level; i > 0 && effect < 0; i--)
+                effect = dev->level_effect[i - 1];
+            if (effect < 0)
+                effect = dev->level_effect[RUMBLE_LEVELS - 1];
+            break;
+        case RUMBLE_CMD_PULSE_WEAK:
+            effect = dev->weak_effect;
+            break;
+        case RUMBLE_CMD_PULSE_STRONG:
+            effect = dev->strong_effect;
+            break;
+        default:
+            break;
+    }
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    if (dev->use_rumble_api)
+    {
+        switch (cmd)
+        {
+            case RUMBLE_CMD_ON:
+                SDL_HapticRumblePlay(dev->haptic, (float) level / RUMBLE_LEVELS, SDL_HAPTIC_INFINITY);
+                break;
+            case RUMBLE_CMD_OFF:
+            case RUMBLE_CMD_STOP:
+                SDL_HapticRumbleStop(dev->haptic);
+                break;
+            case RUMBLE_CMD_PULSE_WEAK:
+                SDL_HapticRumblePlay(dev->haptic, 0.5, 500);
+                break;
+            case RUMBLE_CMD_PULSE_STRONG:
+                SDL_HapticRumblePlay(dev->haptic, 1, 500);
+                break;
+        }
+        return;
+    }
+
+    if (dev->playing >= 0 && dev->playing != effect)
+        SDL_HapticStopEffect(dev->haptic, dev->playing);
+    dev->playing = -1;
+    if (effect >= 0 && SDL_HapticRunEffect(dev->haptic, effect, 1) == 0 && cmd == RUMBLE_CMD_ON)
+        dev->playing = effect;
+#elif __linux__
+    if (dev->playing >= 0 && dev->playing != effect)
+        play_effect(dev->fd, dev->playing, 0);
+    dev->playing = -1;
+    if (effect >= 0)
+    {
+        play_effect(dev->fd, effect, 1);
+        if (cmd == RUMBLE_CMD_ON)
+            dev->playing = effect;
+    }
+#endif /* __linux__ */
+}
+
+static void device_command(int cntrl, ERumbleCmd cmd, int level)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 elapsed;
+
+    apply_command(cntrl, cmd, level);
+
+    elapsed = SDL_GetPerformanceCounter() - start;
+    l_DeviceTicks += elapsed;
+    if (elapsed > l_DeviceTicksMax)
+        l_DeviceTicksMax = elapsed;
+    l_DeviceCalls++;
+    trace_span("rumble command", start, cntrl);
+}
+
+static void set_level(int cntrl, int level, unsigned int now)
+{
+    SRumbleState *s = &l_State[cntrl];
+
+    if (level == s->level)
+        return;
+    device_command(cntrl, level > 0 ? RUMBLE_CMD_ON : RUMBLE_CMD_OFF, level);
+    s->level = level;
+    s->last_update = now;
+}
+
+static void game_write(int cntrl, int on, unsigned int time)
+{
+    SRumbleState *s = &l_State[cntrl];
+
+    if (on == s->on)
+        return;
+
+    if (on)
+    {
+        if (!s->active)
+        {
+            s->active = 1;
+            s->burst_start = time;
+            s->periods = 0;
+        }
+        s->current = (s->current + 1) % RUMBLE_HISTORY;
+        s->on_start[s->current] = s->on_end[s->current] = time;
+        if (s->periods < RUMBLE_HISTORY)
+            s->periods++;
+    }
+    else
+    {
+        s->on_end[s->current] = time;
+    }
+
+    s->on = on;
+    s->last_change = time;
+}
+
+/* work out the strength the game is asking for and pass it on to the device, rate-limited */
+static void update_state(int cntrl, unsigned int now)
+{
+    SRumbleState *s = &l_State[cntrl];
+    int level;
+
+    if (!s->active)
+        return;
+
+    if (!s->on && now - s->last_change >= RUMBLE_IDLE_US)
+    {
+        s->active = 0;
+        level = 0;
+    }
+    else
+    {
+        unsigned int window = now - s->burst_start;
+        unsigned int on_time = 0;
+        int i, idx;
+
+        if (window > RUMBLE_WINDOW_US)
+            window = RUMBLE_WINDOW_US;
+        for (i = 0, idx = s->current; i < s->periods; i++, idx = (idx + RUMBLE_HISTORY - 1) % RUMBLE_HISTORY)
+        {
+            unsigned int age_start = now - s->on_start[idx];
+            unsigned int age_end = (idx == s->current && s->on) ? 0 : now - s->on_end[idx];
+            if (age_end >= window)
+                break;
+            on_time += (age_start < window ? age_start : window) - age_end;
+        }
+
+        if (window == 0)
+            level = RUMBLE_LEVELS;
+        else
+            level = (int) (((Uint64) on_time * RUMBLE_LEVELS + window - 1) / window);
+        if (level < 1)
+            level = 1;
+        if (level > RUMBLE_LEVELS)
+            level = RUMBLE_LEVELS;
+    }
+
+    /* starting and stopping are never delayed, strength changes are */
+    if (level != s->level && (level == 0 || s->level == 0 || now - s->last_update >= RUMBLE_UPDATE_US))
+        set_level(cntrl, level, now);
+}
+
+static int queue_push(int cntrl, ERumbleCmd cmd, unsigned int time)
+{
+    unsigned int pos = osal_atomic_load(&l_QueueHead);
+
+    for (;;)
+    {
+        SRumbleCmd *cell = &l_Queue[pos & (RUMBLE_QUEUE_SIZE - 1)];
+        int diff = (int) (osal_atomic_load(&cell->sequence) - pos);
+        if (diff == 0)
+        {
+            if (osal_atomic_cas(&l_QueueHead, pos, pos + 1))
+            {
+                cell->time = time;
+                cell->cntrl = (unsigned char) cntrl;
+                cell->cmd = (unsigned char) cmd;
+                osal_atomic_store(&cell->sequence, pos + 1);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0;   // full
+        }
+        pos = osal_atomic_load(&l_QueueHead);
+    }
+}
+
+static int queue_pop(SRumbleCmd *out)
+{
+    SRumbleCmd *cell = &l_Queue[l_QueueTail & (RUMBLE_QUEUE_SIZE - 1)];
+
+    if ((int) (osal_atomic_load(&cell->sequence) - (l_QueueTail + 1)) < 0)
+        return 0;   // empty
+
+    out->time = cell->time;
+    out->cntrl = cell->cntrl;
+    out->cmd = cell->cmd;
+    osal_atomic_store(&cell->sequence, l_QueueTail + RUMBLE_QUEUE_SIZE);
+    l_QueueTail++;
+    return 1;
+}
+
+static int RumbleWorker(void *unused)
+{
+    SRumbleCmd cmd;
+    unsigned int now;
+    int i, active = 0;
+
+    for (;;)
+    {
+        /* while a state machine is active it has to be looked at regularly, even without new commands */
+        if (active)
+            SDL_SemWaitTimeout(l_WorkerWakeup, RUMBLE_TICK_MS);
+        else
+            SDL_SemWait(l_WorkerWakeup);
+
+        while (queue_pop(&cmd))
+        {
+            switch ((ERumbleCmd) cmd.cmd)
+            {
+                case RUMBLE_CMD_ON:
+                case RUMBLE_CMD_OFF:
+                    game_write(cmd.cntrl, cmd.cmd == RUMBLE_CMD_ON, cmd.time);
+                    break;
+                case RUMBLE_CMD_STOP:
+                    memset(&l_State[cmd.cntrl], 0, sizeof(SRumbleState));
+                    device_command(cmd.cntrl, RUMBLE_CMD_STOP, 0);
+                    break;
+                default:
+                    device_command(cmd.cntrl, (ERumbleCmd) cmd.cmd, 0);
+                    break;
+            }
+        }
+
+        now = rumble_time();
+        active = 0;
+        for (i = 0; i < 4; i++)
+        {
+            update_state(i, now);
+            active |= l_State[i].active;
+        }
+
+        if (osal_atomic_load(&l_WorkerQuit))
+            break;
+    }
+
+    trace_thread_exit();
+    return 0;
+}
+
+static void post_command(int cntrl, ERumbleCmd cmd)
+{
+    input_stats_add(COUNTER_RUMBLE_COMMANDS, 1);
+    if (!osal_atomic_load(&l_WorkerRunning))
+    {
+        apply_command(cntrl, cmd, RUMBLE_LEVELS);
+        return;
+    }
+
+    if (!queue_push(cntrl, cmd, rumble_time()))
+    {
+        osal_atomic_fetch_add(&l_CmdsDropped, 1);
+        return;
+    }
+    if (l_Batch)
+        l_BatchPosted = 1;
+    else
+        SDL_SemPost(l_WorkerWakeup);
+}
+
+/* global functions */
+void rumble_start_worker(void)
+{
+    unsigned int i;
+
+    if (l_WorkerThread != NULL)
+        return;
+
+    for (i = 0; i < RUMBLE_QUEUE_SIZE; i++)
+        l_Queue[i].sequence = i;
+    l_QueueHead = l_QueueTail = 0;
+    l_WorkerQuit = 0;
+    memset(l_GameRumble, 0, sizeof(l_GameRumble));
+    memset(l_State, 0, sizeof(l_State));
+    l_GameWrites = l_GameWritesCoalesced = l_CmdsDropped = 0;
+    l_DeviceCalls = 0;
+    l_DeviceTicks = l_DeviceTicksMax = 0;
+
+    l_WorkerWakeup = SDL_CreateSemaphore(0);
+    if (l_WorkerWakeup == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't create rumble semaphore: %s", SDL_GetError());
+        return;
+    }
+
+    l_WorkerThread = SDL_CreateThread(RumbleWorker, "InputRumble", NULL);
+    if (l_WorkerThread == NULL)
+    {
+        /* no threads (e.g. single-threaded web build): rumble commands are applied synchronously */
+        DebugMessage(M64MSG_VERBOSE, "Couldn't create rumble worker thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(l_WorkerWakeup);
+        l_WorkerWakeup = NULL;
+        return;
+    }
+
+    osal_atomic_store(&l_WorkerRunning, 1);
+}
+
+void rumble_stop_worker(void)
+{
+    double freq = (double) SDL_GetPerformanceFrequency();
+    int i;
+
+    if (l_WorkerThread == NULL)
+        return;
+
+    /* remaining commands are applied before the worker quits */
+    osal_atomic_store(&l_WorkerRunning, 0);
+    osal_atomic_store(&l_WorkerQuit, 1);
+    SDL_SemPost(l_WorkerWakeup);
+    SDL_WaitThread(l_WorkerThread, NULL);
+    l_WorkerThread = NULL;
+    SDL_DestroySemaphore(l_WorkerWakeup);
+    l_WorkerWakeup = NULL;
+
+    /* don't leave a motor running */
+    for (i = 0; i < 4; i++)
+    {
+        if (l_State[i].level > 0)
+            apply_command(i, RUMBLE_CMD_STOP, 0);
+    }
+
+    if (l_GameWrites > 0)
+        DebugMessage(M64MSG_VERBOSE, "Rumble: %u writes from game (%u coalesced, %u dropped), %u device calls taking %.3f ms (max %.3f ms)",
+                     l_GameWrites, l_GameWritesCoalesced, l_CmdsDropped, l_DeviceCalls,
+                     l_DeviceTicks * 1000.0 / freq, l_DeviceTicksMax * 1000.0 / freq);
+}
+
+void rumble_set(int cntrl, int on)
+{
+    on = (on != 0);
+    osal_atomic_fetch_add(&l_GameWrites, 1);
+    if (on == l_GameRumble[cntrl])
+    {
+        osal_atomic_fetch_add(&l_GameWritesCoalesced, 1);
+        input_stats_add(COUNTER_RUMBLE_COALESCED, 1);
+        return;
+    }
+    l_GameRumble[cntrl] = on;
+    post_command(cntrl, on ? RUMBLE_CMD_ON : RUMBLE_CMD_OFF);
+}
+
+int rumble_get(int cntrl)
+{
+    return l_GameRumble[cntrl];
+}
+
+void rumble_begin_batch(void)
+{
+    l_Batch = 1;
+    l_BatchPosted = 0;
+}
+
+void rumble_end_batch(void)
+{
+    l_Batch = 0;
+    if (l_BatchPosted && osal_atomic_load(&l_WorkerRunning))
+        SDL_SemPost(l_WorkerWakeup);
+    l_BatchPosted = 0;
+}
+
+void rumble_pulse(int cntrl, int strong)
+{
+    post_command(cntrl, strong ? RUMBLE_CMD_PULSE_STRONG : RUMBLE_CMD_PULSE_WEAK);
+}
+
+void rumble_stop(int cntrl)
+{
+    l_GameRumble[cntrl] = 0;
+    post_command(cntrl, RUMBLE_CMD_STOP);
+}
+
+static void release_device(SRumbleDevice *dev)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+    int i;
+
+    if (dev->haptic != NULL)
+    {
+        if (!dev->use_rumble_api)
+        {
+            for (i = 0; i < RUMBLE_LEVELS; i++)
+                if (dev->level_effect[i] >= 0)
+                    SDL_HapticDestroyEffect(dev->haptic, dev->level_effect[i]);
+            if (dev->weak_effect >= 0)
+                SDL_HapticDestroyEffect(dev->haptic, dev->weak_effect);
+            if (dev->strong_effect >= 0)
+                SDL_HapticDestroyEffect(dev->haptic, dev->strong_effect);
+        }
+        SDL_HapticClose(dev->haptic);
+    }
+    if (dev->joystick != NULL)
+        SDL_JoystickClose(dev->joystick);
+#elif __linux__
+    /* closing the event device also frees the effects uploaded through it */
+    if (dev->fd > 0)
+        close(dev->fd);
+#endif
+    memset(dev, 0, sizeof(SRumbleDevice));
+    dev->device = -1;
+}
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+static int new_leftright_effect(SDL_Haptic *haptic, Uint16 large, Uint16 small, Uint32 length)
+{
+    SDL_HapticEffect effect;
+
+    memset(&effect, 0, sizeof(effect));
+    effect.type = SDL_HAPTIC_LEFTRIGHT;
+    effect.leftright.length = length;
+    effect.leftright.large_magnitude = large;
+    effect.leftright.small_magnitude = small;
+    return SDL_HapticNewEffect(haptic, &effect);
+}
+
+static int create_device(int cntrl, SRumbleDevice *dev)
+{
+    int i;
+
+    dev->joystick = SDL_JoystickOpen(default_instance.controller[cntrl].device);
+    if (dev->joystick == NULL)
+        return 0;
+
+    dev->haptic = SDL_HapticOpenFromJoystick(dev->joystick);
+    if (!dev->haptic) {
+        DebugMessage(M64MSG_WARNING, "Couldn't open rumble support for joystick #%i", cntrl + 1);
+        return 0;
+    }
+
+    if ((SDL_HapticQuery(dev->haptic) & SDL_HAPTIC_LEFTRIGHT) && SDL_HapticNumEffects(dev->haptic) >= RUMBLE_LEVELS + 2)
+    {
+        int ok = 1;
+        for (i = 0; i < RUMBLE_LEVELS; i++)
+        {
+            Uint16 magnitude = (Uint16) (0xFFFF * (i + 1) / RUMBLE_LEVELS);
+            dev->level_effect[i] = new_leftright_effect(dev->haptic, magnitude, magnitude, SDL_HAPTIC_INFINITY);
+            ok &= (dev->level_effect[i] >= 0);
+        }
+        dev->weak_effect = new_leftright_effect(dev->haptic, 0x7FFF, 0x7FFF, 500);
+        dev->strong_effect = new_leftright_effect(dev->haptic, 0xFFFF, 0xFFFF, 500);
+        ok &= (dev->weak_effect >= 0 && dev->strong_effect >= 0);
+        if (ok)
+            return 1;
+
+        for (i = 0; i < RUMBLE_LEVELS; i++)
+            if (dev->level_effect[i] >= 0)
+                SDL_HapticDestroyEffect(dev->haptic, dev->level_effect[i]);
+        if (dev->weak_effect >= 0)
+            SDL_HapticDestroyEffect(dev->haptic, dev->weak_effect);
+        if (dev->strong_effect >= 0)
+            SDL_HapticDestroyEffect(dev->haptic, dev->strong_effect);
+    }
+
+    /* fall back to SDL's simple rumble API, which is initialized here once */
+    if (SDL_HapticRumbleSupported(dev->haptic) == SDL_FALSE) {
+        DebugMessage(M64MSG_WARNING, "Joystick #%i doesn't support rumble effect", cntrl + 1);
+        return 0;
+    }
+
+    if (SDL_HapticRumbleInit(dev->haptic) != 0) {
+        DebugMessage(M64MSG_WARNING, "Rumble initialization failed for Joystick #%i", cntrl + 1);
+        return 0;
+    }
+
+    dev->use_rumble_api = 1;
+    return 1;
+}
+#elif __linux__
+static int upload_effect(int fd, Uint16 strong, Uint16 weak, Uint16 length)
+{
+    struct ff_effect effect;
+
+    memset(&effect, 0, sizeof(effect));
+    effect.type = FF_RUMBLE;
+    effect.id = -1;
+    effect.u.rumble.strong_magnitude = strong;
+    effect.u.rumble.weak_magnitude = weak;
+    effect.replay.length = length;
+    effect.replay.delay = 0;
+
+    if (ioctl(fd, EVIOCSFF, &effect) == -1)
+        return -1;
+    return effect.id;
+}
+
+static int create_device(int cntrl, SRumbleDevice *dev)
+{
+    DIR* dp;
+    struct dirent* ep;
+    unsigned long features[4];
+    char temp[128];
+    char temp2[128];
+    int iFound = 0;
+    int i;
+
+    sprintf(temp,"/sys/class/input/js%d/device", default_instance.controller[cntrl].device);
+    dp = opendir(temp);
+
+    if(dp==NULL)
+        return 0;
+
+    while ((ep=readdir(dp)))
+        {
+        if (strncmp(ep->d_name, "event",5)==0)
+            {
+            sprintf(temp, "/dev/input/%s", ep->d_name);
+            iFound = 1;
+            break;
+            }
+        else if(strncmp(ep->d_name,"input:event", 11)==0)
+            {
+            sscanf(ep->d_name, "input:%s", temp2);
+            sprintf(temp, "/dev/input/%s", temp2);
+            iFound = 1;
+            break;
+            }
+        else if(strncmp(ep->d_name,"input:input", 11)==0)
+            {
+            strcat(temp, "/");
+            strcat(temp, ep->d_name);
+            closedir (dp);
+            dp = opendir(temp);
+            if(dp==NULL)
+                return 0;
+            }
+       }
+
+    closedir(dp);
+
+    if (!iFound)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't find input event for rumble support.");
+        return 0;
+    }
+
+    dev->fd = open(temp, O_RDWR);
+    if(dev->fd==-1)
+        {
+        DebugMessage(M64MSG_WARNING, "Couldn't open device file '%s' for rumble support.", temp);
+        dev->fd = 0;
+        return 0;
+        }
+
+    if(ioctl(dev->fd, EVIOCGBIT(EV_FF, sizeof(unsigned long) * 4), features)==-1)
+        {
+        DebugMessage(M64MSG_WARNING, "Linux kernel communication failed for force feedback (rumble).\n");
+        return 0;
+        }
+
+    if(!test_bit(FF_RUMBLE, features))
+        {
+        DebugMessage(M64MSG_WARNING, "No rumble supported on N64 joystick #%i", cntrl + 1);
+        return 0;
+        }
+
+    /* hack: xboxdrv is buggy and doesn't support infinite replay, so the level effects get a length of 0x7fff.
+     * when xboxdrv is fixed (https://github.com/Grumbel/xboxdrv/issues/47), please remove this */
+    for (i = RUMBLE_LEVELS - 1; i >= 0; i--)
+    {
+        Uint16 magnitude = (Uint16) (0xFFFF * (i + 1) / RUMBLE_LEVELS);
+        dev->level_effect[i] = upload_effect(dev->fd, magnitude, magnitude, 0x7fff);
+    }
+    dev->strong_effect = upload_effect(dev->fd, 0xFFFF, 0x0000, 500);
+    dev->weak_effect = upload_effect(dev->fd, 0x0000, 0xFFFF, 500);
+
+    if (dev->level_effect[RUMBLE_LEVELS - 1] < 0)
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't upload rumble effect for N64 joystick #%i", cntrl + 1);
+        return 0;
+    }
+
+    return 1;
+}
+#endif /* __linux__ */
+
+void rumble_open(int cntrl)
+{
+#if SDL_VERSION_ATLEAST(2,0,0) || defined(__linux__)
+    SRumbleDevice *dev = &l_Devices[cntrl];
+    Uint64 start;
+    int i;
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    default_instance.controller[cntrl].event_joystick = NULL;
+#else
+    default_instance.controller[cntrl].event_joystick = 0;
+#endif
+    if (default_instance.controller[cntrl].device < 0)
+        return;
+
+    /* re-use the effects which were created for this device before */
+#if SDL_VERSION_ATLEAST(2,0,0)
+    if (dev->device == default_instance.controller[cntrl].device && dev->haptic != NULL && SDL_JoystickGetAttached(dev->joystick))
+    {
+        default_instance.controller[cntrl].event_joystick = dev->haptic;
+        return;
+    }
+#else
+    if (dev->device == default_instance.controller[cntrl].device && dev->fd > 0)
+    {
+        default_instance.controller[cntrl].event_joystick = dev->fd;
+        return;
+    }
+#endif
+    release_device(dev);
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    if (!l_hapticInitialized && !SDL_WasInit(SDL_INIT_HAPTIC)) {
+        if (SDL_InitSubSystem(SDL_INIT_HAPTIC) == -1) {
+            DebugMessage(M64MSG_ERROR, "Couldn't init SDL haptic subsystem: %s", SDL_GetError() );
+            return;
+        }
+        l_hapticInitialized = 1;
+    }
+#endif
+
+    dev->device = default_instance.controller[cntrl].device;
+    dev->playing = dev->weak_effect = dev->strong_effect = -1;
+    for (i = 0; i < RUMBLE_LEVELS; i++)
+        dev->level_effect[i] = -1;
+
+    start = trace_now();
+    if (!create_device(cntrl, dev))
+    {
+        trace_span("rumble_open", start, cntrl);
+        release_device(dev);
+        return;
+    }
+    trace_span("rumble_open", start, cntrl);
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    default_instance.controller[cntrl].event_joystick = dev->haptic;
+#else
+    default_instance.controller[cntrl].event_joystick = dev->fd;
+#endif
+    DebugMessage(M64MSG_INFO, "Rumble activated on N64 joystick #%i", cntrl + 1);
+#endif /* __linux__ */
+}
+
+void rumble_close(int cntrl)
+{
+    /* the device and its effects stay cached for the next RomOpen */
+#if SDL_VERSION_ATLEAST(2,0,0)
+    default_instance.controller[cntrl].event_joystick = NULL;
+#else
+    default_instance.controller[cntrl].event_joystick = 0;
+#endif
+}
+
+void rumble_release_all(void)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        release_device(&l_Devices[i]);
+        rumble_close(i);
+    }
+
+#if SDL_VERSION_ATLEAST(2,0,0)
+    /* quit the haptic subsystem if we started it */
+    if (l_hapticInitialized)
+        SDL_QuitSubSystem(SDL_INIT_HAPTIC);
+#endif
+    l_hapticInitialized = 0;
+}
+
@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - rumble.h                                      *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __RUMBLE_H__
+#define __RUMBLE_H__
+
+/* open/close the force feedback device belonging to controller[cntrl].device.  the device and
+ * its uploaded effects are cached until rumble_release_all() or until the port's device changes */
+extern void rumble_open(int cntrl);
+extern void rumble_close(int cntrl);
+extern void rumble_release_all(void);
+
+/* start/stop the worker thread which performs all the haptic device calls */
+extern void rumble_start_worker(void);
+extern void rumble_stop_worker(void);
+
+/* these only post a command for the worker thread, they never block */
+extern void rumble_set(int cntrl, int on);          // rumble pak motor on/off
+extern void rumble_pulse(int cntrl, int strong);    // short feedback when switching paks
+extern void rumble_stop(int cntrl);
+
+/* last motor state written by the game, for saving the plugin state; restored with rumble_set() */
+extern int rumble_get(int cntrl);
+
+/* the commands posted between these calls (from the emulation thread) wake the worker only once */
+extern void rumble_begin_batch(void);
+extern void rumble_end_batch(void);
+
+#endif /* __RUMBLE_H__ */
+
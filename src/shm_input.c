@@ -0,0 +1,276 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - shm_input.c                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "osal_atomic.h"
+#include "osal_preproc.h"
+#include "plugin.h"
+#include "shm_input.h"
+
+#if OSAL_HAVE_POSIX_IPC
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* a reader gives up on a slot which keeps changing under it after this many attempts */
+#define SHM_READ_RETRIES    16
+/* in lockstep mode, spin this many times before sleeping while waiting for the producer */
+#define SHM_SPIN_COUNT      2000
+
+/* static data definitions */
+static input_shm_header *l_Shm = NULL;
+static char         l_ShmName[256];
+static int          l_ShmCreated = 0;   // we created the object, so we remove it again
+static int          l_Lockstep = 0;
+static unsigned int l_TimeoutMs = 1000;
+
+static input_shm_frame l_Frame;         // the frame used for the current poll of the controllers
+static unsigned int l_LastPort = 4;
+static unsigned int l_Seen = 0;         // write_index at the last free-running read
+
+/* statistics, reported when the segment is closed */
+static unsigned int l_Frames = 0, l_Retries = 0, l_Waits = 0, l_Timeouts = 0;
+
+/* static functions */
+static void load_shm_config(void)
+{
+    m64p_handle pConfig;
+    int iValue;
+
+    l_ShmName[0] = 0;
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+
+    ConfigSetDefaultString(pConfig, "SharedMemoryName", "", "Name of a POSIX shared memory object through which another process can inject controller input (see input_ext.h). Empty to disable");
+    ConfigSetDefaultBool(pConfig, "SharedMemoryLockstep", 0, "If True, every frame from the shared memory producer is used for exactly one poll of the controllers, and the game waits for the producer");
+    ConfigSetDefaultInt(pConfig, "SharedMemoryTimeout", 1000, "Milliseconds to wait for the shared memory producer in lockstep mode before the last frame is reused");
+
+    if (ConfigGetParameter(pConfig, "SharedMemoryName", M64TYPE_STRING, l_ShmName, sizeof(l_ShmName)) != M64ERR_SUCCESS)
+        l_ShmName[0] = 0;
+    if (ConfigGetParameter(pConfig, "SharedMemoryLockstep", M64TYPE_BOOL, &iValue, sizeof(int)) == M64ERR_SUCCESS)
+        l_Lockstep = iValue;
+    if (ConfigGetParameter(pConfig, "SharedMemoryTimeout", M64TYPE_INT, &iValue, sizeof(int)) == M64ERR_SUCCESS && iValue >= 0)
+        l_TimeoutMs = (unsigned int) iValue;
+}
+
+/* seqlock read of one ring slot; returns 0 and leaves *out alone if the producer kept rewriting it */
+static int read_slot(unsigned int index, input_shm_frame *out)
+{
+    input_shm_frame *slot = &l_Shm->ring[index % INPUT_SHM_RING_SIZE];
+    input_shm_frame frame;
+    unsigned int seq, tries;
+
+    for (tries = 0; tries < SHM_READ_RETRIES; tries++)
+    {
+        seq = osal_atomic_load((volatile unsigned int *) &slot->seq);
+        if (!(seq & 1))
+        {
+            frame.frame = slot->frame;
+            frame.ports = slot->ports;
+            memcpy(frame.buttons, (const void *) slot->buttons, sizeof(frame.buttons));
+            osal_atomic_fence();
+            if (slot->seq == seq)
+            {
+                *out = frame;
+                return 1;
+            }
+        }
+        l_Retries++;
+    }
+
+    return 0;
+}
+
+static int wait_for_frame(unsigned int read_index)
+{
+    unsigned int start, spins = 0;
+
+    l_Waits++;
+    start = SDL_GetTicks();
+    while (osal_atomic_load((volatile unsigned int *) &l_Shm->write_index) == read_index)
+    {
+        unsigned int waited;
+
+        if (++spins < SHM_SPIN_COUNT)
+            continue;
+        waited = SDL_GetTicks() - start;
+        if (waited >= l_TimeoutMs)
+            return 0;
+        /* just yield at first (the producer may share our cpu), then sleep */
+        SDL_Delay(waited < 2 ? 0 : 1);
+    }
+
+    return 1;
+}
+
+/* a lockstep frame is only consumed once it has been read whole, so a slot which the producer keeps
+ * rewriting is waited for like one which hasn't been written yet */
+static int read_lockstep_slot(unsigned int read_index)
+{
+    unsigned int start = SDL_GetTicks();
+
+    while (!read_slot(read_index, &l_Frame))
+    {
+        unsigned int waited = SDL_GetTicks() - start;
+
+        if (waited >= l_TimeoutMs)
+            return 0;
+        SDL_Delay(waited < 2 ? 0 : 1);
+    }
+
+    return 1;
+}
+
+static void next_frame(void)
+{
+    unsigned int write_index = osal_atomic_load((volatile unsigned int *) &l_Shm->write_index);
+    unsigned int read_index = l_Shm->read_index;
+
+    if (l_Lockstep)
+    {
+        if (write_index == read_index && !wait_for_frame(read_index))
+        {
+            /* keep playing the last frame, the producer may have quit */
+            l_Timeouts++;
+            return;
+        }
+        if (!read_lockstep_slot(read_index))
+        {
+            /* the same frame is read again at the next poll */
+            l_Timeouts++;
+            return;
+        }
+        l_Frames++;
+        osal_atomic_store((volatile unsigned int *) &l_Shm->read_index, read_index + 1);
+        return;
+    }
+
+    /* free running: use the newest frame, if there is a new one; if it couldn't be read, the last
+     * frame stays in use and the newest one is tried again at the next poll */
+    if (write_index == l_Seen || !read_slot(write_index - 1, &l_Frame))
+        return;
+    l_Seen = write_index;
+    l_Frames++;
+    osal_atomic_store((volatile unsigned int *) &l_Shm->read_index, write_index);
+}
+
+/* global functions */
+void shm_input_open(void)
+{
+#if OSAL_HAVE_POSIX_IPC
+    input_shm_header *shm;
+    struct stat st;
+    int fd;
+
+    if (l_Shm != NULL)
+        return;
+
+    load_shm_config();
+    if (l_ShmName[0] == 0)
+        return;
+
+    l_ShmCreated = 0;
+    fd = shm_open(l_ShmName, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+        l_ShmCreated = 1;
+    else
+        fd = shm_open(l_ShmName, O_RDWR, 0);
+    if (fd < 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Couldn't open shared memory input '%s'", l_ShmName);
+        return;
+    }
+    if (fstat(fd, &st) != 0 || ((size_t) st.st_size < sizeof(input_shm_header) && ftruncate(fd, sizeof(input_shm_header)) != 0))
+    {
+        DebugMessage(M64MSG_ERROR, "Couldn't size shared memory input '%s'", l_ShmName);
+        close(fd);
+        return;
+    }
+
+    shm = (input_shm_header *) mmap(NULL, sizeof(input_shm_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == (input_shm_header *) MAP_FAILED)
+    {
+        DebugMessage(M64MSG_ERROR, "Couldn't map shared memory input '%s'", l_ShmName);
+        return;
+    }
+
+    if (shm->magic != INPUT_SHM_MAGIC || shm->version != INPUT_SHM_VERSION)
+    {
+        memset(shm, 0, sizeof(input_shm_header));
+        shm->ring_size = INPUT_SHM_RING_SIZE;
+        shm->version = INPUT_SHM_VERSION;
+        osal_atomic_store((volatile unsigned int *) &shm->magic, INPUT_SHM_MAGIC);
+    }
+    shm->lockstep = l_Lockstep;
+
+    memset(&l_Frame, 0, sizeof(l_Frame));
+    l_LastPort = 4;
+    l_Seen = shm->write_index;
+    if (!l_Lockstep)
+        shm->read_index = l_Seen;
+    l_Frames = l_Retries = l_Waits = l_Timeouts = 0;
+    l_Shm = shm;
+
+    DebugMessage(M64MSG_INFO, "Shared memory input '%s' attached%s", l_ShmName, l_Lockstep ? " (lockstep)" : "");
+#endif
+}
+
+void shm_input_close(void)
+{
+#if OSAL_HAVE_POSIX_IPC
+    if (l_Shm == NULL)
+        return;
+
+    DebugMessage(M64MSG_VERBOSE, "Shared memory input: %u frames read, %u slot retries, %u waits, %u timeouts",
+                 l_Frames, l_Retries, l_Waits, l_Timeouts);
+
+    munmap(l_Shm, sizeof(input_shm_header));
+    l_Shm = NULL;
+    if (l_ShmCreated)
+        shm_unlink(l_ShmName);
+#endif
+}
+
+void shm_input_apply(int Control, BUTTONS *Keys)
+{
+    if (l_Shm == NULL)
+        return;
+
+    if ((unsigned int) Control <= l_LastPort)
+        next_frame();
+    l_LastPort = (unsigned int) Control;
+
+    if (l_Frame.ports & (1u << Control))
+        Keys->Value = l_Frame.buttons[Control];
+}
+
@@ -0,0 +1,35 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - shm_input.h                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __SHM_INPUT_H__
+#define __SHM_INPUT_H__
+
+#include "m64p_plugin.h"
+
+/* attach to/detach from the shared memory segment named in the 'Input-SDL' config section */
+extern void shm_input_open(void);
+extern void shm_input_close(void);
+
+/* replaces the state of the port with the injected one, if the current frame drives this port.
+ * a call for a port number <= the one of the previous call starts a new frame */
+extern void shm_input_apply(int Control, BUTTONS *Keys);
+
+#endif /* __SHM_INPUT_H__ */
+
@@ -0,0 +1,359 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - tpak.c                                        *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_types.h"
+#include "osal_files.h"
+#include "pak_file.h"
+#include "plugin.h"
+#include "tpak.h"
+
+/* values of the transfer pak's access mode register (0xB000) */
+#define CART_NOT_INSERTED   0x40
+#define CART_ACCESS_MODE_0  0x80
+#define CART_ACCESS_MODE_1  0x89
+
+#define GB_ROM_BANK_SIZE    0x4000
+#define GB_RAM_BANK_SIZE    0x2000
+
+typedef enum
+{
+    MBC_NONE = 0,
+    MBC_1,
+    MBC_2,
+    MBC_3,
+    MBC_5
+} EMbcType;
+
+typedef struct
+{
+    /* transfer pak registers */
+    int              enabled;
+    int              bank;                  // which 16 KiB of the GB address space is visible at 0xC000
+    int              access_mode;
+    int              access_mode_changed;
+
+    /* Game Boy cartridge */
+    osal_mapped_file rom;
+    SPakFile         ram;                   // battery backed save RAM, if the cartridge has one
+    unsigned int     rom_banks;
+    unsigned int     ram_size;
+    EMbcType         mbc;
+    unsigned int     rom_bank;
+    unsigned int     ram_bank;
+    int              ram_enabled;
+    int              mbc1_mode;
+    unsigned char    rtc[5];                // MBC3 clock registers; stored but not counted
+} STransferPak;
+
+/* static data definitions */
+static STransferPak l_Tpak[4];
+
+/* static functions */
+static EMbcType get_mbc_type(unsigned char cart_type)
+{
+    switch (cart_type)
+    {
+        case 0x00: case 0x08: case 0x09:
+            return MBC_NONE;
+        case 0x01: case 0x02: case 0x03:
+            return MBC_1;
+        case 0x05: case 0x06:
+            return MBC_2;
+        case 0x0f: case 0x10: case 0x11: case 0x12: case 0x13:
+            return MBC_3;
+        case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e:
+            return MBC_5;
+        default:
+            DebugMessage(M64MSG_WARNING, "Unsupported Game Boy cartridge type 0x%02x, treating it as ROM only", cart_type);
+            return MBC_NONE;
+    }
+}
+
+static unsigned int get_ram_size(EMbcType mbc, unsigned char ram_type)
+{
+    static const unsigned int sizes[6] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+
+    if (mbc == MBC_2)
+        return 0x200;
+    return (ram_type < 6) ? sizes[ram_type] : 0;
+}
+
+/* the cartridge's battery RAM is saved next to the ROM unless 'TransferPakSav' says otherwise */
+static void default_sav_path(char *sav, size_t size, const char *rom)
+{
+    const char *dot = strrchr(rom, '.');
+    const char *sep = strrchr(rom, '/');
+    size_t len = strlen(rom);
+
+    if (strrchr(rom, '\\') > sep)
+        sep = strrchr(rom, '\\');
+    if (dot != NULL && (sep == NULL || dot > sep))
+        len = (size_t) (dot - rom);
+    snprintf(sav, size, "%.*s.sav", (int) len, rom);
+}
+
+static void mbc_write(STransferPak *tp, unsigned int gb_addr, unsigned char value)
+{
+    switch (tp->mbc)
+    {
+        case MBC_NONE:
+            break;
+        case MBC_1:
+            if (gb_addr < 0x2000)
+                tp->ram_enabled = ((value & 0x0f) == 0x0a);
+            else if (gb_addr < 0x4000)
+                tp->rom_bank = (tp->rom_bank & 0x60) | ((value & 0x1f) ? (value & 0x1f) : 1);
+            else if (gb_addr < 0x6000)
+            {
+                tp->rom_bank = (tp->rom_bank & 0x1f) | ((value & 0x03) << 5);
+                tp->ram_bank = value & 0x03;
+            }
+            else
+                tp->mbc1_mode = value & 0x01;
+            break;
+        case MBC_2:
+            /* address bit 8 selects between the RAM enable and ROM bank registers */
+            if (gb_addr >= 0x4000)
+                break;
+            if (gb_addr & 0x0100)
+                tp->rom_bank = (value & 0x0f) ? (value & 0x0f) : 1;
+            else
+                tp->ram_enabled = ((value & 0x0f) == 0x0a);
+            break;
+        case MBC_3:
+            if (gb_addr < 0x2000)
+                tp->ram_enabled = ((value & 0x0f) == 0x0a);
+            else if (gb_addr < 0x4000)
+                tp->rom_bank = (value & 0x7f) ? (value & 0x7f) : 1;
+            else if (gb_addr < 0x6000)
+                tp->ram_bank = value & 0x0f;
+            /* 0x6000-0x7fff latches the clock, which is never running here */
+            break;
+        case MBC_5:
+            if (gb_addr < 0x2000)
+                tp->ram_enabled = ((value & 0x0f) == 0x0a);
+            else if (gb_addr < 0x3000)
+                tp->rom_bank = (tp->rom_bank & 0x100) | value;
+            else if (gb_addr < 0x4000)
+                tp->rom_bank = (tp->rom_bank & 0xff) | ((value & 0x01) << 8);
+            else if (gb_addr < 0x6000)
+                tp->ram_bank = value & 0x0f;
+            break;
+    }
+}
+
+/* offset into the save RAM for a GB address in 0xa000-0xbfff, or -1 if no RAM is visible there */
+static int ram_offset(const STransferPak *tp, unsigned int gb_addr)
+{
+    unsigned int bank;
+
+    if (!tp->ram_enabled || tp->ram.map.data == NULL)
+        return -1;
+
+    if (tp->mbc == MBC_2)
+        return (int) ((gb_addr - 0xa000) & 0x1ff);
+
+    bank = tp->ram_bank;
+    if (tp->mbc == MBC_1 && tp->mbc1_mode == 0)
+        bank = 0;
+    else if (tp->mbc == MBC_3 && bank >= 0x08)
+        return -1;
+    return (int) ((bank * GB_RAM_BANK_SIZE + (gb_addr - 0xa000)) % tp->ram_size);
+}
+
+/* the cartridge memory behind a 32 byte aligned GB address, or NULL if nothing drives the bus */
+static const unsigned char *gb_read_block(const STransferPak *tp, unsigned int gb_addr)
+{
+    int offset;
+
+    if (gb_addr < 0x4000)
+        return tp->rom.data + gb_addr;
+
+    if (gb_addr < 0x8000)
+        return tp->rom.data + (tp->rom_bank % tp->rom_banks) * GB_ROM_BANK_SIZE + (gb_addr - 0x4000);
+
+    if (gb_addr >= 0xa000 && gb_addr < 0xc000)
+    {
+        offset = ram_offset(tp, gb_addr);
+        if (offset >= 0)
+            return tp->ram.map.data + offset;
+    }
+
+    return NULL;
+}
+
+static void gb_read(STransferPak *tp, unsigned int gb_addr, unsigned char *data)
+{
+    const unsigned char *block = gb_read_block(tp, gb_addr);
+
+    if (block != NULL)
+        memcpy(data, block, 32);
+    else if (tp->mbc == MBC_3 && tp->ram_enabled && tp->ram_bank >= 0x08 && tp->ram_bank <= 0x0c &&
+             gb_addr >= 0xa000 && gb_addr < 0xc000)
+        memset(data, tp->rtc[tp->ram_bank - 0x08], 32);
+    else
+        memset(data, 0xff, 32);
+}
+
+static void gb_write(STransferPak *tp, unsigned int gb_addr, const unsigned char *data)
+{
+    int offset;
+
+    /* games fill the whole block with the register value */
+    if (gb_addr < 0x8000)
+        mbc_write(tp, gb_addr, data[31]);
+    else if (gb_addr >= 0xa000 && gb_addr < 0xc000)
+    {
+        offset = ram_offset(tp, gb_addr);
+        if (offset >= 0)
+            pak_file_write(&tp->ram, (size_t) offset, data, 32);
+        else if (tp->mbc == MBC_3 && tp->ram_enabled && tp->ram_bank >= 0x08 && tp->ram_bank <= 0x0c)
+            tp->rtc[tp->ram_bank - 0x08] = data[31];
+    }
+}
+
+/* global functions */
+void tpak_open(int cntrl)
+{
+    STransferPak *tp = &l_Tpak[cntrl];
+    char SectionName[32];
+    char RomPath[1024], SavPath[1024];
+    m64p_handle pConfig;
+
+    tpak_close(cntrl);
+    tp->access_mode = CART_NOT_INSERTED;
+
+    sprintf(SectionName, "Input-SDL-Control%i", cntrl + 1);
+    if (ConfigOpenSection(SectionName, &pConfig) != M64ERR_SUCCESS)
+        return;
+    if (ConfigGetParameter(pConfig, "TransferPakROM", M64TYPE_STRING, RomPath, sizeof(RomPath)) != M64ERR_SUCCESS || RomPath[0] == 0)
+        return;
+    if (ConfigGetParameter(pConfig, "TransferPakSav", M64TYPE_STRING, SavPath, sizeof(SavPath)) != M64ERR_SUCCESS || SavPath[0] == 0)
+        default_sav_path(SavPath, sizeof(SavPath), RomPath);
+
+    if (!osal_file_map_readonly(&tp->rom, RomPath))
+    {
+        DebugMessage(M64MSG_WARNING, "Couldn't open Game Boy ROM '%s' for transfer pak #%i", RomPath, cntrl + 1);
+        return;
+    }
+    if (tp->rom.size < 2 * GB_ROM_BANK_SIZE)
+    {
+        DebugMessage(M64MSG_WARNING, "'%s' is too small to be a Game Boy ROM", RomPath);
+        osal_file_unmap(&tp->rom);
+        return;
+    }
+
+    tp->rom_banks = (unsigned int) (tp->rom.size / GB_ROM_BANK_SIZE);
+    tp->mbc = get_mbc_type(tp->rom.data[0x147]);
+    tp->ram_size = get_ram_size(tp->mbc, tp->rom.data[0x149]);
+    tp->rom_bank = 1;
+
+    if (tp->ram_size > 0)
+    {
+        /* a new save reads back as zeros, like a cartridge whose battery has been replaced */
+        if (!pak_file_open(&tp->ram, SavPath, tp->ram_size))
+            DebugMessage(M64MSG_WARNING, "Couldn't open Game Boy save '%s', the cartridge will have no RAM", SavPath);
+    }
+
+    tp->access_mode = CART_ACCESS_MODE_0;
+    tp->access_mode_changed = 0x44;
+    DebugMessage(M64MSG_INFO, "Transfer pak #%i: '%.16s' (type 0x%02x, %u KiB ROM, %u KiB RAM)", cntrl + 1,
+                 (const char *) tp->rom.data + 0x134, tp->rom.data[0x147], tp->rom_banks * 16, tp->ram_size / 1024);
+}
+
+void tpak_close(int cntrl)
+{
+    STransferPak *tp = &l_Tpak[cntrl];
+
+    pak_file_close(&tp->ram);
+    osal_file_unmap(&tp->rom);
+    memset(tp, 0, sizeof(STransferPak));
+}
+
+void tpak_read(int cntrl, unsigned int address, unsigned char *data)
+{
+    STransferPak *tp = &l_Tpak[cntrl];
+
+    switch (address >> 12)
+    {
+        case 0x8:
+            memset(data, tp->enabled ? 0x84 : 0x00, 32);
+            break;
+        case 0xb:
+            if (!tp->enabled)
+            {
+                memset(data, 0x00, 32);
+                break;
+            }
+            memset(data, tp->access_mode, 32);
+            if (tp->access_mode != CART_NOT_INSERTED)
+                data[0] |= tp->access_mode_changed;
+            tp->access_mode_changed = 0;
+            break;
+        case 0xc: case 0xd: case 0xe: case 0xf:
+            if (tp->enabled && tp->rom.data != NULL)
+                gb_read(tp, address - 0xc000 + tp->bank * GB_ROM_BANK_SIZE, data);
+            else
+                memset(data, 0x00, 32);
+            break;
+        default:
+            memset(data, 0x00, 32);
+            break;
+    }
+}
+
+void tpak_write(int cntrl, unsigned int address, const unsigned char *data)
+{
+    STransferPak *tp = &l_Tpak[cntrl];
+    unsigned char value = data[31];
+
+    switch (address >> 12)
+    {
+        case 0x8:
+            if (value == 0xfe)
+                tp->enabled = 0;
+            else if (value == 0x84)
+                tp->enabled = 1;
+            break;
+        case 0xa:
+            if (tp->enabled)
+                tp->bank = value & 0x03;
+            break;
+        case 0xb:
+            if (tp->enabled && tp->rom.data != NULL)
+            {
+                tp->access_mode = (value & 0x01) ? CART_ACCESS_MODE_1 : CART_ACCESS_MODE_0;
+                tp->access_mode_changed = 0x04;
+            }
+            break;
+        case 0xc: case 0xd: case 0xe: case 0xf:
+            if (tp->enabled && tp->rom.data != NULL)
+                gb_write(tp, address - 0xc000 + tp->bank * GB_ROM_BANK_SIZE, data);
+            break;
+    }
+}
+
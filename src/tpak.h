@@ -0,0 +1,34 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - tpak.h                                        *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __TPAK_H__
+#define __TPAK_H__
+
+/* the plugin's transfer pak, used for ports in RawData mode.  the Game Boy cartridge comes from the
+ * 'TransferPakROM' and 'TransferPakSav' parameters of the port's config section */
+extern void tpak_open(int cntrl);
+extern void tpak_close(int cntrl);
+
+/* 32 byte block transfers for RD_READPAK/RD_WRITEPAK; the caller computes the data CRC */
+extern void tpak_read(int cntrl, unsigned int address, unsigned char *data);
+extern void tpak_write(int cntrl, unsigned int address, const unsigned char *data);
+
+#endif /* __TPAK_H__ */
+
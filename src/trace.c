@@ -0,0 +1,288 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - trace.c                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef M64P_STATIC_PLUGINS
+#define M64P_CORE_PROTOTYPES 1
+#endif
+#include "m64p_config.h"
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "osal_atomic.h"
+#include "osal_preproc.h"
+#include "plugin.h"
+#include "trace.h"
+
+#define TRACE_MAX_THREADS   16
+#define TRACE_EVENTS        65536   // per thread, about 1.5 MB
+
+typedef struct
+{
+    const char  *name;
+    Uint64       start;
+    Uint32       duration;          // performance counter ticks
+    int          arg;
+} STraceEvent;
+
+/* the spans of one thread.  the owner appends, trace_flush() writes out [flushed, count); a full buffer is only
+ * emptied by its owner, under l_FlushLock, once all of it has been written.  a buffer goes to another thread
+ * once its owner has exited and all of it has been written */
+typedef struct
+{
+    unsigned long thread_id;
+    volatile unsigned int count;
+    unsigned int flushed;
+    volatile unsigned int dropped;  // bumped by the owner without the lock, taken by trace_flush()
+    int          released;          // the owner called trace_thread_exit()
+    STraceEvent  event[TRACE_EVENTS];
+} STraceBuffer;
+
+static int           l_Enabled = 0;
+static char          l_Path[256];
+static FILE         *l_File = NULL;
+static Uint64        l_Origin = 0;          // performance counter at time 0 of the trace
+static double        l_UsecPerTick = 0.0;
+static SDL_mutex    *l_FlushLock = NULL;
+
+static STraceBuffer *l_Buffers[TRACE_MAX_THREADS];
+static unsigned int  l_NumBuffers = 0;      // under l_FlushLock
+static volatile unsigned int l_Lost = 0;    // spans of threads which didn't get a buffer
+static unsigned int  l_Session = 1;         // bumped by trace_stop(), so that the threads drop their old buffer
+static osal_thread_local STraceBuffer *l_ThreadBuffer = NULL;
+static osal_thread_local unsigned int l_ThreadSession = 0;
+
+/* static functions */
+/* the buffer of the calling thread, NULL if it couldn't get one.  a thread takes over the buffer of an exited
+ * thread with the same id (the os reuses them) or any released buffer which has been written out, so that the
+ * threads started for every rom don't use up the slots */
+static STraceBuffer *thread_buffer(void)
+{
+    unsigned long thread_id;
+    STraceBuffer *buffer = NULL;
+    unsigned int b;
+
+    if (l_ThreadSession == l_Session)
+        return l_ThreadBuffer;
+
+    thread_id = (unsigned long) SDL_ThreadID();
+    SDL_LockMutex(l_FlushLock);
+    for (b = 0; b < l_NumBuffers && buffer == NULL; b++)
+    {
+        if (l_Buffers[b]->thread_id == thread_id)
+            buffer = l_Buffers[b];
+    }
+    for (b = 0; b < l_NumBuffers && buffer == NULL; b++)
+    {
+        if (l_Buffers[b]->released && l_Buffers[b]->flushed == l_Buffers[b]->count)
+        {
+            buffer = l_Buffers[b];
+            buffer->count = buffer->flushed = 0;
+        }
+    }
+    if (buffer == NULL && l_NumBuffers < TRACE_MAX_THREADS)
+    {
+        buffer = (STraceBuffer *) malloc(sizeof(STraceBuffer));
+        if (buffer != NULL)
+        {
+            buffer->count = buffer->flushed = buffer->dropped = 0;
+            l_Buffers[l_NumBuffers++] = buffer;
+        }
+    }
+    if (buffer != NULL)
+    {
+        buffer->thread_id = thread_id;
+        buffer->released = 0;
+    }
+    SDL_UnlockMutex(l_FlushLock);
+
+    l_ThreadBuffer = buffer;
+    l_ThreadSession = l_Session;
+    return buffer;
+}
+
+static int open_file(void)
+{
+    if (l_File != NULL)
+        return 1;
+
+    l_File = fopen(l_Path, "w");
+    if (l_File == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Trace: couldn't create '%s'", l_Path);
+        l_Enabled = 0;
+        return 0;
+    }
+    /* the closing ']' is optional in the trace-event format, so that the file can be read before trace_stop() */
+    fprintf(l_File, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"mupen64plus-input-sdl\"}}");
+    return 1;
+}
+
+/* global functions */
+void trace_start(Uint64 Origin)
+{
+    m64p_handle pConfig;
+    const char *path;
+
+    if (l_Enabled)
+        return;
+    if (ConfigOpenSection("Input-SDL", &pConfig) != M64ERR_SUCCESS)
+        return;
+    ConfigSetDefaultString(pConfig, "TraceFile", "", "Path of a Chrome trace-event JSON file (chrome://tracing, Perfetto) into which the time spent by the plugin is written when a rom is closed.  Empty for none");
+    path = ConfigGetParamString(pConfig, "TraceFile");
+    if (path == NULL || path[0] == 0)
+        return;
+
+    if (l_FlushLock == NULL)
+        l_FlushLock = SDL_CreateMutex();
+    if (l_FlushLock == NULL)
+        return;
+
+    strncpy(l_Path, path, sizeof(l_Path) - 1);
+    l_Path[sizeof(l_Path) - 1] = 0;
+    l_Origin = Origin;
+    l_UsecPerTick = 1000000.0 / (double) SDL_GetPerformanceFrequency();
+    l_Enabled = 1;
+    DebugMessage(M64MSG_INFO, "Trace: recording into '%s'", l_Path);
+}
+
+void trace_flush(void)
+{
+    unsigned int b, i, count, dropped = 0, written = 0;
+
+    if (!l_Enabled)
+        return;
+
+    SDL_LockMutex(l_FlushLock);
+    if (open_file())
+    {
+        for (b = 0; b < l_NumBuffers; b++)
+        {
+            STraceBuffer *buffer = l_Buffers[b];
+
+            count = osal_atomic_load(&buffer->count);
+            for (i = buffer->flushed; i < count; i++)
+            {
+                const STraceEvent *e = &buffer->event[i];
+
+                fprintf(l_File, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f",
+                        e->name, buffer->thread_id, (double) (Sint64) (e->start - l_Origin) * l_UsecPerTick,
+                        (double) e->duration * l_UsecPerTick);
+                if (e->arg != -1)
+                    fprintf(l_File, ",\"args\":{\"value\":%i}", e->arg);
+                fputc('}', l_File);
+            }
+            written += count - buffer->flushed;
+            buffer->flushed = count;
+            dropped += osal_atomic_fetch_and(&buffer->dropped, 0);
+        }
+        fflush(l_File);
+        DebugMessage(M64MSG_VERBOSE, "Trace: %u spans written", written);
+        if (dropped != 0)
+            DebugMessage(M64MSG_WARNING, "Trace: %u spans were dropped because the buffer of their thread was full", dropped);
+        dropped = osal_atomic_fetch_and(&l_Lost, 0);
+        if (dropped != 0)
+            DebugMessage(M64MSG_WARNING, "Trace: %u spans were dropped because more than %i threads recorded spans", dropped, TRACE_MAX_THREADS);
+    }
+    SDL_UnlockMutex(l_FlushLock);
+}
+
+void trace_stop(void)
+{
+    unsigned int b;
+
+    if (!l_Enabled)
+        return;
+
+    trace_flush();
+    l_Enabled = 0;
+    if (l_File != NULL)
+    {
+        fprintf(l_File, "\n]\n");
+        fclose(l_File);
+        l_File = NULL;
+    }
+
+    for (b = 0; b < TRACE_MAX_THREADS; b++)
+    {
+        free(l_Buffers[b]);
+        l_Buffers[b] = NULL;
+    }
+    l_NumBuffers = 0;
+    l_Session++;
+}
+
+void trace_thread_exit(void)
+{
+    if (l_ThreadSession != l_Session || l_ThreadBuffer == NULL)
+        return;
+
+    SDL_LockMutex(l_FlushLock);
+    l_ThreadBuffer->released = 1;
+    SDL_UnlockMutex(l_FlushLock);
+    l_ThreadBuffer = NULL;
+    l_ThreadSession = 0;
+}
+
+Uint64 trace_now(void)
+{
+    return l_Enabled ? SDL_GetPerformanceCounter() : 0;
+}
+
+void trace_span(const char *Name, Uint64 Start, int Arg)
+{
+    STraceBuffer *buffer;
+    STraceEvent *e;
+    unsigned int count;
+
+    if (!l_Enabled || Start == 0)
+        return;
+    buffer = thread_buffer();
+    if (buffer == NULL)
+    {
+        osal_atomic_fetch_add(&l_Lost, 1);
+        return;
+    }
+
+    count = buffer->count;
+    if (count == TRACE_EVENTS)
+    {
+        /* the buffer can be used again once all of it was written out */
+        SDL_LockMutex(l_FlushLock);
+        if (buffer->flushed == count)
+            buffer->count = buffer->flushed = count = 0;
+        SDL_UnlockMutex(l_FlushLock);
+        if (count == TRACE_EVENTS)
+        {
+            osal_atomic_fetch_add(&buffer->dropped, 1);
+            return;
+        }
+    }
+
+    e = &buffer->event[count];
+    e->name = Name;
+    e->start = Start;
+    e->duration = (Uint32) (SDL_GetPerformanceCounter() - Start);
+    e->arg = Arg;
+    osal_atomic_store(&buffer->count, count + 1);
+}
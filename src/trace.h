@@ -0,0 +1,49 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - trace.h                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <SDL.h>
+
+/* timed spans of the plugin's work, written as a Chrome trace-event JSON file (chrome://tracing, Perfetto) if
+ * 'TraceFile' is set in the 'Input-SDL' config section.  each thread records into its own buffer, which is only
+ * written out by trace_flush() */
+
+/* reads the config and enables the recording; 'Origin' (performance counter) is the time 0 of the trace */
+extern void trace_start(Uint64 Origin);
+
+/* writes the recorded spans of all threads to the file; the threads which record spans mustn't be running */
+extern void trace_flush(void);
+
+/* writes the rest, finishes the file and frees the buffers */
+extern void trace_stop(void);
+
+/* called by a thread of the plugin before it exits, so that its buffer can be taken by a later thread */
+extern void trace_thread_exit(void);
+
+/* the start time of a span, 0 if the recording is disabled */
+extern Uint64 trace_now(void);
+
+/* records a span from 'Start' (trace_now()) until now.  'Name' must be a string literal; 'Arg' is shown with the
+ * span unless it is -1 */
+extern void trace_span(const char *Name, Uint64 Start, int Arg);
+
+#endif /* __TRACE_H__ */
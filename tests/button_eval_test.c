@@ -0,0 +1,196 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - button_eval_test.c                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* checks the SSE2 and AVX2 button evaluators bit for bit against the scalar one, and the scalar one against
+ * the meaning of the bindings, with random programs and input values which hit the axis thresholds */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the vector evaluators are static, so the test is built together with the evaluator */
+#include "button_eval.c"
+
+#define PROGRAMS    200000
+
+typedef void (*ptr_Eval)(const SButtonProgram *prog, Uint16 Buttons[4]);
+
+/* static data definitions */
+static unsigned long long l_Random = 88172645463325252ULL;
+static SButtonProgram l_Prog;
+
+/* static functions */
+static unsigned int next_random(void)
+{
+    l_Random ^= l_Random << 13;
+    l_Random ^= l_Random >> 7;
+    l_Random ^= l_Random << 17;
+    return (unsigned int) l_Random;
+}
+
+/* is the input of binding b active with the value v, by the definition in button_eval.h */
+static int binding_active(const SBinding *b, Sint32 v)
+{
+    switch (b->type)
+    {
+        case BIND_JOY_AXIS_NEG:
+            return v <= b->param;
+        case BIND_JOY_AXIS_POS:
+            return v >= b->param;
+        case BIND_JOY_HAT:
+            return (v & b->param) != 0;
+        case BIND_MOUSE:
+            return (v & b->index) != 0;
+        default:
+            return v != 0;
+    }
+}
+
+static void random_binding(SBinding *b)
+{
+    static const Uint8 types[] = { BIND_KEY, BIND_JOY_BUTTON, BIND_JOY_AXIS_NEG, BIND_JOY_AXIS_POS, BIND_JOY_HAT, BIND_MOUSE };
+
+    b->type = types[next_random() % (sizeof(types) / sizeof(types[0]))];
+    b->target = next_random() % 16;
+    b->index = 1u << (next_random() % 8);
+    if (b->type == BIND_JOY_AXIS_NEG)
+        b->param = (Sint16) -(Sint32) (next_random() % 32769);
+    else if (b->type == BIND_JOY_AXIS_POS)
+        b->param = (Sint16) (next_random() % 32768);
+    else
+        b->param = (Sint16) (1 << (next_random() % 4));
+}
+
+/* axis values are mostly at, or one off, the threshold of the binding, or at the ends of the range */
+static Sint32 random_value(const SBinding *b)
+{
+    Sint32 v;
+
+    switch (b->type)
+    {
+        case BIND_JOY_AXIS_NEG:
+        case BIND_JOY_AXIS_POS:
+            switch (next_random() % 4)
+            {
+                case 0:  v = (Sint16) next_random(); break;
+                case 1:  v = b->param; break;
+                case 2:  v = b->param + ((next_random() & 1) ? 1 : -1); break;
+                default: v = (next_random() & 1) ? 32767 : -32768; break;
+            }
+            if (v > 32767)
+                v = 32767;
+            if (v < -32768)
+                v = -32768;
+            return v;
+        case BIND_JOY_HAT:
+            return next_random() % 16;
+        case BIND_MOUSE:
+            return next_random() % 256;
+        default:
+            return next_random() & 1;
+    }
+}
+
+/* global functions */
+void DebugMessage(int level, const char *message, ...)
+{
+    va_list args;
+
+    va_start(args, message);
+    vprintf(message, args);
+    va_end(args);
+    putchar('\n');
+}
+
+int main(void)
+{
+    static SBinding bind[4][MAX_BUTTON_BINDINGS];
+    const SBinding *bind_ptr[4] = { bind[0], bind[1], bind[2], bind[3] };
+    ptr_Eval eval[2] = { NULL, NULL };
+    const char *eval_name[2] = { "SSE2", "AVX2" };
+    long wrong_scalar = 0, wrong[2] = { 0, 0 };
+    unsigned int count[4];
+    long n;
+    int i;
+
+#if BUTTON_EVAL_X86
+    if (SDL_HasSSE2())
+        eval[0] = button_eval_sse2;
+#if SDL_VERSION_ATLEAST(2,0,4)
+    if (SDL_HasAVX2())
+        eval[1] = button_eval_avx2;
+#endif
+#endif
+
+    for (n = 0; n < PROGRAMS; n++)
+    {
+        Uint16 expected[4], scalar[4], vector[4];
+        int port;
+
+        /* from no bindings up to a full port, which has no padding */
+        for (port = 0; port < 4; port++)
+        {
+            count[port] = next_random() % (MAX_BUTTON_BINDINGS + 1);
+            for (i = 0; i < (int) count[port]; i++)
+                random_binding(&bind[port][i]);
+        }
+        button_eval_build(&l_Prog, bind_ptr, count);
+
+        for (port = 0; port < 4; port++)
+        {
+            unsigned int e;
+
+            expected[port] = 0;
+            for (e = l_Prog.start[port]; e < l_Prog.start[port] + l_Prog.count[port]; e++)
+            {
+                /* the padding entries have no source, and stay 0 */
+                if (e >= l_Prog.type_end[port][BIND_MOUSE])
+                    break;
+                l_Prog.value[e] = random_value(&l_Prog.source[e]);
+                if (binding_active(&l_Prog.source[e], l_Prog.value[e]))
+                    expected[port] |= 1u << l_Prog.source[e].target;
+            }
+        }
+
+        button_eval_scalar(&l_Prog, scalar);
+        if (memcmp(scalar, expected, sizeof(scalar)) != 0)
+            wrong_scalar++;
+        for (i = 0; i < 2; i++)
+        {
+            if (eval[i] == NULL)
+                continue;
+            (*eval[i])(&l_Prog, vector);
+            if (memcmp(vector, scalar, sizeof(vector)) != 0)
+                wrong[i]++;
+        }
+    }
+
+    printf("%ld random programs: scalar evaluator wrong %ld times\n", n, wrong_scalar);
+    for (i = 0; i < 2; i++)
+    {
+        if (eval[i] == NULL)
+            printf("%s evaluator: not supported by this cpu, skipped\n", eval_name[i]);
+        else
+            printf("%s evaluator: differs from the scalar one %ld times\n", eval_name[i], wrong[i]);
+    }
+
+    return (wrong_scalar != 0 || wrong[0] != 0 || wrong[1] != 0) ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - crc_bench.c                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* checks the CRC of the controller pak data which the plugin answers with against the bitwise CRC it used to
+ * compute, on random data, and times a whole write pak command.  the bitwise CRC and a copy of the plugin's
+ * table driven CRC are timed as well, for reference */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define CHECKS      100000
+#define ITERATIONS  2000000
+#define RUNS        5
+
+#define RD_WRITEPAK 0x03
+
+/* static data definitions */
+static unsigned char l_Table[256];
+static volatile unsigned char l_Sink;
+
+/* static functions */
+
+/* the CRC of the plugin before it had a table, bit by bit */
+static unsigned char bitwise_crc(const unsigned char *Data, int iLength)
+{
+    unsigned char Remainder = Data[0];
+    int iByte = 1;
+    unsigned char bBit = 0;
+
+    while (iByte <= iLength)
+    {
+        int HighBit = ((Remainder & 0x80) != 0);
+        Remainder = Remainder << 1;
+
+        Remainder += (iByte < iLength && Data[iByte] & (0x80 >> bBit)) ? 1 : 0;
+
+        Remainder ^= (HighBit) ? 0x85 : 0;
+
+        bBit++;
+        iByte += bBit / 8;
+        bBit %= 8;
+    }
+
+    return Remainder;
+}
+
+/* a reference copy of the table driven CRC in plugin.c, whose table can't be reached from here; the shipped
+ * code is only timed as part of the write pak command */
+static unsigned char table_crc(const unsigned char *Data, int iLength)
+{
+    unsigned char Remainder = 0;
+    int iByte;
+
+    for (iByte = 0; iByte < iLength; iByte++)
+        Remainder = l_Table[Remainder ^ Data[iByte]];
+    return Remainder;
+}
+
+static void build_table(void)
+{
+    int v, bit;
+
+    for (v = 0; v < 256; v++)
+    {
+        unsigned char r = (unsigned char) v;
+
+        for (bit = 0; bit < 8; bit++)
+            r = (unsigned char) ((r & 0x80) ? (r << 1) ^ 0x85 : r << 1);
+        l_Table[v] = r;
+    }
+}
+
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* best time of a few runs, in ns per call */
+static double time_crc(unsigned char (*crc)(const unsigned char *, int), unsigned char *data)
+{
+    double best = 1e9;
+    int run, i;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        double ns;
+
+        for (i = 0; i < ITERATIONS; i++)
+        {
+            data[i & 31] = (unsigned char) i;
+            l_Sink = (*crc)(data, 32);
+        }
+        ns = (now() - start) * 1e9 / ITERATIONS;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    ptr_InitiateControllers initiate;
+    ptr_ControllerCommand command;
+    ptr_RomOpen rom_open;
+    ptr_RomClosed rom_closed;
+    ptr_InputInstanceBind bind;
+    m64p_handle instance;
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    unsigned char pif[38], data[32];
+    long mismatches = 0, i;
+    double best = 1e9;
+    int run;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin\n", argv[0]);
+        return 2;
+    }
+
+    /* a headless instance answers the pak commands of a RawData port itself, without a pak file */
+    for (i = 0; i < 4; i++)
+        fake_core_keyboard_port((int) i);
+    fake_core_set("Input-SDL-Control1", "RawData", "True");
+    fake_core_start_plugin(argv[1]);
+    initiate = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    command = (ptr_ControllerCommand) fake_core_get("ControllerCommand");
+    rom_open = (ptr_RomOpen) fake_core_get("RomOpen");
+    rom_closed = (ptr_RomClosed) fake_core_get("RomClosed");
+    bind = (ptr_InputInstanceBind) fake_core_get("InputInstanceBind");
+    instance = (*(ptr_InputInstanceCreate) fake_core_get("InputInstanceCreate"))();
+    (*bind)(instance);
+    info.Controls = controls;
+    (*initiate)(info);
+    (*rom_open)();
+    if (!controls[0].RawData)
+    {
+        fprintf(stderr, "port 1 isn't in RawData mode\n");
+        return 2;
+    }
+
+    build_table();
+    srand(1);
+    for (i = 0; i < CHECKS; i++)
+    {
+        int b;
+
+        /* the first checks are the blocks with a single bit set */
+        for (b = 0; b < 32; b++)
+            data[b] = (i < 256) ? ((b == i / 8) ? (unsigned char) (0x80 >> (i % 8)) : 0) : (unsigned char) rand();
+        pif[0] = 35;
+        pif[1] = 1;
+        pif[2] = RD_WRITEPAK;
+        pif[3] = 0xC0;
+        pif[4] = 0x1B;
+        memcpy(&pif[5], data, 32);
+        (*command)(0, pif);
+        (*command)(-1, NULL);
+        if (pif[37] != bitwise_crc(data, 32) || table_crc(data, 32) != bitwise_crc(data, 32))
+            mismatches++;
+    }
+    printf("%i blocks of pak data: the plugin's CRC differs from the bitwise one %ld times\n", CHECKS, mismatches);
+
+    printf("bitwise CRC of 32 bytes:  %6.1f ns (reference, the plugin's old code)\n", time_crc(bitwise_crc, data));
+    printf("table CRC of 32 bytes:    %6.1f ns (reference, a copy of the plugin's code)\n", time_crc(table_crc, data));
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        double ns;
+
+        for (i = 0; i < ITERATIONS; i++)
+        {
+            pif[5 + (i & 31)] = (unsigned char) i;
+            (*command)(0, pif);
+            (*command)(-1, NULL);
+        }
+        ns = (now() - start) * 1e9 / ITERATIONS;
+        if (ns < best)
+            best = ns;
+    }
+    printf("write pak command:        %6.1f ns (through ControllerCommand(), with the input hash)\n", best);
+
+    (*rom_closed)();
+    (*bind)(NULL);
+    (*(ptr_InputInstanceDestroy) fake_core_get("InputInstanceDestroy"))(instance);
+    fake_core_stop_plugin();
+    return mismatches != 0;
+}
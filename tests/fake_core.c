@@ -0,0 +1,386 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - fake_core.c                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "m64p_common.h"
+#include "m64p_config.h"
+#include "m64p_types.h"
+#include "fake_core.h"
+#include "version.h"
+
+#define MAX_SECTIONS    16
+#define MAX_PARAMS      64
+#define MAX_VALUE       256
+
+#define CONFIG_VERSION  2.00        // of the controller sections, see config.h
+
+typedef struct
+{
+    char      name[64];
+    char      value[MAX_VALUE];
+    m64p_type type;
+} SParam;
+
+typedef struct
+{
+    char   name[64];
+    int    num_params;
+    SParam param[MAX_PARAMS];
+} SSection;
+
+/* static data definitions */
+static pthread_mutex_t l_Lock = PTHREAD_MUTEX_INITIALIZER;  // the plugin reads the config from every instance's thread
+static SSection     l_Section[MAX_SECTIONS];
+static int          l_NumSections = 0;
+static void        *l_Plugin = NULL;
+static unsigned int l_Messages[M64MSG_VERBOSE + 1];
+
+static const char *l_ButtonNames[] = {
+    "DPad R", "DPad L", "DPad D", "DPad U", "Start", "Z Trig", "B Button", "A Button",
+    "C Button R", "C Button L", "C Button D", "C Button U", "R Trig", "L Trig",
+    "Mempak switch", "Rumblepak switch", "X Axis", "Y Axis"
+};
+
+/* static functions */
+static SSection *find_section(const char *Name, int Create)
+{
+    int i;
+
+    for (i = 0; i < l_NumSections; i++)
+    {
+        if (strcmp(l_Section[i].name, Name) == 0)
+            return &l_Section[i];
+    }
+    if (!Create || l_NumSections == MAX_SECTIONS)
+        return NULL;
+    snprintf(l_Section[l_NumSections].name, sizeof(l_Section[0].name), "%s", Name);
+    l_Section[l_NumSections].num_params = 0;
+    return &l_Section[l_NumSections++];
+}
+
+static SParam *find_param(SSection *Section, const char *Name, int Create)
+{
+    int i;
+
+    if (Section == NULL)
+        return NULL;
+    for (i = 0; i < Section->num_params; i++)
+    {
+        if (strcmp(Section->param[i].name, Name) == 0)
+            return &Section->param[i];
+    }
+    if (!Create || Section->num_params == MAX_PARAMS)
+        return NULL;
+    snprintf(Section->param[Section->num_params].name, sizeof(Section->param[0].name), "%s", Name);
+    Section->param[Section->num_params].value[0] = 0;
+    Section->param[Section->num_params].type = M64TYPE_STRING;
+    return &Section->param[Section->num_params++];
+}
+
+static void set_value(SParam *Param, m64p_type Type, const void *Value)
+{
+    Param->type = Type;
+    switch (Type)
+    {
+        case M64TYPE_INT:
+            snprintf(Param->value, MAX_VALUE, "%i", *(const int *) Value);
+            break;
+        case M64TYPE_FLOAT:
+            snprintf(Param->value, MAX_VALUE, "%f", *(const float *) Value);
+            break;
+        case M64TYPE_BOOL:
+            snprintf(Param->value, MAX_VALUE, "%s", *(const int *) Value ? "True" : "False");
+            break;
+        default:
+            snprintf(Param->value, MAX_VALUE, "%s", (const char *) Value);
+            break;
+    }
+}
+
+static int get_bool(const char *Value)
+{
+    return strcasecmp(Value, "True") == 0 || atoi(Value) != 0;
+}
+
+static m64p_error set_default(m64p_handle Handle, const char *Name, m64p_type Type, const void *Value)
+{
+    SParam *param;
+
+    pthread_mutex_lock(&l_Lock);
+    param = find_param((SSection *) Handle, Name, 0);
+    if (param == NULL && (param = find_param((SSection *) Handle, Name, 1)) != NULL)
+        set_value(param, Type, Value);
+    pthread_mutex_unlock(&l_Lock);
+    return param != NULL ? M64ERR_SUCCESS : M64ERR_NO_MEMORY;
+}
+
+static void debug_callback(void *Context, int Level, const char *Message)
+{
+    static const char *names[] = { "", "Error", "Warning", "Info", "Status", "Verbose" };
+
+    if (Level < M64MSG_ERROR || Level > M64MSG_VERBOSE)
+        return;
+    __atomic_add_fetch(&l_Messages[Level], 1, __ATOMIC_RELAXED);
+    if (Level <= M64MSG_WARNING || getenv("TEST_VERBOSE") != NULL)
+        fprintf(stderr, "Input %s: %s\n", names[Level], Message);
+}
+
+/* the core functions which the plugin looks up */
+EXPORT m64p_error CALL CoreGetAPIVersions(int *ConfigVersion, int *DebugVersion, int *VidextVersion, int *ExtraVersion)
+{
+    if (ConfigVersion != NULL)
+        *ConfigVersion = CONFIG_API_VERSION;
+    if (DebugVersion != NULL)
+        *DebugVersion = 0x020001;
+    if (VidextVersion != NULL)
+        *VidextVersion = 0x030000;
+    if (ExtraVersion != NULL)
+        *ExtraVersion = 0;
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL ConfigOpenSection(const char *SectionName, m64p_handle *ConfigSectionHandle)
+{
+    SSection *section;
+
+    pthread_mutex_lock(&l_Lock);
+    section = find_section(SectionName, 1);
+    pthread_mutex_unlock(&l_Lock);
+    if (section == NULL)
+        return M64ERR_NO_MEMORY;
+    *ConfigSectionHandle = section;
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL ConfigDeleteSection(const char *SectionName)
+{
+    SSection *section;
+
+    pthread_mutex_lock(&l_Lock);
+    section = find_section(SectionName, 0);
+    if (section != NULL)
+        section->num_params = 0;
+    pthread_mutex_unlock(&l_Lock);
+    return section != NULL ? M64ERR_SUCCESS : M64ERR_INPUT_NOT_FOUND;
+}
+
+EXPORT m64p_error CALL ConfigListParameters(m64p_handle ConfigSectionHandle, void *context,
+                                            void (*ParameterListCallback)(void *context, const char *ParamName, m64p_type ParamType))
+{
+    SSection *section = (SSection *) ConfigSectionHandle;
+    int i;
+
+    for (i = 0; i < section->num_params; i++)
+        (*ParameterListCallback)(context, section->param[i].name, section->param[i].type);
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL ConfigSetParameter(m64p_handle ConfigSectionHandle, const char *ParamName, m64p_type ParamType, const void *ParamValue)
+{
+    SParam *param;
+
+    pthread_mutex_lock(&l_Lock);
+    param = find_param((SSection *) ConfigSectionHandle, ParamName, 1);
+    if (param != NULL)
+        set_value(param, ParamType, ParamValue);
+    pthread_mutex_unlock(&l_Lock);
+    return param != NULL ? M64ERR_SUCCESS : M64ERR_NO_MEMORY;
+}
+
+EXPORT m64p_error CALL ConfigGetParameter(m64p_handle ConfigSectionHandle, const char *ParamName, m64p_type ParamType, void *ParamValue, int MaxSize)
+{
+    m64p_error rval = M64ERR_SUCCESS;
+    SParam *param;
+
+    pthread_mutex_lock(&l_Lock);
+    param = find_param((SSection *) ConfigSectionHandle, ParamName, 0);
+    if (param == NULL)
+        rval = M64ERR_INPUT_NOT_FOUND;
+    else if (ParamType == M64TYPE_INT && MaxSize >= (int) sizeof(int))
+        *(int *) ParamValue = atoi(param->value);
+    else if (ParamType == M64TYPE_FLOAT && MaxSize >= (int) sizeof(float))
+        *(float *) ParamValue = (float) atof(param->value);
+    else if (ParamType == M64TYPE_BOOL && MaxSize >= (int) sizeof(int))
+        *(int *) ParamValue = get_bool(param->value);
+    else if (ParamType == M64TYPE_STRING && MaxSize > (int) strlen(param->value))
+        strcpy((char *) ParamValue, param->value);
+    else
+        rval = M64ERR_INPUT_INVALID;
+    pthread_mutex_unlock(&l_Lock);
+    return rval;
+}
+
+EXPORT m64p_error CALL ConfigSetDefaultInt(m64p_handle ConfigSectionHandle, const char *ParamName, int ParamValue, const char *ParamHelp)
+{
+    return set_default(ConfigSectionHandle, ParamName, M64TYPE_INT, &ParamValue);
+}
+
+EXPORT m64p_error CALL ConfigSetDefaultFloat(m64p_handle ConfigSectionHandle, const char *ParamName, float ParamValue, const char *ParamHelp)
+{
+    return set_default(ConfigSectionHandle, ParamName, M64TYPE_FLOAT, &ParamValue);
+}
+
+EXPORT m64p_error CALL ConfigSetDefaultBool(m64p_handle ConfigSectionHandle, const char *ParamName, int ParamValue, const char *ParamHelp)
+{
+    return set_default(ConfigSectionHandle, ParamName, M64TYPE_BOOL, &ParamValue);
+}
+
+EXPORT m64p_error CALL ConfigSetDefaultString(m64p_handle ConfigSectionHandle, const char *ParamName, const char *ParamValue, const char *ParamHelp)
+{
+    return set_default(ConfigSectionHandle, ParamName, M64TYPE_STRING, ParamValue);
+}
+
+EXPORT int CALL ConfigGetParamInt(m64p_handle ConfigSectionHandle, const char *ParamName)
+{
+    int value = 0;
+
+    ConfigGetParameter(ConfigSectionHandle, ParamName, M64TYPE_INT, &value, sizeof(int));
+    return value;
+}
+
+EXPORT float CALL ConfigGetParamFloat(m64p_handle ConfigSectionHandle, const char *ParamName)
+{
+    float value = 0.0f;
+
+    ConfigGetParameter(ConfigSectionHandle, ParamName, M64TYPE_FLOAT, &value, sizeof(float));
+    return value;
+}
+
+EXPORT int CALL ConfigGetParamBool(m64p_handle ConfigSectionHandle, const char *ParamName)
+{
+    int value = 0;
+
+    ConfigGetParameter(ConfigSectionHandle, ParamName, M64TYPE_BOOL, &value, sizeof(int));
+    return value;
+}
+
+/* the string stays valid as long as the parameter isn't changed */
+EXPORT const char * CALL ConfigGetParamString(m64p_handle ConfigSectionHandle, const char *ParamName)
+{
+    SParam *param;
+
+    pthread_mutex_lock(&l_Lock);
+    param = find_param((SSection *) ConfigSectionHandle, ParamName, 0);
+    pthread_mutex_unlock(&l_Lock);
+    return param != NULL ? param->value : "";
+}
+
+EXPORT const char * CALL ConfigGetSharedDataFilepath(const char *filename)
+{
+    return NULL;
+}
+
+EXPORT const char * CALL ConfigGetUserConfigPath(void)
+{
+    return "/tmp/";
+}
+
+EXPORT const char * CALL ConfigGetUserDataPath(void)
+{
+    return "/tmp/";
+}
+
+EXPORT const char * CALL ConfigGetUserCachePath(void)
+{
+    return "/tmp/";
+}
+
+/* global functions */
+void fake_core_set(const char *Section, const char *Name, const char *Value)
+{
+    m64p_handle section;
+
+    if (ConfigOpenSection(Section, &section) != M64ERR_SUCCESS ||
+        ConfigSetParameter(section, Name, M64TYPE_STRING, Value) != M64ERR_SUCCESS)
+    {
+        fprintf(stderr, "fake core: config table full at %s/%s\n", Section, Name);
+        exit(2);
+    }
+}
+
+void fake_core_keyboard_port(int Control)
+{
+    char section[32];
+    char version[16];
+    int i;
+
+    snprintf(section, sizeof(section), "Input-SDL-Control%i", Control + 1);
+    snprintf(version, sizeof(version), "%f", CONFIG_VERSION);
+    fake_core_set(section, "version", version);
+    fake_core_set(section, "mode", "0");
+    fake_core_set(section, "device", "-1");
+    fake_core_set(section, "plugged", "True");
+    fake_core_set(section, "plugin", "2");
+    for (i = 0; i < (int) (sizeof(l_ButtonNames) / sizeof(l_ButtonNames[0])); i++)
+        fake_core_set(section, l_ButtonNames[i], "");
+}
+
+void fake_core_start_plugin(const char *Path)
+{
+    ptr_PluginStartup startup;
+    void *core;
+
+    l_Plugin = dlopen(Path, RTLD_NOW | RTLD_LOCAL);
+    if (l_Plugin == NULL)
+    {
+        fprintf(stderr, "fake core: couldn't load %s: %s\n", Path, dlerror());
+        exit(2);
+    }
+    startup = (ptr_PluginStartup) fake_core_get("PluginStartup");
+    /* the config functions are looked up in the test program itself */
+    core = dlopen(NULL, RTLD_NOW);
+    if ((*startup)(core, NULL, debug_callback) != M64ERR_SUCCESS)
+    {
+        fprintf(stderr, "fake core: PluginStartup() failed\n");
+        exit(2);
+    }
+}
+
+void fake_core_stop_plugin(void)
+{
+    ptr_PluginShutdown shutdown = (ptr_PluginShutdown) fake_core_get("PluginShutdown");
+
+    (*shutdown)();
+    dlclose(l_Plugin);
+    l_Plugin = NULL;
+}
+
+void *fake_core_get(const char *Name)
+{
+    void *function = dlsym(l_Plugin, Name);
+
+    if (function == NULL)
+    {
+        fprintf(stderr, "fake core: the plugin has no function %s\n", Name);
+        exit(2);
+    }
+    return function;
+}
+
+unsigned int fake_core_messages(m64p_msg_level Level)
+{
+    return __atomic_load_n(&l_Messages[Level], __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,46 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - fake_core.h                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __FAKE_CORE_H__
+#define __FAKE_CORE_H__
+
+#include "m64p_types.h"
+
+/* a stand-in for the mupen64plus core, so that the tests can load the plugin like a front-end does: the config
+ * functions work on a table in memory, and the plugin's messages are counted by level.  the test program must
+ * be linked with -rdynamic, because the plugin looks up the config functions in the program */
+
+/* sets a config parameter; the values are kept as strings and converted when they are read */
+extern void fake_core_set(const char *Section, const char *Name, const char *Value);
+
+/* configures port Control (0-3) as a keyboard controller with a mempak and no key bindings */
+extern void fake_core_keyboard_port(int Control);
+
+/* loads the plugin from Path and calls its PluginStartup(); exits the test if that fails */
+extern void fake_core_start_plugin(const char *Path);
+extern void fake_core_stop_plugin(void);
+
+/* looks up a function of the plugin; exits the test if it is missing */
+extern void *fake_core_get(const char *Name);
+
+/* messages which the plugin sent at the given level, M64MSG_ERROR to M64MSG_VERBOSE */
+extern unsigned int fake_core_messages(m64p_msg_level Level);
+
+#endif /* __FAKE_CORE_H__ */
@@ -0,0 +1,202 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - getkeys_bench.c                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* times GetKeys() on the default instance with nothing changing: the first port of a frame samples the
+ * devices, the later ports of the frame are built from the same sample.  then times GetAllKeys() on the
+ * default instance and on a headless one, with nothing changing and with a button and a stick key of port 1
+ * changing every frame */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define ITERATIONS  1000000
+#define RUNS        5
+
+/* scancodes of the keys of DPad R and X Axis left on port 1 */
+#define SCANCODE_A  4
+#define SCANCODE_K  14
+
+/* static data definitions */
+static ptr_GetKeys     l_GetKeys;
+static ptr_GetAllKeys  l_GetAllKeys;
+static ptr_SDL_KeyDown l_KeyDown;
+static ptr_SDL_KeyUp   l_KeyUp;
+
+/* keysyms which the plugin converts to scancodes: letters, digits, keypad and arrows */
+static const int l_Keysyms[] = {
+    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't',
+    'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+    256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267, 268, 269, 270, 271, 273, 274, 275, 276
+};
+
+static const char *l_Buttons[] = {
+    "DPad R", "DPad L", "DPad D", "DPad U", "Start", "Z Trig", "B Button", "A Button", "R Trig", "L Trig"
+};
+
+/* static functions */
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* best time of a few runs, in ns per frame which polls the ports 0 to Ports - 1 */
+static double time_frames(int Ports)
+{
+    BUTTONS keys;
+    double best = 1e9;
+    int run, i, port;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        double ns;
+
+        for (i = 0; i < ITERATIONS; i++)
+            for (port = 0; port < Ports; port++)
+                (*l_GetKeys)(port, &keys);
+        ns = (now() - start) * 1e9 / ITERATIONS;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/* best time of a few runs, in ns per GetAllKeys() */
+static double time_all_keys(int Changing)
+{
+    BUTTONS keys[4];
+    double best = 1e9;
+    int run, i;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        double ns;
+
+        for (i = 0; i < ITERATIONS; i++)
+        {
+            if (Changing)
+            {
+                if (i & 1)
+                {
+                    (*l_KeyUp)(0, SCANCODE_A);
+                    (*l_KeyUp)(0, SCANCODE_K);
+                }
+                else
+                {
+                    (*l_KeyDown)(0, SCANCODE_A);
+                    (*l_KeyDown)(0, SCANCODE_K);
+                }
+            }
+            (*l_GetAllKeys)(keys);
+        }
+        ns = (now() - start) * 1e9 / ITERATIONS;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+static void print_all_keys(const char *Instance)
+{
+    double steady = time_all_keys(0);
+    double changing = time_all_keys(1);
+
+    printf("GetAllKeys(), %-9s instance:   %6.1f ns, %6.1f ns with 2 keys changing\n", Instance, steady, changing);
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    ptr_InitiateControllers initiate;
+    ptr_RomOpen rom_open;
+    ptr_RomClosed rom_closed;
+    ptr_InputInstanceBind bind;
+    m64p_handle instance;
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    double first, frame;
+    int port, b, k = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin\n", argv[0]);
+        return 2;
+    }
+
+    /* 10 buttons and both stick axes on keys, on all 4 ports */
+    for (port = 0; port < 4; port++)
+    {
+        char section[32], value[32];
+
+        fake_core_keyboard_port(port);
+        snprintf(section, sizeof(section), "Input-SDL-Control%i", port + 1);
+        for (b = 0; b < (int) (sizeof(l_Buttons) / sizeof(l_Buttons[0])); b++)
+        {
+            snprintf(value, sizeof(value), "key(%i)", l_Keysyms[k++]);
+            fake_core_set(section, l_Buttons[b], value);
+        }
+        snprintf(value, sizeof(value), "key(%i,%i)", l_Keysyms[k], l_Keysyms[k + 1]);
+        fake_core_set(section, "X Axis", value);
+        snprintf(value, sizeof(value), "key(%i,%i)", l_Keysyms[k + 2], l_Keysyms[k + 3]);
+        fake_core_set(section, "Y Axis", value);
+        k += 4;
+    }
+    fake_core_start_plugin(argv[1]);
+    initiate = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    rom_open = (ptr_RomOpen) fake_core_get("RomOpen");
+    rom_closed = (ptr_RomClosed) fake_core_get("RomClosed");
+    l_GetKeys = (ptr_GetKeys) fake_core_get("GetKeys");
+    l_GetAllKeys = (ptr_GetAllKeys) fake_core_get("GetAllKeys");
+    l_KeyDown = (ptr_SDL_KeyDown) fake_core_get("SDL_KeyDown");
+    l_KeyUp = (ptr_SDL_KeyUp) fake_core_get("SDL_KeyUp");
+    bind = (ptr_InputInstanceBind) fake_core_get("InputInstanceBind");
+    info.Controls = controls;
+    (*initiate)(info);
+    (*rom_open)();
+
+    first = time_frames(1);
+    frame = time_frames(4);
+    printf("GetKeys(), first port of a frame:     %6.1f ns\n", first);
+    printf("GetKeys(), later ports:               %6.1f ns\n", (frame - first) / 3);
+    printf("GetKeys() for 4 ports:                %6.1f ns per frame\n", frame);
+    print_all_keys("default");
+    (*rom_closed)();
+
+    instance = (*(ptr_InputInstanceCreate) fake_core_get("InputInstanceCreate"))();
+    (*bind)(instance);
+    (*initiate)(info);
+    (*rom_open)();
+    print_all_keys("headless");
+    (*rom_closed)();
+    (*bind)(NULL);
+    (*(ptr_InputInstanceDestroy) fake_core_get("InputInstanceDestroy"))(instance);
+    fake_core_stop_plugin();
+    return 0;
+}
@@ -0,0 +1,220 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - instances_test.c                              *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* runs the same input on the default instance and on N headless instances, each driven by its own thread,
+ * and checks that every instance returns the same buttons and input hash.  also checks that ResetInputStats()
+ * on one instance leaves the statistics of the others alone, and that an instance which is still bound on
+ * another thread isn't destroyed */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define DEFAULT_FRAMES  200000
+#define DEFAULT_THREADS 8
+
+typedef struct
+{
+    m64p_handle  instance;
+    uint64_t     hash;
+    unsigned int frames;
+    long         errors;
+} SJob;
+
+/* static data definitions */
+static ptr_InitiateControllers  l_InitiateControllers;
+static ptr_RomOpen              l_RomOpen;
+static ptr_RomClosed            l_RomClosed;
+static ptr_SDL_KeyDown          l_KeyDown;
+static ptr_SDL_KeyUp            l_KeyUp;
+static ptr_GetAllKeys           l_GetAllKeys;
+static ptr_GetInputHash         l_GetInputHash;
+static ptr_GetInputStats        l_GetInputStats;
+static ptr_ResetInputStats      l_ResetInputStats;
+static ptr_InputInstanceCreate  l_InstanceCreate;
+static ptr_InputInstanceDestroy l_InstanceDestroy;
+static ptr_InputInstanceBind    l_InstanceBind;
+
+static long l_Frames = DEFAULT_FRAMES;
+static pthread_barrier_t l_Bound, l_Destroyed;
+
+/* static functions */
+
+/* key a+i presses A on port i, one port per frame; port 0 has 2 frames of input delay */
+static void run_game(SJob *job)
+{
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    BUTTONS keys[4];
+    long frame;
+    int port;
+
+    info.Controls = controls;
+    (*l_InitiateControllers)(info);
+    (*l_RomOpen)();
+    job->errors = 0;
+    for (frame = 0; frame < l_Frames; frame++)
+    {
+        int scancode = 4 + (int) (frame % 4);
+
+        (*l_KeyDown)(0, scancode);
+        (*l_GetAllKeys)(keys);
+        (*l_KeyUp)(0, scancode);
+        for (port = 0; port < 4; port++)
+        {
+            int expected = (port == 0) ? (frame >= 2 && (frame - 2) % 4 == 0) : (frame % 4 == port);
+
+            if (keys[port].A_BUTTON != expected)
+                job->errors++;
+        }
+    }
+    (*l_GetInputHash)(&job->hash, &job->frames);
+    (*l_RomClosed)();
+}
+
+static void *game_thread(void *arg)
+{
+    SJob *job = (SJob *) arg;
+
+    (*l_InstanceBind)(job->instance);
+    run_game(job);
+    (*l_InstanceBind)(NULL);
+    return NULL;
+}
+
+/* keeps its instance bound while the main thread tries to destroy it, then uses it */
+static void *bound_thread(void *arg)
+{
+    SJob *job = (SJob *) arg;
+    BUTTONS keys[4];
+
+    (*l_InstanceBind)(job->instance);
+    pthread_barrier_wait(&l_Bound);
+    pthread_barrier_wait(&l_Destroyed);
+    (*l_GetAllKeys)(keys);
+    (*l_GetInputHash)(&job->hash, &job->frames);
+    (*l_InstanceBind)(NULL);
+    return NULL;
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    char key[16];
+    SJob reference, *job, bound;
+    pthread_t *thread, bound_id;
+    input_stats before, reset, after;
+    int threads = DEFAULT_THREADS, bad = 0, stats_ok, refused, i;
+    unsigned int errors, late_errors;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin [threads [frames]]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+        threads = atoi(argv[2]);
+    if (argc > 3)
+        l_Frames = atol(argv[3]);
+
+    for (i = 0; i < 4; i++)
+    {
+        char section[32];
+
+        fake_core_keyboard_port(i);
+        snprintf(section, sizeof(section), "Input-SDL-Control%i", i + 1);
+        snprintf(key, sizeof(key), "key(%i)", 'a' + i);
+        fake_core_set(section, "A Button", key);
+    }
+    fake_core_set("Input-SDL-Control1", "InputDelay", "2");
+    fake_core_start_plugin(argv[1]);
+
+    l_InitiateControllers = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    l_RomOpen = (ptr_RomOpen) fake_core_get("RomOpen");
+    l_RomClosed = (ptr_RomClosed) fake_core_get("RomClosed");
+    l_KeyDown = (ptr_SDL_KeyDown) fake_core_get("SDL_KeyDown");
+    l_KeyUp = (ptr_SDL_KeyUp) fake_core_get("SDL_KeyUp");
+    l_GetAllKeys = (ptr_GetAllKeys) fake_core_get("GetAllKeys");
+    l_GetInputHash = (ptr_GetInputHash) fake_core_get("GetInputHash");
+    l_GetInputStats = (ptr_GetInputStats) fake_core_get("GetInputStats");
+    l_ResetInputStats = (ptr_ResetInputStats) fake_core_get("ResetInputStats");
+    l_InstanceCreate = (ptr_InputInstanceCreate) fake_core_get("InputInstanceCreate");
+    l_InstanceDestroy = (ptr_InputInstanceDestroy) fake_core_get("InputInstanceDestroy");
+    l_InstanceBind = (ptr_InputInstanceBind) fake_core_get("InputInstanceBind");
+
+    /* the default instance, on this thread */
+    run_game(&reference);
+    printf("default instance: %ld wrong buttons in %ld frames\n", reference.errors, l_Frames);
+
+    job = (SJob *) calloc(threads, sizeof(SJob));
+    thread = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    for (i = 0; i < threads; i++)
+        job[i].instance = (*l_InstanceCreate)();
+    for (i = 0; i < threads; i++)
+        pthread_create(&thread[i], NULL, game_thread, &job[i]);
+    for (i = 0; i < threads; i++)
+        pthread_join(thread[i], NULL);
+    for (i = 0; i < threads; i++)
+    {
+        if (job[i].errors != 0 || job[i].hash != reference.hash || job[i].frames != reference.frames)
+            bad++;
+    }
+    printf("%i instances on %i threads: %i differ from the default instance\n", threads, threads, bad);
+
+    /* every instance has its own zero point, also for the counters of the whole plugin */
+    before.size = reset.size = after.size = sizeof(input_stats);
+    (*l_GetInputStats)(&before);
+    (*l_InstanceBind)(job[0].instance);
+    (*l_ResetInputStats)();
+    (*l_GetInputStats)(&reset);
+    (*l_InstanceBind)(NULL);
+    (*l_GetInputStats)(&after);
+    stats_ok = before.config_loads != 0 && before.polls[0] != 0 && reset.config_loads == 0 && reset.polls[0] == 0 &&
+               after.config_loads == before.config_loads && after.polls[0] == before.polls[0];
+    printf("resetting the statistics of one instance: %s\n", stats_ok ? "the others kept theirs" : "CHANGED the others");
+
+    /* destroying an instance which another thread has bound must fail, and leave the instance usable */
+    errors = fake_core_messages(M64MSG_ERROR);
+    bound.instance = (*l_InstanceCreate)();
+    pthread_barrier_init(&l_Bound, NULL, 2);
+    pthread_barrier_init(&l_Destroyed, NULL, 2);
+    pthread_create(&bound_id, NULL, bound_thread, &bound);
+    pthread_barrier_wait(&l_Bound);
+    (*l_InstanceDestroy)(bound.instance);
+    refused = fake_core_messages(M64MSG_ERROR) == errors + 1;
+    errors = fake_core_messages(M64MSG_ERROR);
+    pthread_barrier_wait(&l_Destroyed);
+    pthread_join(bound_id, NULL);
+    (*l_InstanceDestroy)(bound.instance);
+    for (i = 0; i < threads; i++)
+        (*l_InstanceDestroy)(job[i].instance);
+    late_errors = fake_core_messages(M64MSG_ERROR) - errors;
+    printf("destroying a bound instance: %s, destroying the unbound ones: %u errors\n", refused ? "refused" : "NOT refused", late_errors);
+
+    fake_core_stop_plugin();
+    free(job);
+    free(thread);
+    return (reference.errors != 0 || bad != 0 || !stats_ok || !refused || late_errors != 0) ? 1 : 0;
+}
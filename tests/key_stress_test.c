@@ -0,0 +1,175 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - key_stress_test.c                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* a front-end's event thread sends SDL_KeyDown()/SDL_KeyUp() as fast as it can while the emulation thread polls
+ * the controllers, on the default instance and on a headless one at the same time.  a key which is held down
+ * must never be lost.  'make tsan' runs it with ThreadSanitizer, on a plugin built with it */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define DEFAULT_POLLS   1000000
+
+typedef struct
+{
+    m64p_handle   instance;
+    volatile int  done;
+    unsigned long events;
+    long          lost;     // polls which didn't see the held key
+    long          seen;     // polls which saw a flapping key
+} SStress;
+
+/* static data definitions */
+static ptr_InitiateControllers l_InitiateControllers;
+static ptr_RomOpen             l_RomOpen;
+static ptr_RomClosed           l_RomClosed;
+static ptr_SDL_KeyDown         l_KeyDown;
+static ptr_SDL_KeyUp           l_KeyUp;
+static ptr_GetAllKeys          l_GetAllKeys;
+static ptr_InputInstanceBind   l_InstanceBind;
+
+static long l_Polls = DEFAULT_POLLS;
+
+/* static functions */
+
+/* key c (port 2) stays down, keys b and d (ports 1 and 3) flap, and out of range keys are ignored */
+static void *event_thread(void *arg)
+{
+    SStress *stress = (SStress *) arg;
+
+    (*l_InstanceBind)(stress->instance);
+    (*l_KeyDown)(0, 6);
+    while (!__atomic_load_n(&stress->done, __ATOMIC_ACQUIRE))
+    {
+        (*l_KeyDown)(0, 5);
+        (*l_KeyDown)(0, 7);
+        (*l_KeyUp)(0, 5);
+        (*l_KeyUp)(0, 7);
+        (*l_KeyDown)(0, 100000);
+        (*l_KeyUp)(0, -3);
+        __atomic_add_fetch(&stress->events, 6, __ATOMIC_RELEASE);
+    }
+    (*l_InstanceBind)(NULL);
+    return NULL;
+}
+
+static void *emulation_thread(void *arg)
+{
+    SStress *stress = (SStress *) arg;
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    BUTTONS keys[4];
+    pthread_t events;
+    long i;
+
+    (*l_InstanceBind)(stress->instance);
+    info.Controls = controls;
+    (*l_InitiateControllers)(info);
+    (*l_RomOpen)();
+
+    pthread_create(&events, NULL, event_thread, stress);
+    while (__atomic_load_n(&stress->events, __ATOMIC_ACQUIRE) == 0)
+        ;
+    for (i = 0; i < l_Polls; i++)
+    {
+        (*l_GetAllKeys)(keys);
+        if (!keys[2].A_BUTTON)
+            stress->lost++;
+        if (keys[1].A_BUTTON || keys[3].A_BUTTON)
+            stress->seen++;
+    }
+    __atomic_store_n(&stress->done, 1, __ATOMIC_RELEASE);
+    pthread_join(events, NULL);
+
+    (*l_RomClosed)();
+    (*l_InstanceBind)(NULL);
+    return NULL;
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    ptr_InputInstanceCreate create;
+    ptr_InputInstanceDestroy destroy;
+    SStress stress[2];
+    pthread_t headless;
+    char key[16];
+    int i, failed = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin [polls]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+        l_Polls = atol(argv[2]);
+
+    for (i = 0; i < 4; i++)
+    {
+        char section[32];
+
+        fake_core_keyboard_port(i);
+        snprintf(section, sizeof(section), "Input-SDL-Control%i", i + 1);
+        snprintf(key, sizeof(key), "key(%i)", 'a' + i);
+        fake_core_set(section, "A Button", key);
+    }
+    fake_core_start_plugin(argv[1]);
+
+    l_InitiateControllers = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    l_RomOpen = (ptr_RomOpen) fake_core_get("RomOpen");
+    l_RomClosed = (ptr_RomClosed) fake_core_get("RomClosed");
+    l_KeyDown = (ptr_SDL_KeyDown) fake_core_get("SDL_KeyDown");
+    l_KeyUp = (ptr_SDL_KeyUp) fake_core_get("SDL_KeyUp");
+    l_GetAllKeys = (ptr_GetAllKeys) fake_core_get("GetAllKeys");
+    l_InstanceBind = (ptr_InputInstanceBind) fake_core_get("InputInstanceBind");
+    create = (ptr_InputInstanceCreate) fake_core_get("InputInstanceCreate");
+    destroy = (ptr_InputInstanceDestroy) fake_core_get("InputInstanceDestroy");
+
+    /* a headless instance on its own thread, and the default instance, which uses SDL, on the main thread */
+    for (i = 0; i < 2; i++)
+    {
+        stress[i].done = 0;
+        stress[i].events = 0;
+        stress[i].lost = stress[i].seen = 0;
+    }
+    stress[0].instance = NULL;
+    stress[1].instance = (*create)();
+    pthread_create(&headless, NULL, emulation_thread, &stress[1]);
+    emulation_thread(&stress[0]);
+    pthread_join(headless, NULL);
+
+    for (i = 0; i < 2; i++)
+    {
+        printf("%s instance: %ld polls, %lu key events: held key lost %ld times, flapping keys seen %ld times\n",
+               i == 0 ? "default" : "headless", l_Polls, stress[i].events, stress[i].lost, stress[i].seen);
+        if (stress[i].lost != 0)
+            failed = 1;
+    }
+    (*destroy)(stress[1].instance);
+
+    fake_core_stop_plugin();
+    return failed;
+}
@@ -0,0 +1,221 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - shm_bench.c                                   *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* measures how many frames per second go from a producer through the shared memory input to GetAllKeys(),
+ * free running and in lockstep, and checks that no poll gets a torn frame and that lockstep delivers every
+ * frame exactly once and in order, also while the producer keeps rewriting the slot which is being read */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define DEFAULT_FRAMES  2000000
+/* the rewriting producer hands over one frame at a time, so it runs fewer of them */
+#define REWRITE_DIVISOR 100
+/* polls of read_index between two rewrites of a slot */
+#define REWRITE_PAUSE   64
+
+enum EMode
+{
+    FREE_RUNNING = 0,
+    LOCKSTEP,
+    LOCKSTEP_REWRITE,   // lockstep, and the producer keeps rewriting the last slot until it has been read
+    NUM_MODES
+};
+
+typedef struct
+{
+    input_shm_header *shm;
+    int               mode;
+    volatile int      done;
+    unsigned int      published;
+} SProducer;
+
+/* static data definitions */
+static ptr_GetAllKeys l_GetAllKeys;
+static char           l_ShmName[64];
+static const char    *l_ModeNames[NUM_MODES] = { "free running:", "lockstep:", "rewriting:" };
+
+/* static functions */
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* writes a slot as described in input_ext.h: frame f holds f * 4 + n for port n.  with Torn, the slot
+ * holds garbage for a while between the two increments of seq */
+static void write_slot(input_shm_frame *Slot, unsigned int Frame, int Torn)
+{
+    int port;
+
+    __atomic_store_n(&Slot->seq, Slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (Torn)
+    {
+        for (port = 0; port < 4; port++)
+            __atomic_store_n(&Slot->buttons[port], 0xdead0000u + port, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    Slot->frame = Frame;
+    Slot->ports = 0xf;
+    for (port = 0; port < 4; port++)
+        Slot->buttons[port] = Frame * 4 + port;
+    __atomic_store_n(&Slot->seq, Slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void *producer_thread(void *arg)
+{
+    SProducer *producer = (SProducer *) arg;
+    input_shm_header *shm = producer->shm;
+    unsigned int frame = 0;
+
+    while (!__atomic_load_n(&producer->done, __ATOMIC_ACQUIRE))
+    {
+        unsigned int w = shm->write_index;
+        unsigned int r = __atomic_load_n(&shm->read_index, __ATOMIC_ACQUIRE);
+        int i;
+
+        if (producer->mode == LOCKSTEP_REWRITE && w != r)
+        {
+            /* the frame before w hasn't been read yet: write it again, then leave the reader a gap */
+            write_slot(&shm->ring[(w - 1) % INPUT_SHM_RING_SIZE], w - 1, 1);
+            for (i = 0; i < REWRITE_PAUSE && __atomic_load_n(&shm->read_index, __ATOMIC_ACQUIRE) == r; i++)
+                ;
+            continue;
+        }
+        if (producer->mode == LOCKSTEP && w - r >= INPUT_SHM_RING_SIZE)
+        {
+            sched_yield();
+            continue;
+        }
+        write_slot(&shm->ring[w % INPUT_SHM_RING_SIZE], frame, 0);
+        __atomic_store_n(&shm->write_index, w + 1, __ATOMIC_RELEASE);
+        frame++;
+    }
+    producer->published = frame;
+    return NULL;
+}
+
+/* runs a rom with the producer on another thread; returns the polls which didn't get the expected frame */
+static long run(int Mode, long Frames, ptr_RomOpen RomOpen, ptr_RomClosed RomClosed)
+{
+    SProducer producer;
+    pthread_t thread;
+    BUTTONS keys[4];
+    long frame, wrong = 0;
+    unsigned int last = 0;
+    double start, seconds;
+    int fd, port;
+
+    fake_core_set("Input-SDL", "SharedMemoryLockstep", Mode != FREE_RUNNING ? "True" : "False");
+    (*RomOpen)();
+
+    /* the plugin has created the object */
+    fd = shm_open(l_ShmName, O_RDWR, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "couldn't open the shared memory object %s\n", l_ShmName);
+        exit(2);
+    }
+    producer.shm = (input_shm_header *) mmap(NULL, sizeof(input_shm_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    producer.mode = Mode;
+    producer.done = 0;
+    pthread_create(&thread, NULL, producer_thread, &producer);
+    while (__atomic_load_n(&producer.shm->write_index, __ATOMIC_ACQUIRE) == 0)
+        ;
+
+    start = now();
+    for (frame = 0; frame < Frames; frame++)
+    {
+        (*l_GetAllKeys)(keys);
+        for (port = 0; port < 4; port++)
+        {
+            /* all ports come from the same frame; in lockstep every frame comes exactly once, free
+             * running the frames never go back */
+            if (keys[port].Value != keys[0].Value + port)
+                wrong++;
+            else if (Mode != FREE_RUNNING ? keys[port].Value != (unsigned int) (frame * 4 + port) : keys[port].Value < last)
+                wrong++;
+        }
+        last = keys[0].Value;
+    }
+    seconds = now() - start;
+
+    __atomic_store_n(&producer.done, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    printf("%-12s %7.2f M frames/s (%5.0f ns per frame of 4 ports), %u frames published, %ld wrong\n",
+           l_ModeNames[Mode], Frames / seconds / 1e6, seconds * 1e9 / Frames, producer.published, wrong);
+    munmap(producer.shm, sizeof(input_shm_header));
+    (*RomClosed)();
+    return wrong;
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    ptr_InitiateControllers initiate;
+    ptr_RomOpen rom_open;
+    ptr_RomClosed rom_closed;
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    long frames = DEFAULT_FRAMES, wrong;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin [frames]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+        frames = atol(argv[2]);
+
+    for (i = 0; i < 4; i++)
+        fake_core_keyboard_port(i);
+    snprintf(l_ShmName, sizeof(l_ShmName), "/m64p-shm-bench-%i", (int) getpid());
+    fake_core_set("Input-SDL", "SharedMemoryName", l_ShmName);
+    fake_core_start_plugin(argv[1]);
+    initiate = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    rom_open = (ptr_RomOpen) fake_core_get("RomOpen");
+    rom_closed = (ptr_RomClosed) fake_core_get("RomClosed");
+    l_GetAllKeys = (ptr_GetAllKeys) fake_core_get("GetAllKeys");
+    info.Controls = controls;
+    (*initiate)(info);
+
+    wrong = run(FREE_RUNNING, frames, rom_open, rom_closed);
+    wrong += run(LOCKSTEP, frames, rom_open, rom_closed);
+    wrong += run(LOCKSTEP_REWRITE, frames / REWRITE_DIVISOR, rom_open, rom_closed);
+
+    fake_core_stop_plugin();
+    return wrong != 0;
+}
@@ -0,0 +1,268 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus-input-sdl - tpak_bench.c                                  *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* drives the plugin's transfer pak through ControllerCommand() with the command stream of a Stadium-style
+ * game: a sweep over all ROM banks of a Game Boy cartridge, then a mix of save RAM writes and reads.  checks
+ * every block which is read back and reports the commands per second and the throughput of the data */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "m64p_plugin.h"
+#include "m64p_types.h"
+#include "input_ext.h"
+#include "fake_core.h"
+
+#define RUNS            20
+#define RAM_ROUNDS      8
+
+#define RD_READPAK      0x02
+#define RD_WRITEPAK     0x03
+
+/* a 1 MiB MBC3 cartridge with 32 KiB of battery RAM */
+#define ROM_BANKS       64
+#define ROM_BANK_SIZE   0x4000
+#define RAM_BANKS       4
+#define RAM_BANK_SIZE   0x2000
+
+/* static data definitions */
+static ptr_ControllerCommand l_Command;
+static unsigned char         l_Pif[38];
+static unsigned long         l_Commands;
+static long                  l_Wrong;
+
+/* static functions */
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned char rom_byte(unsigned int Offset)
+{
+    return (unsigned char) (Offset * 7 + (Offset >> 14));
+}
+
+static int write_rom(const char *Path)
+{
+    unsigned char *rom = (unsigned char *) malloc(ROM_BANKS * ROM_BANK_SIZE);
+    unsigned int i;
+    FILE *f;
+
+    for (i = 0; i < ROM_BANKS * ROM_BANK_SIZE; i++)
+        rom[i] = rom_byte(i);
+    memset(rom + 0x134, 0, 16);
+    memcpy(rom + 0x134, "TPAK BENCH", 10);
+    rom[0x147] = 0x13;      // MBC3 + RAM + battery
+    rom[0x149] = 0x03;      // 32 KiB RAM
+    f = fopen(Path, "wb");
+    if (f == NULL || fwrite(rom, 1, ROM_BANKS * ROM_BANK_SIZE, f) != ROM_BANKS * ROM_BANK_SIZE)
+    {
+        if (f != NULL)
+            fclose(f);
+        free(rom);
+        return 0;
+    }
+    fclose(f);
+    free(rom);
+    return 1;
+}
+
+/* one pak command on port 1, answered at the end of the pif pass like the core does it */
+static void pak_command(int Command, unsigned int Address, const unsigned char *Data)
+{
+    l_Pif[0] = (Command == RD_WRITEPAK) ? 35 : 3;
+    l_Pif[1] = (Command == RD_WRITEPAK) ? 1 : 33;
+    l_Pif[2] = (unsigned char) Command;
+    l_Pif[3] = (unsigned char) (Address >> 8);
+    l_Pif[4] = (unsigned char) (Address & 0xE0);
+    if (Data != NULL)
+        memcpy(&l_Pif[5], Data, 32);
+    (*l_Command)(0, l_Pif);
+    (*l_Command)(-1, NULL);
+    l_Commands++;
+}
+
+static void pak_write_value(unsigned int Address, unsigned char Value)
+{
+    unsigned char data[32];
+
+    memset(data, Value, 32);
+    pak_command(RD_WRITEPAK, Address, data);
+}
+
+/* writes a GB register or memory through the 0xC000-0xFFFF window of the transfer pak */
+static void gb_write_value(unsigned int GbAddress, unsigned char Value)
+{
+    pak_write_value(0xA000, (unsigned char) (GbAddress >> 14));
+    pak_write_value(0xC000 + (GbAddress & 0x3FFF), Value);
+}
+
+/* every bank of the ROM, read 32 bytes at a time */
+static void rom_sweep(void)
+{
+    unsigned int bank, offset;
+
+    for (bank = 1; bank < ROM_BANKS; bank++)
+    {
+        gb_write_value(0x2000, (unsigned char) bank);
+        pak_write_value(0xA000, 1);
+        for (offset = 0; offset < ROM_BANK_SIZE; offset += 32)
+        {
+            pak_command(RD_READPAK, 0xC000 + offset, NULL);
+            if (l_Pif[5] != rom_byte(bank * ROM_BANK_SIZE + offset) ||
+                l_Pif[36] != rom_byte(bank * ROM_BANK_SIZE + offset + 31))
+                l_Wrong++;
+        }
+    }
+}
+
+/* every block of every RAM bank is written and read back */
+static void ram_mix(unsigned int Round)
+{
+    unsigned char data[32];
+    unsigned int bank, offset;
+
+    gb_write_value(0x0000, 0x0A);
+    for (bank = 0; bank < RAM_BANKS; bank++)
+    {
+        gb_write_value(0x4000, (unsigned char) bank);
+        pak_write_value(0xA000, 2);
+        for (offset = 0; offset < RAM_BANK_SIZE; offset += 32)
+        {
+            memset(data, (int) (Round + bank + offset / 32), 32);
+            pak_command(RD_WRITEPAK, 0xE000 + offset, data);
+            pak_command(RD_READPAK, 0xE000 + offset, NULL);
+            if (memcmp(&l_Pif[5], data, 32) != 0)
+                l_Wrong++;
+        }
+    }
+}
+
+/* best time of a few runs, in seconds; Commands is set to the commands sent by a run */
+static double time_run(void (*Run)(unsigned int), unsigned long *Commands)
+{
+    double best = 1e9;
+    int run;
+
+    for (run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        double seconds;
+
+        l_Commands = 0;
+        (*Run)((unsigned int) run);
+        seconds = now() - start;
+        if (seconds < best)
+            best = seconds;
+    }
+    *Commands = l_Commands;
+    return best;
+}
+
+static void run_rom_sweep(unsigned int Round)
+{
+    (void) Round;
+    rom_sweep();
+}
+
+static void run_ram_mix(unsigned int Round)
+{
+    unsigned int i;
+
+    for (i = 0; i < RAM_ROUNDS; i++)
+        ram_mix(Round * RAM_ROUNDS + i);
+}
+
+static void report(const char *Name, double Seconds, unsigned long Commands, unsigned long Blocks)
+{
+    printf("%-15s %8lu commands, %5.1f ns per command, %6.1f MB/s of pak data\n", Name, Commands,
+           Seconds * 1e9 / Commands, Blocks * 32 / Seconds / 1e6);
+}
+
+/* global functions */
+int main(int argc, char **argv)
+{
+    ptr_InitiateControllers initiate;
+    ptr_RomOpen rom_open;
+    ptr_RomClosed rom_closed;
+    CONTROL controls[4];
+    CONTROL_INFO info;
+    char rom[64], sav[64];
+    unsigned long commands;
+    double seconds;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s plugin\n", argv[0]);
+        return 2;
+    }
+
+    snprintf(rom, sizeof(rom), "/tmp/tpak-bench-%i.gb", (int) getpid());
+    snprintf(sav, sizeof(sav), "/tmp/tpak-bench-%i.sav", (int) getpid());
+    if (!write_rom(rom))
+    {
+        fprintf(stderr, "couldn't write %s\n", rom);
+        return 2;
+    }
+
+    /* the transfer pak of the default instance, on a RawData port */
+    for (i = 0; i < 4; i++)
+        fake_core_keyboard_port(i);
+    fake_core_set("Input-SDL-Control1", "RawData", "True");
+    fake_core_set("Input-SDL-Control1", "plugin", "4");
+    fake_core_set("Input-SDL-Control1", "TransferPakROM", rom);
+    fake_core_set("Input-SDL-Control1", "TransferPakSav", sav);
+    fake_core_start_plugin(argv[1]);
+    initiate = (ptr_InitiateControllers) fake_core_get("InitiateControllers");
+    rom_open = (ptr_RomOpen) fake_core_get("RomOpen");
+    rom_closed = (ptr_RomClosed) fake_core_get("RomClosed");
+    l_Command = (ptr_ControllerCommand) fake_core_get("ControllerCommand");
+    info.Controls = controls;
+    (*initiate)(info);
+    (*rom_open)();
+    if (!controls[0].RawData || controls[0].Plugin != PLUGIN_TRANSFER_PAK)
+    {
+        fprintf(stderr, "port 1 doesn't have a RawData transfer pak\n");
+        return 2;
+    }
+
+    /* power the transfer pak on and select access mode 1, as the games do */
+    pak_write_value(0x8000, 0x84);
+    pak_write_value(0xB000, 0x01);
+
+    seconds = time_run(run_rom_sweep, &commands);
+    report("ROM bank sweep:", seconds, commands, (ROM_BANKS - 1) * (ROM_BANK_SIZE / 32));
+    seconds = time_run(run_ram_mix, &commands);
+    report("save RAM mix:", seconds, commands, RAM_ROUNDS * RAM_BANKS * (RAM_BANK_SIZE / 32) * 2);
+    printf("%ld blocks read back wrong\n", l_Wrong);
+
+    (*rom_closed)();
+    fake_core_stop_plugin();
+    unlink(rom);
+    unlink(sav);
+    return l_Wrong != 0;
+}